@@ -161,10 +161,82 @@ typedef enum {
 	/// The supplied max_buf should be scaled by 0.001.
 	transp_bufsize_thousandths = 2,
 
+	/// Outlets only: send data to all connected inlets from the outlet's I/O thread instead of
+	/// using one transfer thread per connected inlet. Scales better with many inlets.
+	transp_async_sender = 4,
+
+	/// Inlets only: ask the outlet to send integer values as differences to the previous sample.
+	/// Saves bandwidth for slowly varying signals (e.g., EEG) at the cost of some CPU time.
+	transp_delta_encoding = 8,
+
 	// prevent compilers from assuming an instance fits in a single byte
 	_lsl_transport_options_maxval = 0x7f000000
 } lsl_transport_options_t;
 
+/// Receive modes for stream inlets, see lsl_set_inlet_mode()
+typedef enum {
+	/// Block until data arrives; the data socket is read via an I/O event loop.
+	inlet_mode_default = 0,
+
+	/// Spin for a configurable time before blocking and busy-poll the data socket.
+	/// Lowers the delivery latency at the cost of keeping CPU cores busy.
+	inlet_mode_busy_poll = 1,
+
+	// prevent compilers from assuming an instance fits in a single byte
+	_inlet_mode_maxval = 0x7f000000
+} lsl_inlet_mode_t;
+
+/**
+ * Runtime statistics of an outlet, see lsl_get_outlet_stats().
+ *
+ * Counters start at 0 when the outlet is created. Distributions are summarized by their median
+ * (p50), 99th percentile (p99) and maximum; the percentiles have a relative error below 12.5%.
+ */
+typedef struct {
+	/// number of samples pushed into the outlet
+	uint64_t samples_pushed;
+	/// number of samples dropped because an inlet didn't keep up, summed over all inlets
+	uint64_t samples_dropped;
+	/// number of samples currently waiting to be sent, summed over all inlets
+	uint64_t samples_queued;
+	/// number of inlets that connected to the data port
+	uint64_t sessions_accepted;
+	/// number of inlets currently connected to the data port
+	uint64_t sessions_active;
+	/// number of chunks (i.e., socket writes) sent to inlets
+	uint64_t chunks_sent;
+	/// number of bytes sent to inlets
+	uint64_t bytes_sent;
+	/// number of samples per chunk
+	uint64_t chunk_samples_p50, chunk_samples_p99, chunk_samples_max;
+	/// time until a chunk was written to the socket, in microseconds
+	uint64_t write_us_p50, write_us_p99, write_us_max;
+} lsl_outlet_stats;
+
+/**
+ * Runtime statistics of an inlet, see lsl_get_inlet_stats().
+ *
+ * Counters start at 0 when the inlet is created.
+ */
+typedef struct {
+	/// number of samples received from the outlet
+	uint64_t samples_received;
+	/// number of samples lost before the pulled samples (see lsl_inlet_dropped_samples())
+	uint64_t samples_dropped;
+	/// number of samples currently waiting to be pulled
+	uint64_t samples_queued;
+	/// number of times the connection was re-established, e.g. after the outlet restarted
+	uint64_t reconnects;
+	/// number of time synchronization probes answered by the outlet
+	uint64_t time_probes;
+	/// round trip time of the time synchronization probes, in microseconds
+	uint64_t rtt_us_p50, rtt_us_p99, rtt_us_max;
+	/// the last estimated clock offset to the outlet's host (0 if there's no estimate yet)
+	double time_correction;
+	/// the uncertainty (round trip time) of the last clock offset estimate
+	double time_uncertainty;
+} lsl_inlet_stats;
+
 /// Return an explanation for the last error
 extern LIBLSL_C_API const char *lsl_last_error(void);
 
@@ -228,4 +300,24 @@ extern LIBLSL_C_API double lsl_local_clock();
  */
 extern LIBLSL_C_API void lsl_destroy_string(char *s);
 
+/**
+ * Get the statistics of all outlets and inlets of this process in the Prometheus text format.
+ *
+ * The metrics are those of lsl_get_outlet_stats() and lsl_get_inlet_stats(), prefixed with
+ * `lsl_outlet_` and `lsl_inlet_` and labeled with the stream's name, type, source_id and uid.
+ * The text can e.g. be served to a Prometheus server via HTTP or a socket.
+ * @return The text, to be deallocated with lsl_destroy_string(), or NULL in case of an error.
+ */
+extern LIBLSL_C_API char *lsl_get_metrics_text(void);
+
+/**
+ * Write the statistics of all outlets and inlets to a file in the Prometheus text format.
+ *
+ * The file is replaced atomically, so it can be read at any time (e.g. by the textfile collector
+ * of a node exporter).
+ * @return #lsl_no_error, #lsl_argument_error if no filename is given or #lsl_internal_error if
+ * the file couldn't be written.
+ */
+extern LIBLSL_C_API int32_t lsl_write_metrics(const char *filename);
+
 extern LIBLSL_C_API void lsl_add_log_callback(const char* id, void (*callback)(), void* user_data, int verbosity);
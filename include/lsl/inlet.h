@@ -173,6 +173,22 @@ extern LIBLSL_C_API double lsl_time_correction_ex(lsl_inlet in, double *remote_t
  */
 extern LIBLSL_C_API int32_t lsl_set_postprocessing(lsl_inlet in, uint32_t flags);
 
+/**
+ * Set the receive mode of the inlet.
+ *
+ * In #inlet_mode_busy_poll mode, pull calls spin for up to `spin_us` microseconds before they
+ * block, and the data connection polls its socket with non-blocking reads (and `SO_BUSY_POLL`
+ * where available) for the same time before falling back to the I/O event loop.
+ * This reduces the delivery latency for closed-loop applications, but keeps the pulling thread
+ * and the inlet's receive thread busy, so it only helps if both have a CPU core of their own.
+ * @param in The lsl_inlet object to act on.
+ * @param mode One of #lsl_inlet_mode_t.
+ * @param spin_us The spinning time in microseconds (ignored for #inlet_mode_default).
+ * @return The error code: if nonzero, can be #lsl_argument_error if an unknown mode or a negative
+ * spinning time was passed in.
+ */
+extern LIBLSL_C_API int32_t lsl_set_inlet_mode(lsl_inlet in, lsl_inlet_mode_t mode, int32_t spin_us);
+
 
 /* === Pulling a sample from the inlet === */
 
@@ -314,6 +330,24 @@ extern LIBLSL_C_API uint32_t lsl_samples_available(lsl_inlet in);
 /// Drop all queued not-yet pulled samples, return the nr of dropped samples
 extern LIBLSL_C_API uint32_t lsl_inlet_flush(lsl_inlet in);
 
+/**
+* Get the number of samples that were lost before the samples pulled so far.
+*
+* This counts the samples the outlet had to drop because they weren't sent in time (if the outlet
+* supports sequence numbers) and the samples dropped by the inlet because its buffer was full.
+* Samples discarded by lsl_inlet_flush() aren't counted.
+*/
+extern LIBLSL_C_API uint64_t lsl_inlet_dropped_samples(lsl_inlet in);
+
+/**
+* Get the runtime statistics of an inlet, e.g. to monitor it.
+*
+* @param in The inlet.
+* @param[out] stats The statistics, see #lsl_inlet_stats.
+* @return #lsl_no_error, or #lsl_argument_error if stats is NULL.
+*/
+extern LIBLSL_C_API int32_t lsl_get_inlet_stats(lsl_inlet in, lsl_inlet_stats *stats);
+
 /**
 * Query whether the clock was potentially reset since the last call to lsl_was_clock_reset().
 *
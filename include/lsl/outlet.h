@@ -238,6 +238,53 @@ extern LIBLSL_C_API int32_t lsl_have_consumers(lsl_outlet out);
 */
 extern LIBLSL_C_API int32_t lsl_wait_for_consumers(lsl_outlet out, double timeout);
 
+/**
+ * Set when the samples buffered for a consumer are sent off.
+ *
+ * A chunk is sent once any of the limits is reached or a sample was pushed with the pushthrough
+ * flag set; a limit of 0 is not checked. The default is the outlet's `chunk_size` with no byte or
+ * time limit. A time limit bounds the latency of low-rate streams with a large chunk size, a byte
+ * limit lets the connection fill whole TCP segments before sending them.
+ * The policy applies to consumers that connect afterwards, and a consumer's `max_chunklen` takes
+ * precedence over `max_samples`.
+ * @param out The lsl_outlet object to act on.
+ * @param max_samples Send a chunk once it holds this many samples.
+ * @param max_bytes Send a chunk once it holds this many serialized bytes.
+ * @param max_delay_us Send a chunk at most this many microseconds after its first sample was
+ * pushed.
+ * @return The error code: if nonzero, can be #lsl_argument_error if a negative limit was passed in.
+ */
+extern LIBLSL_C_API int32_t lsl_set_outlet_flush_policy(
+	lsl_outlet out, int32_t max_samples, int32_t max_bytes, int32_t max_delay_us);
+
+/**
+ * Keep the most recent samples in a memory-mapped ring buffer file.
+ *
+ * Inlets that reconnect after a connection loss then receive the samples they missed instead of
+ * only those pushed after the reconnect, as long as these are still in the history. Since the
+ * history is backed by a file, it can cover minutes of data without keeping them in memory.
+ * The file is replaced if it exists and removed when the history is disabled or the outlet is
+ * destroyed. Only supported on Linux.
+ * @param out The lsl_outlet object to act on.
+ * @param filename The file to keep the history in, or NULL to disable the history.
+ * @param max_history The length of the history in seconds (if the stream has a nominal sampling
+ * rate, otherwise x100 in samples).
+ * @return The error code: if nonzero, can be #lsl_argument_error if max_history is not positive or
+ * #lsl_internal_error if the file couldn't be created.
+ */
+extern LIBLSL_C_API int32_t lsl_set_outlet_history(
+	lsl_outlet out, const char *filename, double max_history);
+
+/**
+ * Get the runtime statistics of an outlet, e.g. to monitor it.
+ *
+ * Collecting them doesn't interfere with pushing samples.
+ * @param out The outlet.
+ * @param[out] stats The statistics, see #lsl_outlet_stats.
+ * @return #lsl_no_error, or #lsl_argument_error if stats is NULL.
+ */
+extern LIBLSL_C_API int32_t lsl_get_outlet_stats(lsl_outlet out, lsl_outlet_stats *stats);
+
 /**
  * Retrieve a handle to the stream info provided by this outlet.
  * This is what was used to create the stream (and also has the Additional Network Information
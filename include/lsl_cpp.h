@@ -798,6 +798,37 @@ public:
 	 */
 	bool wait_for_consumers(double timeout) { return lsl_wait_for_consumers(obj.get(), timeout) != 0; }
 
+	/** Set when the samples buffered for a consumer are sent off.
+	 *
+	 * See lsl_set_outlet_flush_policy() for details.
+	 * @param max_samples Send a chunk once it holds this many samples (0: no limit).
+	 * @param max_bytes Send a chunk once it holds this many serialized bytes (0: no limit).
+	 * @param max_delay_us Send a chunk at most this many microseconds after its first sample
+	 * was pushed (0: no limit).
+	 */
+	void set_flush_policy(int32_t max_samples, int32_t max_bytes = 0, int32_t max_delay_us = 0) {
+		check_error(lsl_set_outlet_flush_policy(obj.get(), max_samples, max_bytes, max_delay_us));
+	}
+
+	/** Keep the most recent samples in a file so reconnecting inlets can catch up.
+	 *
+	 * See lsl_set_outlet_history() for details.
+	 * @param filename The file to keep the history in (empty to disable the history).
+	 * @param max_history The length of the history in seconds (if the stream has a nominal
+	 * sampling rate, otherwise x100 in samples).
+	 */
+	void set_history(const std::string &filename, double max_history) {
+		check_error(lsl_set_outlet_history(
+			obj.get(), filename.empty() ? nullptr : filename.c_str(), max_history));
+	}
+
+	/// Get the runtime statistics of the outlet, see lsl_get_outlet_stats().
+	lsl_outlet_stats stats() const {
+		lsl_outlet_stats result;
+		check_error(lsl_get_outlet_stats(obj.get(), &result));
+		return result;
+	}
+
 	/** Retrieve the stream info provided by this outlet.
 	 * This is what was used to create the stream (and also has the Additional Network Information
 	 * fields assigned).
@@ -1090,6 +1121,17 @@ public:
 		check_error(lsl_set_postprocessing(obj.get(), flags));
 	}
 
+	/** Set the receive mode of the inlet.
+	 *
+	 * With `inlet_mode_busy_poll`, pulls spin for up to `spin_us` microseconds before blocking
+	 * and the data socket is busy-polled, trading CPU time for a lower delivery latency.
+	 * @param mode The receive mode, see lsl_inlet_mode_t.
+	 * @param spin_us The spinning time in microseconds (ignored for `inlet_mode_default`).
+	 */
+	void set_mode(lsl_inlet_mode_t mode, int32_t spin_us = 100) {
+		check_error(lsl_set_inlet_mode(obj.get(), mode, spin_us));
+	}
+
 	// =======================================
 	// === Pulling a sample from the inlet ===
 	// =======================================
@@ -1522,6 +1564,20 @@ public:
 	/// Drop all queued not-yet pulled samples, return the nr of dropped samples
 	uint32_t flush() noexcept { return lsl_inlet_flush(obj.get()); }
 
+	/**
+	 * Get the number of samples that were lost before the samples pulled so far, i.e. samples
+	 * the outlet couldn't send in time and samples dropped because the inlet's buffer was full.
+	 * See lsl_inlet_dropped_samples() for details.
+	 */
+	uint64_t dropped_samples() const { return lsl_inlet_dropped_samples(obj.get()); }
+
+	/// Get the runtime statistics of the inlet, see lsl_get_inlet_stats().
+	lsl_inlet_stats stats() const {
+		lsl_inlet_stats result;
+		check_error(lsl_get_inlet_stats(obj.get(), &result));
+		return result;
+	}
+
 	/**
 	 * Query whether the clock was potentially reset since the last call to was_clock_reset().
 	 *
@@ -254,6 +254,8 @@ void api_config::load_from_file(const std::string &filename) {
 		time_probe_count_ = pt.get("tuning.TimeProbeCount", 8);
 		time_probe_interval_ = pt.get("tuning.TimeProbeInterval", 0.064);
 		time_probe_max_rtt_ = pt.get("tuning.TimeProbeMaxRTT", 0.128);
+		time_drift_window_ = pt.get("tuning.TimeDriftWindow", 30);
+		kernel_timestamps_ = pt.get("tuning.KernelTimestamps", true);
 		outlet_buffer_reserve_ms_ = pt.get("tuning.OutletBufferReserveMs", 5000);
 		outlet_buffer_reserve_samples_ = pt.get("tuning.OutletBufferReserveSamples", 128);
 		socket_send_buffer_size_ = pt.get("tuning.SendSocketBufferSize", 0);
@@ -262,6 +264,7 @@ void api_config::load_from_file(const std::string &filename) {
 		socket_receive_buffer_size_ = pt.get("tuning.ReceiveSocketBufferSize", 0);
 		smoothing_halftime_ = pt.get("tuning.SmoothingHalftime", 90.0F);
 		force_default_timestamps_ = pt.get("tuning.ForceDefaultTimestamps", false);
+		numa_local_samples_ = pt.get("tuning.NumaLocalSamples", false);
 
 		// log config filename only after setting the verbosity level and all config has been read
 		if (!filename.empty())
@@ -182,6 +182,10 @@ public:
 	double time_probe_interval() const { return time_probe_interval_; }
 	/// Maximum assumed RTT of a time probe (= extra waiting time).
 	double time_probe_max_rtt() const { return time_probe_max_rtt_; }
+	/// Number of time updates the drift of a remote clock is estimated from.
+	int time_drift_window() const { return time_drift_window_; }
+	/// Take the receive times of time probes from the kernel's time stamps, if supported.
+	bool kernel_timestamps() const { return kernel_timestamps_; }
 	/// Default pre-allocated buffer size for the outlet, in ms (regular streams).
 	int outlet_buffer_reserve_ms() const { return outlet_buffer_reserve_ms_; }
 	/// Default pre-allocated buffer size for the outlet, in samples (irregular streams).
@@ -198,6 +202,9 @@ public:
 	float smoothing_halftime() const { return smoothing_halftime_; }
 	/// Override timestamps with lsl clock if True
 	bool force_default_timestamps() const { return force_default_timestamps_; }
+	/// Allocate the sample pools of outlets and inlets on the NUMA node of the thread producing
+	/// the samples (Linux only).
+	bool numa_local_samples() const { return numa_local_samples_; }
 
 	/// Deleted copy constructor (noncopyable).
 	api_config(const api_config &rhs) = delete;
@@ -249,6 +256,8 @@ private:
 	int time_probe_count_;
 	double time_probe_interval_;
 	double time_probe_max_rtt_;
+	int time_drift_window_;
+	bool kernel_timestamps_;
 	int outlet_buffer_reserve_ms_;
 	int outlet_buffer_reserve_samples_;
 	int socket_send_buffer_size_;
@@ -257,6 +266,7 @@ private:
 	int socket_receive_buffer_size_;
 	float smoothing_halftime_;
 	bool force_default_timestamps_;
+	bool numa_local_samples_;
 };
 } // namespace lsl
 
@@ -15,11 +15,16 @@
 
 #define BOOST_ASIO_NO_DEPRECATED
 #include "cancellation.h"
+#include "common.h"
 #include <asio/basic_stream_socket.hpp>
 #include <asio/io_context.hpp>
 #include <asio/ip/tcp.hpp>
+#include <chrono>
 #include <exception>
 #include <streambuf>
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
 
 using asio::io_context;
 
@@ -99,6 +104,35 @@ public:
 	 */
 	const asio::error_code &error() const { return ec_; }
 
+	/// Start of the received data that hasn't been consumed yet (see `in_buffer_size()`).
+	const char *in_buffer() const { return gptr(); }
+
+	/// Number of bytes that have been received but not consumed yet.
+	std::size_t in_buffer_size() const { return static_cast<std::size_t>(egptr() - gptr()); }
+
+	/// Mark `n` bytes (at most `in_buffer_size()`) of the received data as consumed.
+	void consume(std::size_t n) { gbump(static_cast<int>(n)); }
+
+	/// The OS handle of the socket, e.g. to check its state without reading from it.
+	Socket::native_handle_type native_handle() { return socket().native_handle(); }
+
+	/**
+	 * Poll the connected socket with non-blocking reads for up to `us` microseconds before
+	 * waiting for data via the I/O context (0: wait right away).
+	 */
+	void busy_poll(uint32_t us) {
+		if (us == busy_poll_us_ || !socket().is_open()) return;
+		busy_poll_us_ = us;
+		socket().non_blocking(us != 0, ec_);
+#ifdef SO_BUSY_POLL
+		// also let the kernel poll the device queue on reads; raising it above the
+		// net.core.busy_read default might require CAP_NET_ADMIN, so errors are ignored
+		int kernel_us = static_cast<int>(us);
+		setsockopt(
+			socket().native_handle(), SOL_SOCKET, SO_BUSY_POLL, &kernel_us, sizeof(kernel_us));
+#endif
+	}
+
 protected:
 	/// Close the socket if it's open.
 	void close_if_open() {
@@ -125,20 +159,36 @@ protected:
 		// will be processed by the run_one
 	}
 
+	/// Spin on non-blocking reads for up to busy_poll_us_, return false if no data arrived.
+	bool busy_receive(std::size_t &bytes_transferred) {
+		const auto until =
+			std::chrono::steady_clock::now() + std::chrono::microseconds(busy_poll_us_);
+		do {
+			bytes_transferred =
+				socket().receive(asio::buffer(asio::buffer(get_buffer_) + putback_max), 0, ec_);
+			// data or a real error (to be handled by the caller)
+			if (ec_ != asio::error::would_block) return true;
+			cpu_relax();
+		} while (!cancel_issued_ && std::chrono::steady_clock::now() < until);
+		return false;
+	}
+
 	int_type underflow() override {
 		if (gptr() == egptr()) {
 			std::size_t bytes_transferred_;
-			socket().async_receive(asio::buffer(asio::buffer(get_buffer_) + putback_max),
-				[this, &bytes_transferred_](
-					const asio::error_code &ec, std::size_t bytes_transferred = 0) {
-					this->ec_ = ec;
-					bytes_transferred_ = bytes_transferred;
-				});
-
-			ec_ = asio::error::would_block;
-			protected_reset(); // line changed for lsl
-			do as_context().run_one();
-			while (!cancel_issued_ && ec_ == asio::error::would_block);
+			if (!busy_poll_us_ || !busy_receive(bytes_transferred_)) {
+				socket().async_receive(asio::buffer(asio::buffer(get_buffer_) + putback_max),
+					[this, &bytes_transferred_](
+						const asio::error_code &ec, std::size_t bytes_transferred = 0) {
+						this->ec_ = ec;
+						bytes_transferred_ = bytes_transferred;
+					});
+
+				ec_ = asio::error::would_block;
+				protected_reset(); // line changed for lsl
+				do as_context().run_one();
+				while (!cancel_issued_ && ec_ == asio::error::would_block);
+			}
 			if (ec_) return traits_type::eof();
 
 			setg(&get_buffer_[0], &get_buffer_[0] + putback_max,
@@ -193,6 +243,8 @@ protected:
 	enum { buffer_size = 16384 };
 	char get_buffer_[buffer_size], put_buffer_[buffer_size];
 	asio::error_code ec_;
+	/// time to poll the socket before waiting for data via the I/O context, in microseconds
+	uint32_t busy_poll_us_{0};
 	std::atomic<bool> cancel_issued_{false};
 	bool cancel_started_{false};
 	std::recursive_mutex cancel_mut_;
@@ -1,9 +1,13 @@
 #include "common.h"
 #include "api_config.h"
+#include "metrics.h"
 #include <algorithm>
 #include <cctype>
 #include <chrono>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <loguru.hpp>
 
 #ifdef _WIN32
@@ -41,6 +45,52 @@ LIBLSL_C_API void lsl_destroy_string(char *s) {
 	if (s) free(s);
 }
 
+LIBLSL_C_API char *lsl_get_metrics_text(void) {
+	try {
+		std::string tmp = lsl::metrics_registry::instance().prometheus_text();
+		char *result = (char *)malloc(tmp.size() + 1);
+		if (result == nullptr) {
+			LOG_F(ERROR, "Error allocating memory for the metrics");
+			return nullptr;
+		}
+		memcpy(result, tmp.data(), tmp.size());
+		result[tmp.size()] = '\0';
+		return result;
+	} catch (std::exception &e) {
+		LOG_F(WARNING, "Unexpected error in lsl_get_metrics_text: %s", e.what());
+		return nullptr;
+	}
+}
+
+LIBLSL_C_API int32_t lsl_write_metrics(const char *filename) {
+	if (!filename || !*filename) return lsl_argument_error;
+	try {
+		// write a temporary file first, so readers never see a partially written file
+		const std::string tmpname = std::string(filename) + ".tmp";
+		{
+			std::ofstream out(tmpname, std::ios::binary | std::ios::trunc);
+			out << lsl::metrics_registry::instance().prometheus_text();
+			if (!out.flush()) {
+				LOG_F(WARNING, "Couldn't write the metrics to %s", tmpname.c_str());
+				return lsl_internal_error;
+			}
+		}
+#ifdef _WIN32
+		// rename() doesn't replace existing files on Windows
+		std::remove(filename);
+#endif
+		if (std::rename(tmpname.c_str(), filename) != 0) {
+			LOG_F(WARNING, "Couldn't replace %s with the new metrics", filename);
+			std::remove(tmpname.c_str());
+			return lsl_internal_error;
+		}
+		return lsl_no_error;
+	} catch (std::exception &e) {
+		LOG_F(WARNING, "Unexpected error in lsl_write_metrics: %s", e.what());
+		return lsl_internal_error;
+	}
+}
+
 LIBLSL_C_API const char *lsl_last_error(void) {
 	thread_local char last_error[LAST_ERROR_SIZE] = {0};
 	return last_error;
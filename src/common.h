@@ -25,6 +25,10 @@ extern "C" {
 #include <cstdint>
 #endif
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
 #if BOOST_VERSION < 104500
 #error                                                                                             \
 	"Please do not compile this with a lslboost version older than 1.45 because the library would otherwise not be protocol-compatible with builds using other versions."
@@ -58,6 +62,10 @@ const double FOREVER = LSL_FOREVER;
 /// Constant to indicate that a sample has the next successive time stamp.
 const double DEDUCED_TIMESTAMP = LSL_DEDUCED_TIMESTAMP;
 
+/// Timestamp of the sample tcp_server::end_serving() uses to wake up and stop the transfers.
+/// Not simply negative, since DEDUCED_TIMESTAMP (-1.0) is a valid timestamp in the send buffer.
+const double END_OF_TRANSFER_TIMESTAMP = -2.0;
+
 /// Constant to indicate that a stream has variable sampling rate.
 const double IRREGULAR_RATE = LSL_IRREGULAR_RATE;
 
@@ -70,6 +78,17 @@ inline double lsl_clock() { return lsl_local_clock(); }
 /// Ensure that LSL is initialized.
 void ensure_lsl_initialized();
 
+/// Tell the CPU that the calling thread is busy-waiting
+inline void cpu_relax() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_ia32_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || defined(__arm__))
+	__asm__ __volatile__("yield");
+#endif
+}
+
 /// Exception class that indicates that a stream inlet's source has been irrecoverably lost.
 class LIBLSL_CPP_API lost_error : public std::runtime_error {
 public:
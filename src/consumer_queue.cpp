@@ -5,14 +5,22 @@
 #include <loguru.hpp>
 #include <utility>
 
+#ifdef LSL_FUTEX_WAKEUP
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 using namespace lsl;
 
-consumer_queue::consumer_queue(std::size_t size, send_buffer_p registry)
+consumer_queue::consumer_queue(
+	std::size_t size, send_buffer_p registry, std::function<void()> on_ready)
 	: buffer_(new item_t[size]), size_(size),
 	  // largest integer at which we can wrap correctly
 	  wrap_at_(std::numeric_limits<std::size_t>::max() - size -
 			   std::numeric_limits<std::size_t>::max() % size),
-	  registry_(std::move(registry)) {
+	  registry_(std::move(registry)), on_ready_(std::move(on_ready)) {
 	assert(size_ > 1);
 	for (std::size_t i = 0; i < size_; ++i)
 		buffer_[i].seq_state.store(i, std::memory_order_release);
@@ -36,6 +44,43 @@ uint32_t consumer_queue::flush() noexcept {
 	return n;
 }
 
+void consumer_queue::count_drop(const sample_p &dropped) noexcept {
+	if (registry_ && dropped) registry_->metrics()->samples_dropped.add(dropped->num_samples());
+}
+
+uint64_t consumer_queue::samples_dropped(uint64_t at_least) const {
+	// pairs with the fence in drop_oldest(): a drop that claimed a slot before the caller's pop
+	// is either counted or still in flight
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	for (;;) {
+		const bool settled = drops_in_flight_.load(std::memory_order_acquire) == 0;
+		const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+		if (settled || dropped >= at_least) return dropped;
+		cpu_relax();
+	}
+}
+
+uint64_t gap_tracker::missing_before(const sample &s, const consumer_queue *queue) {
+	const uint64_t seq = s.seq();
+	if (!seq_known_) {
+		// samples dropped before the first pop are reported, too
+		next_seq_ = queue && queue->first_seq() != consumer_queue::no_seq ? queue->first_seq() : seq;
+		seq_known_ = true;
+	}
+	uint64_t missing = 0;
+	if (seq > next_seq_) {
+		missing = seq - next_seq_;
+		if (queue) {
+			// the rest of the hole are samples that are still on their way
+			missing = std::min(missing, queue->samples_dropped(reported_ + missing) - reported_);
+			reported_ += missing;
+		}
+	}
+	// a late sample doesn't move the sequence back
+	next_seq_ = std::max(next_seq_, seq + s.num_samples());
+	return missing;
+}
+
 std::size_t consumer_queue::read_available() const {
 	std::size_t write_index = write_idx_.load(std::memory_order_acquire);
 	std::size_t read_index = read_idx_.load(std::memory_order_relaxed);
@@ -47,3 +92,30 @@ std::size_t consumer_queue::read_available() const {
 bool consumer_queue::empty() const {
 	return write_idx_.load(std::memory_order_acquire) == read_idx_.load(std::memory_order_relaxed);
 }
+
+#ifdef LSL_FUTEX_WAKEUP
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+
+void consumer_queue::park(uint32_t seen, std::chrono::steady_clock::duration timeout) {
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+	timespec ts;
+	ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+	ts.tv_nsec = static_cast<long>(ns % 1000000000);
+	// returns immediately if wake_seq_ has already changed; spurious wakeups are handled by the
+	// caller re-checking the queue
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&wake_seq_), FUTEX_WAIT_PRIVATE, seen, &ts,
+		nullptr, 0);
+}
+
+void consumer_queue::wake_waiter() {
+	wake_seq_.fetch_add(1, std::memory_order_release);
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&wake_seq_), FUTEX_WAKE_PRIVATE, 1, nullptr,
+		nullptr, 0);
+}
+#else
+void consumer_queue::wake_waiter() {
+	// ensure that notify_one doesn't happen in between the waiter's check and wait_until
+	std::lock_guard<std::mutex> lk(mut_);
+	cv_.notify_one();
+}
+#endif
@@ -3,11 +3,21 @@
 
 #include "common.h"
 #include "sample.h"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <mutex>
 #include <thread>
 
+// on Linux, blocked consumers wait on a futex so pushes don't need to acquire a mutex
+#if defined(__linux__) && !defined(LSL_NO_FUTEX)
+#define LSL_FUTEX_WAKEUP
+#endif
+
 namespace lsl {
 
 // size of a cache line
@@ -36,6 +46,10 @@ template <typename E1, typename E2, typename... T> struct Padding {
  *
  * Erases the oldest samples if max capacity is exceeded. Implemented as a ring buffer (wait-free
  * unless the buffer is full or empty).
+ *
+ * A chunk (see factory::new_chunk()) takes one slot of the ring, but counts with all its samples
+ * against the capacity, so whole chunks are dropped until a new one fits. A single chunk that's
+ * larger than the capacity is kept on its own.
  */
 class consumer_queue {
 public:
@@ -45,31 +59,32 @@ public:
 	 * the oldest samples are dropped.
 	 * @param registry Optionally a pointer to a registration facility, for multiple-reader
 	 * arrangements.
+	 * @param on_ready Optionally a function that is called by the pushing thread once samples are
+	 * available after request_ready_callback() was called, e.g. to notify an event loop.
 	 */
-	explicit consumer_queue(std::size_t size, send_buffer_p registry = send_buffer_p());
+	explicit consumer_queue(std::size_t size, send_buffer_p registry = send_buffer_p(),
+		std::function<void()> on_ready = nullptr);
 
 	/// Destructor. Unregisters from the send buffer, if any.
 	~consumer_queue();
 
 	/**
-	 * Push a new sample onto the queue. Can only be called by one thread (single-producer).
+	 * Push a new sample onto the queue. Can be called by multiple threads (multi-producer).
 	 * This deletes the oldest sample if the max capacity is exceeded.
 	 */
 	template <class T> void push_sample(T &&sample) {
-		while (!try_push(std::forward<T>(sample))) {
-			// buffer full, drop oldest sample
-			if (!done_sync_.load(std::memory_order_acquire)) {
-				// synchronizes-with store to done_sync_ in ctor
-				std::atomic_thread_fence(std::memory_order_acquire);
-				done_sync_.store(true, std::memory_order_release);
-			}
-			try_pop();
-		}
-		{
-			// ensure that notify_one doesn't happen in between try_pop and wait_for
-			std::lock_guard<std::mutex> lk(mut_);
-			cv_.notify_one();
-		}
+		push_or_drop(std::forward<T>(sample));
+		notify_pushed();
+	}
+
+	/**
+	 * Push `n` samples onto the queue, moving them out of the given array.
+	 * Waiting consumers are only notified once.
+	 */
+	void push_samples(sample_p *samples, std::size_t n) {
+		if (!n) return;
+		for (std::size_t k = 0; k < n; k++) push_or_drop(std::move(samples[k]));
+		notify_pushed();
 	}
 
 	/**
@@ -80,15 +95,63 @@ public:
 	sample_p pop_sample(double timeout = FOREVER) {
 		sample_p result;
 		bool success = try_pop(result);
-		if (!success && timeout > 0.0) {
-			// only acquire mutex if we have to do a blocking wait with timeout
-			std::chrono::duration<double> sec(timeout);
-			std::unique_lock<std::mutex> lk(mut_);
-			if (!try_pop(result)) cv_.wait_for(lk, sec, [&] { return this->try_pop(result); });
-		}
+		if (!success && timeout > 0.0) wait_pushed(timeout, [&] { return this->try_pop(result); });
 		return result;
 	}
 
+	/**
+	 * Pop up to `max` samples from the queue at once. Can be called by multiple threads.
+	 *
+	 * The available samples are claimed as one contiguous range with a single CAS on the read
+	 * index and the caller blocks (and is woken up) at most once, so this is considerably cheaper
+	 * than calling pop_sample() in a loop.
+	 * @param out Pointer to an array of at least `max` samples that receives the popped samples.
+	 * @param max The maximum number of samples to pop.
+	 * @param timeout Timeout for the blocking if the queue is empty, in seconds.
+	 * @return The number of samples written to `out` (0 if the timeout expired).
+	 */
+	std::size_t pop_samples(sample_p *out, std::size_t max, double timeout = 0.0) {
+		std::size_t n = try_pop_n(out, max);
+		if (!n && max && timeout > 0.0)
+			wait_pushed(timeout, [&] { return (n = this->try_pop_n(out, max)) != 0; });
+		return n;
+	}
+
+	/**
+	 * Request a single call of the on_ready function once samples are available.
+	 *
+	 * @return true if the function will be called by the next push, false if samples are already
+	 * available (in which case the function won't be called and the caller should pop them).
+	 */
+	bool request_ready_callback() {
+		ready_requested_.store(true, std::memory_order_relaxed);
+		// pairs with the fence in notify_pushed()
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return empty() || !ready_requested_.exchange(false, std::memory_order_acq_rel);
+	}
+
+	/// first_seq() before the first sample has been pushed
+	static constexpr uint64_t no_seq = std::numeric_limits<uint64_t>::max();
+
+	/**
+	 * The sequence number (see sample::seq()) of the first sample pushed onto the queue, or
+	 * no_seq. A consumer can tell from it how many samples were dropped before its first pop.
+	 */
+	uint64_t first_seq() const { return first_seq_.load(std::memory_order_acquire); }
+
+	/**
+	 * The number of samples dropped because the queue was full, counting all samples of a chunk.
+	 *
+	 * Drops still in progress are waited for until at least `at_least` samples are counted, so a
+	 * consumer that popped a sample sees all drops of the samples that were queued before it.
+	 * With multiple producers, the samples can arrive out of sequence order, so a consumer can
+	 * tell dropped samples from samples that are still on their way.
+	 */
+	uint64_t samples_dropped(uint64_t at_least = 0) const;
+
+	/// Let blocking pops spin for up to `spin_us` microseconds before they park the thread.
+	void set_spin_time(uint32_t spin_us) { spin_us_.store(spin_us, std::memory_order_relaxed); }
+
 	/// Number of available samples. This is approximate unless called by the thread calling the
 	/// pop_sample().
 	std::size_t read_available() const;
@@ -106,23 +169,130 @@ public:
 	consumer_queue &operator=(consumer_queue &&) = delete;
 
 private:
+	// push a sample, dropping the oldest sample(s) if the queue is full
+	template <class T> void push_or_drop(T &&sample) {
+		uint64_t first = first_seq_.load(std::memory_order_relaxed);
+		if (first == no_seq && sample)
+			first_seq_.compare_exchange_strong(first, sample->seq(), std::memory_order_release,
+				std::memory_order_relaxed);
+		// make room for all samples of a chunk, not just for its slot
+		const std::size_t n = samples_in(sample);
+		while (samples_held_.load(std::memory_order_relaxed) + n > size_)
+			if (!drop_oldest()) break;
+		// no free slot, drop the oldest sample
+		while (!try_push(std::forward<T>(sample))) drop_oldest();
+	}
+
+	// drop the oldest sample (or chunk), return false if the queue was empty
+	bool drop_oldest() {
+		if (!done_sync_.load(std::memory_order_acquire)) {
+			// synchronizes-with store to done_sync_ in ctor
+			std::atomic_thread_fence(std::memory_order_acquire);
+			done_sync_.store(true, std::memory_order_release);
+		}
+		// announce the drop before claiming the slot, see samples_dropped()
+		drops_in_flight_.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		sample_p dropped;
+		const bool success = try_pop(dropped);
+		if (success) {
+			if (dropped) dropped_.fetch_add(dropped->num_samples(), std::memory_order_relaxed);
+			count_drop(dropped);
+		}
+		drops_in_flight_.fetch_sub(1, std::memory_order_release);
+		return success;
+	}
+
+	// the number of samples an item counts against the capacity
+	static std::size_t samples_in(const sample_p &s) noexcept { return s ? s->num_samples() : 1; }
+
+	// count a sample (or chunk) dropped by push_or_drop in the outlet's metrics
+	void count_drop(const sample_p &dropped) noexcept;
+
+	// wake up a waiting consumer (and call the readiness callback, if requested)
+	void notify_pushed() {
+		// pairs with the waiters_ increment in wait_pushed() and the fence in
+		// request_ready_callback(): either the consumer sees the new sample or we see the consumer
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters_.load(std::memory_order_relaxed)) wake_waiter();
+		if (on_ready_ && ready_requested_.load(std::memory_order_relaxed) &&
+			ready_requested_.exchange(false, std::memory_order_acq_rel))
+			on_ready_();
+	}
+
+	/**
+	 * Block until `pred` (which tries to pop samples) succeeds or the timeout expires.
+	 *
+	 * If a spin time is set, the queue is polled for that long first. Afterwards, the consumer
+	 * announces itself in waiters_, so pushes only have to wake someone up if a consumer is
+	 * actually blocked.
+	 */
+	template <class Pred> void wait_pushed(double timeout, Pred pred) {
+		const auto now = std::chrono::steady_clock::now();
+		const auto deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+										std::chrono::duration<double>(timeout));
+		if (const uint32_t spin_us = spin_us_.load(std::memory_order_relaxed)) {
+			const auto spin_until = std::min(deadline, now + std::chrono::microseconds(spin_us));
+			do {
+				if (pred()) return;
+				cpu_relax();
+			} while (std::chrono::steady_clock::now() < spin_until);
+		}
+		waiters_.fetch_add(1, std::memory_order_seq_cst);
+#ifdef LSL_FUTEX_WAKEUP
+		for (;;) {
+			// read the wakeup counter before checking, so a push in between makes park() return
+			const uint32_t seen = wake_seq_.load(std::memory_order_acquire);
+			if (pred()) break;
+			const auto remaining = deadline - std::chrono::steady_clock::now();
+			if (remaining <= remaining.zero()) break;
+			park(seen, remaining);
+		}
+#else
+		{
+			std::unique_lock<std::mutex> lk(mut_);
+			cv_.wait_until(lk, deadline, pred);
+		}
+#endif
+		waiters_.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+#ifdef LSL_FUTEX_WAKEUP
+	/// Sleep until wake_seq_ differs from `seen` or the timeout expires.
+	void park(uint32_t seen, std::chrono::steady_clock::duration timeout);
+#endif
+	/// Wake up one consumer blocked in wait_pushed().
+	void wake_waiter();
+
 	// an item stored in the queue
 	struct item_t {
 		std::atomic<std::size_t> seq_state;
 		sample_p value;
 	};
 
-	// Push a new element to the queue.
-	// Returns true if successful or false if queue full.
+	// Push a new element to the queue. Returns true if successful or false if queue full.
+	// Uses the same method as Vyukov's bounded MPMC queue.
 	template <class T> bool try_push(T &&sample) {
-		std::size_t write_index = write_idx_.load(std::memory_order_acquire);
-		std::size_t next_idx = add1_wrap(write_index);
-		item_t &item = buffer_[write_index % size_];
-		if (UNLIKELY(write_index != item.seq_state.load(std::memory_order_acquire)))
-			return false; // item currently occupied, queue full
-		write_idx_.store(next_idx, std::memory_order_release);
-		copy_or_move(item.value, std::forward<T>(sample));
-		item.seq_state.store(next_idx, std::memory_order_release);
+		item_t *item;
+		std::size_t write_index = write_idx_.load(std::memory_order_relaxed);
+		for (;;) {
+			item = &buffer_[write_index % size_];
+			if (LIKELY(item->seq_state.load(std::memory_order_acquire) == write_index)) {
+				// the item is free, try to claim it using CAS
+				if (LIKELY(write_idx_.compare_exchange_weak(write_index, add1_wrap(write_index),
+						std::memory_order_release, std::memory_order_relaxed)))
+					break;
+			} else {
+				// item currently occupied: the queue is full unless another push got ahead of us
+				const std::size_t current = write_idx_.load(std::memory_order_relaxed);
+				if (current == write_index) return false;
+				write_index = current;
+			}
+		}
+		// counted before the item can be popped, so samples_held_ never drops below zero
+		samples_held_.fetch_add(samples_in(sample), std::memory_order_relaxed);
+		copy_or_move(item->value, std::forward<T>(sample));
+		item->seq_state.store(add1_wrap(write_index), std::memory_order_release);
 		return true;
 	}
 
@@ -147,17 +317,56 @@ private:
 				// we're behind or ahead of another pop, try again
 				read_index = read_idx_.load(std::memory_order_relaxed);
 		}
+		samples_held_.fetch_sub(samples_in(item->value), std::memory_order_relaxed);
 		move_or_drop(item->value, result...);
 		// mark item as free for next pass
 		item->seq_state.store(add_wrap(read_index, size_), std::memory_order_release);
 		return true;
 	}
 
+	// Pop up to max elements from the queue, claiming all ready slots with one CAS.
+	// Returns the number of popped elements (0 if the queue is empty).
+	std::size_t try_pop_n(sample_p *result, std::size_t max) {
+		if (!max) return 0;
+		std::size_t read_index = read_idx_.load(std::memory_order_relaxed), n;
+		for (;;) {
+			// count the consecutive slots that are ready to be popped
+			std::size_t idx = read_index;
+			for (n = 0; n < max; ++n) {
+				const std::size_t next_idx = add1_wrap(idx);
+				if (buffer_[idx % size_].seq_state.load(std::memory_order_acquire) != next_idx)
+					break;
+				idx = next_idx;
+			}
+			if (n == 0) {
+				// either empty or we're behind another pop
+				if (buffer_[read_index % size_].seq_state.load(std::memory_order_acquire) ==
+					read_index)
+					return 0;
+				read_index = read_idx_.load(std::memory_order_relaxed);
+				continue;
+			}
+			// try to claim the whole range at once
+			if (LIKELY(read_idx_.compare_exchange_weak(read_index, idx, std::memory_order_relaxed)))
+				break;
+		}
+		std::size_t samples = 0;
+		for (std::size_t k = 0; k < n; ++k) {
+			item_t &item = buffer_[read_index % size_];
+			samples += samples_in(item.value);
+			result[k] = std::move(item.value);
+			item.seq_state.store(add_wrap(read_index, size_), std::memory_order_release);
+			read_index = add1_wrap(read_index);
+		}
+		samples_held_.fetch_sub(samples, std::memory_order_relaxed);
+		return n;
+	}
+
 	// helper to either copy or move a value, depending on whether it's an rvalue ref
 	inline static void copy_or_move(sample_p &dst, const sample_p &src) { dst = src; }
 	inline static void copy_or_move(sample_p &dst, sample_p &&src) { dst = std::move(src); }
 	// helper to either move or drop a value, depending on whether a dst argument is given
-	inline static void move_or_drop(sample_p &src) { src.~sample_p(); }
+	inline static void move_or_drop(sample_p &src) { src = sample_p(); }
 	inline static void move_or_drop(sample_p &src, sample_p &dst) { dst = std::move(src); }
 
 	/// helper to add a delta to the given index and wrap correctly
@@ -173,33 +382,80 @@ private:
 
 	/// current read position
 	std::atomic<std::size_t> read_idx_{0};
-	/// condition for waiting with timeout
-	std::condition_variable cv_;
 	/// the sample buffer
 	item_t *buffer_;
 
 	/// padding to ensure read_idx_ and write_idx_ don't share a cacheline
-	Padding<std::size_t, std::size_t, std::condition_variable, void *> pad;
+	Padding<std::size_t, std::size_t, void *> pad;
 
 	/// current write position
 	std::atomic<std::size_t> write_idx_{0};
-	/// max number of elements in the queue
+	/// max number of elements (and samples, see samples_held_) in the queue
 	const std::size_t size_;
 	/// threshold at which to wrap read/write indices
 	const std::size_t wrap_at_;
-	/// for use with the condition variable
-	std::mutex mut_;
 
 	/// optional consumer registry
 	send_buffer_p registry_;
+	/// optional function to call when samples are available after request_ready_callback()
+	const std::function<void()> on_ready_;
+	/// whether on_ready_ should be called by the next push
+	std::atomic<bool> ready_requested_{false};
 
 	/// padding to ensure write_ix_ and done_sync_ don't share a cacheline
 #if UINTPTR_MAX <= 0xFFFFFFFF
-	Padding<std::size_t, bool, std::size_t, std::size_t, std::mutex, send_buffer_p> pad2;
+	Padding<std::size_t, bool, std::size_t, std::size_t, send_buffer_p, std::function<void()>,
+		std::atomic<bool>>
+		pad2;
 #endif
 
 	/// whether we have performed a sync on the data stored by the constructor
 	std::atomic<bool> done_sync_{false};
+	/// number of consumers blocked in wait_pushed()
+	std::atomic<uint32_t> waiters_{0};
+	/// how long blocking pops poll the queue before parking, in microseconds
+	std::atomic<uint32_t> spin_us_{0};
+	/// sequence number of the first pushed sample
+	std::atomic<uint64_t> first_seq_{no_seq};
+	/// number of samples in the queue, counting all samples of each chunk
+	std::atomic<std::size_t> samples_held_{0};
+	/// number of samples dropped because the queue was full
+	std::atomic<uint64_t> dropped_{0};
+	/// number of drops that may have claimed a slot, but not counted it in dropped_ yet
+	std::atomic<uint32_t> drops_in_flight_{0};
+#ifdef LSL_FUTEX_WAKEUP
+	/// wakeup counter the blocked consumers wait on
+	std::atomic<uint32_t> wake_seq_{0};
+#else
+	/// for use with the condition variable
+	std::mutex mut_;
+	/// condition for waiting with timeout
+	std::condition_variable cv_;
+#endif
+};
+
+/**
+ * Tells the consumer of a queue how many samples were dropped before each popped sample.
+ *
+ * Holes in the sequence numbers (see sample::seq()) are only counted as far as the queue
+ * actually dropped samples, since samples from concurrent producers can arrive out of order.
+ */
+class gap_tracker {
+public:
+	/**
+	 * The number of samples missing right before `s`.
+	 * @param queue The queue `s` was popped from, or nullptr if the samples can't arrive out of
+	 * order and all holes in the sequence numbers are gaps.
+	 */
+	uint64_t missing_before(const sample &s, const consumer_queue *queue);
+
+private:
+	/// whether next_seq_ is known, i.e. a sample has been tracked
+	bool seq_known_{false};
+	/// the sequence number following the highest one seen so far
+	uint64_t next_seq_{0};
+	/// the number of dropped samples reported so far
+	uint64_t reported_{0};
 };
 
 } // namespace lsl
@@ -3,12 +3,16 @@
 #include "cancellable_streambuf.h"
 #include "inlet_connection.h"
 #include "sample.h"
+#include "shm_transport.h"
 #include "socket_utils.h"
+#include "trace.h"
 #include "util/cast.hpp"
 #include "util/endian.hpp"
 #include "util/strfuns.hpp"
 #include <chrono>
+#include <cstdio>
 #include <exception>
+#include <asio/ip/host_name.hpp>
 #include <iostream>
 #include <loguru.hpp>
 #include <memory>
@@ -21,18 +25,44 @@
 #define NO_EXPLICIT_TEMPLATE_INSTANTIATION
 #include "portable_archive/portable_iarchive.hpp"
 
+#ifdef LSL_SHM_TRANSPORT
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+
 namespace lsl {
 
-data_receiver::data_receiver(inlet_connection &conn, int max_buflen, int max_chunklen)
+/// Whether the peer closes the connection of `buffer` within `timeout_ms` milliseconds.
+static bool peer_closes(cancellable_streambuf &buffer, int timeout_ms) {
+#ifdef LSL_SHM_TRANSPORT
+	const int fd = buffer.native_handle();
+	pollfd pfd{fd, POLLIN | POLLRDHUP, 0};
+	if (poll(&pfd, 1, timeout_ms) <= 0) return false;
+	if (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR)) return true;
+	char c;
+	const auto n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+#else
+	(void)buffer;
+	(void)timeout_ms;
+	return true;
+#endif
+}
+
+data_receiver::data_receiver(
+	inlet_connection &conn, int max_buflen, int max_chunklen, bool delta_encoding)
 	: conn_(conn),
 	  sample_factory_(
 		  new factory(conn.type_info().channel_format(), conn.type_info().channel_count(),
 			  conn.type_info().nominal_srate()
 				  ? static_cast<int>(conn.type_info().nominal_srate() *
 									 api_config::get_instance()->inlet_buffer_reserve_ms() / 1000)
-				  : api_config::get_instance()->inlet_buffer_reserve_samples())),
+				  : api_config::get_instance()->inlet_buffer_reserve_samples(),
+			  api_config::get_instance()->numa_local_samples())),
 	  check_thread_start_(true), closing_stream_(false), connected_(false),
-	  sample_queue_(max_buflen), max_buflen_(max_buflen), max_chunklen_(max_chunklen) {
+	  sample_queue_(max_buflen), max_buflen_(max_buflen), max_chunklen_(max_chunklen),
+	  delta_encoding_(delta_encoding) {
 	if (max_buflen < 0)
 		throw std::invalid_argument("The max_buflen argument must not be smaller than 0.");
 	if (max_chunklen < 0)
@@ -83,8 +113,7 @@ void data_receiver::close_stream() {
 		data_thread_.join();
 }
 
-sample_p lsl::data_receiver::try_get_next_sample(double timeout)
-{
+void data_receiver::check_connection() {
 	if (conn_.lost())
 		throw lost_error("The stream read by this outlet has been lost. To recover, you need to "
 						 "re-resolve the source and re-create the inlet.");
@@ -93,6 +122,11 @@ sample_p lsl::data_receiver::try_get_next_sample(double timeout)
 		data_thread_ = std::thread(&data_receiver::data_thread, this);
 		check_thread_start_ = false;
 	}
+}
+
+sample_p lsl::data_receiver::try_get_next_sample(double timeout)
+{
+	check_connection();
 	// get the sample with timeout
 	if (sample_p s = sample_queue_.pop_sample(timeout))
 		return s;
@@ -111,6 +145,7 @@ double data_receiver::pull_sample_typed(T *buffer, uint32_t buffer_elements, dou
 			throw std::range_error("The number of buffer elements provided does not match the "
 								   "number of channels in the sample.");
 		s->retrieve_typed(buffer);
+		count_pulled(*s);
 		return s->timestamp();
 	} else return 0.0;
 }
@@ -129,11 +164,41 @@ double data_receiver::pull_sample_untyped(void *buffer, int buffer_bytes, double
 			throw std::range_error("The size of the provided buffer does not match the number of "
 								   "bytes in the sample.");
 		s->retrieve_untyped(buffer);
+		count_pulled(*s);
 		return s->timestamp();
 	}
 	else return 0.0;
 }
 
+std::size_t data_receiver::pull_samples(sample_p *out, std::size_t max, double timeout) {
+	check_connection();
+	std::size_t n = sample_queue_.pop_samples(out, max, timeout);
+	if (!n && conn_.lost())
+		throw lost_error("The stream read by this inlet has been lost. To recover, you need to "
+						 "re-resolve the source and re-create the inlet.");
+	return n;
+}
+
+void data_receiver::count_pulled(const sample &s) {
+	if (s.seq() > pulled_seq_) {
+		const uint64_t lost = s.seq() - pulled_seq_;
+		dropped_.fetch_add(lost, std::memory_order_relaxed);
+		skipped_ += static_cast<uint32_t>(lost);
+	}
+	pulled_seq_ = s.seq() + 1;
+}
+
+uint32_t data_receiver::flush() noexcept {
+	// flushed samples were discarded on purpose, so they aren't counted as lost
+	uint32_t n = 0;
+	sample_p batch[64];
+	while (std::size_t k = sample_queue_.pop_samples(batch, sizeof(batch) / sizeof(batch[0]))) {
+		for (std::size_t i = 0; i < k; i++, n++)
+			if (batch[i]) pulled_seq_ = std::exchange(batch[i], sample_p())->seq() + 1;
+	}
+	return n;
+}
+
 
 // === internal processing ===
 
@@ -142,6 +207,9 @@ void data_receiver::data_thread() {
 	loguru::set_thread_name(("D_" + conn_.type_info().name().substr(0, 10) + "_" + conn_.type_info().type().substr(0, 3)).c_str());
 	// ensure that the sample factory persists for the lifetime of this thread
 	factory_p factory(sample_factory_);
+	// a reopened stream starts with the samples pushed from now on
+	resume_ = false;
+	last_timestamp_ = 0.0;
 	try {
 		while (!conn_.lost() && !conn_.shutdown() && !closing_stream_) {
 			try {
@@ -163,6 +231,10 @@ void data_receiver::data_thread() {
 				int data_protocol_version = 100;  // which protocol version we shall use for data
 												  // transmission (100=version 1.00)
 				bool suppress_subnormals = false; // whether we shall suppress subnormal numbers
+				std::string shm_path;			  // the outlet's shared memory, if granted
+				uint64_t shm_position = 0;		  // the position to start reading it at
+				bool delta_encoding = false;	  // whether the values are delta-encoded
+				bool sequence_numbers = false;	  // whether gap markers are sent
 
 				// propose to use the highest protocol version supported by both parties
 				int proposed_protocol_version =
@@ -190,6 +262,23 @@ void data_receiver::data_thread() {
 					server_stream << "Hostname: " << conn_.type_info().hostname() << "\r\n";
 					server_stream << "Source-Id: " << conn_.type_info().source_id() << "\r\n";
 					server_stream << "Session-Id: " << conn_.type_info().session_id() << "\r\n";
+#ifdef LSL_SHM_TRANSPORT
+					// ask outlets on the same host to publish their samples via shared memory
+					if (!shm_failed_ && (conn_.get_tcp_endpoint().address().is_loopback() ||
+											conn_.type_info().hostname() == asio::ip::host_name()))
+						server_stream << "Transport: shm\r\n";
+#endif
+					if (delta_encoding_ && format_integral[conn_.type_info().channel_format()])
+						server_stream << "Value-Encoding: delta\r\n";
+					// ask to be told about samples the outlet drops
+					server_stream << "Sequence-Numbers: 1\r\n";
+					// after a connection loss, ask for the missed samples (if the outlet keeps a
+					// history of them)
+					if (resume_) {
+						char timestamp[32];
+						snprintf(timestamp, sizeof(timestamp), "%.17g", last_timestamp_);
+						server_stream << "Resume-After: " << timestamp << "\r\n";
+					}
 					server_stream << "\r\n" << std::flush;
 
 					// check server response line (LSL/[Version] [StatusCode] [Message])
@@ -239,6 +328,20 @@ void data_receiver::data_thread() {
 							}
 							if (type == "suppress-subnormals")
 								suppress_subnormals = lsl::from_string<bool>(rest);
+							// only accept rings in shared memory, not arbitrary files
+							if (type == "shm-path" && rest.compare(0, 13, "/dev/shm/lsl-") == 0)
+								shm_path = rest;
+							if (type == "shm-position") shm_position = std::stoull(rest);
+							if (type == "value-encoding") {
+								if (rest != "delta" ||
+									!format_integral[conn_.type_info().channel_format()])
+									throw std::runtime_error(
+										"The value encoding requested by the other party is not "
+										"supported.");
+								delta_encoding = true;
+							}
+							if (type == "sequence-numbers")
+								sequence_numbers = lsl::from_string<bool>(rest);
 							if (type == "uid" && rest != conn_.current_uid())
 								throw lost_error("The received UID does not match the current "
 												 "connection's UID.");
@@ -273,6 +376,18 @@ void data_receiver::data_thread() {
 							"The received UID does not match the current connection's UID.");
 				}
 
+				// open the shared memory before the outlet publishes any samples we'd miss
+				std::unique_ptr<shm_subscriber> shm;
+				if (!shm_path.empty()) try {
+						shm = std::make_unique<shm_subscriber>(shm_path, shm_position);
+					} catch (std::exception &e) {
+						// e.g. a different user or a container: ask for a TCP transport
+						LOG_F(WARNING, "Could not open %s (%s), reconnecting via TCP",
+							shm_path.c_str(), e.what());
+						shm_failed_ = true;
+						continue;
+					}
+
 				// --- format validation ---
 				{
 					// receive and parse two subsequent test-pattern samples and check if they are
@@ -308,26 +423,126 @@ void data_receiver::data_thread() {
 
 				// --- transmission loop ---
 
-				double last_timestamp = 0.0;
 				double srate = conn_.current_srate();
-				for (int k = 0; !conn_.lost() && !conn_.shutdown() && !closing_stream_; k++) {
-					// allocate and fetch a new sample
-					sample_p samp(factory->new_sample(0.0, false));
-					if (data_protocol_version >= 110)
-						samp->load_streambuf(
+				auto deduce_timestamp = [this, srate](sample &samp) {
+					if (samp.timestamp() == DEDUCED_TIMESTAMP) {
+						samp.timestamp() = last_timestamp_;
+						if (srate != IRREGULAR_RATE) samp.timestamp() += 1.0 / srate;
+					}
+					last_timestamp_ = samp.timestamp();
+					resume_ = true;
+					samp.seq() = next_seq_++;
+					LSL_TRACE_POINT(received, samp.timestamp());
+				};
+				// the outlet dropped `missing` samples, so the next timestamp is deduced later
+				auto skip_samples = [this, srate](uint64_t missing) {
+					next_seq_ += missing;
+					if (srate != IRREGULAR_RATE) last_timestamp_ += missing / srate;
+				};
+				// read the gap markers the outlet sent before the next sample (blocking)
+				auto read_gaps = [&]() {
+					while (sequence_numbers && buffer.sgetc() == TAG_GAP) {
+						char marker[GAP_MARKER_BYTES];
+						if (buffer.sgetn(marker, sizeof(marker)) != sizeof(marker))
+							throw lost_error("Connection lost.");
+						skip_samples(sample::load_gap_marker(marker, reverse_byte_order));
+					}
+				};
+
+				const int max_batch = 128;
+				sample_p batch[max_batch];
+				// samples published in shared memory; the socket stays open to keep the session
+				bool shm_seq_known = false;
+				uint64_t shm_seq = 0;
+				if (shm) try {
+						for (int k = 0; !conn_.lost() && !conn_.shutdown() && !closing_stream_;) {
+							int n = static_cast<int>(shm->read(*factory, batch, max_batch, 0.1));
+							if (!n) continue;
+							for (int i = 0; i < n; i++) {
+								// the outlet's sequence numbers reveal overwritten records
+								const uint64_t seq = batch[i]->seq();
+								if (shm_seq_known && seq > shm_seq) skip_samples(seq - shm_seq);
+								shm_seq = seq + 1;
+								shm_seq_known = true;
+								deduce_timestamp(*batch[i]);
+							}
+							sample_queue_.push_samples(batch, n);
+							conn_.metrics().samples_received.add(n);
+							if (srate <= 16 || (k & ~0xF) != ((k + n) & ~0xF))
+								conn_.update_receive_time(lsl_clock());
+							k += n;
+						}
+					} catch (lost_error &) {
+						// an outlet that goes away closes the session shortly after its ring;
+						// a ring that's gone silent on a live session would only fail again
+						if (!peer_closes(buffer, 1000)) {
+							LOG_F(WARNING, "Shared memory of %s went silent, reconnecting via TCP",
+								shm_path.c_str());
+							shm_failed_ = true;
+						}
+						throw;
+					}
+				// fixed-size samples are decoded in batches straight from the receive buffer
+				else if (data_protocol_version >= 110 && !delta_encoding &&
+					conn_.type_info().channel_format() != cft_string) {
+					for (int k = 0; !conn_.lost() && !conn_.shutdown() && !closing_stream_;) {
+						buffer.busy_poll(busy_poll_us_.load(std::memory_order_relaxed));
+						// block until the first sample has been received
+						read_gaps();
+						batch[0] = factory->new_sample(0.0, false);
+						batch[0]->load_streambuf(
 							buffer, data_protocol_version, reverse_byte_order, suppress_subnormals);
-					else
-						*inarch >> *samp;
-					// deduce timestamp if necessary
-					if (samp->timestamp() == DEDUCED_TIMESTAMP) {
-						samp->timestamp() = last_timestamp;
-						if (srate != IRREGULAR_RATE) samp->timestamp() += 1.0 / srate;
+						deduce_timestamp(*batch[0]);
+						// then decode all complete samples that are already buffered
+						int n = 1;
+						for (std::size_t len; n < max_batch; n++) {
+							if (sequence_numbers && buffer.in_buffer_size() &&
+								*buffer.in_buffer() == TAG_GAP) {
+								if (buffer.in_buffer_size() < GAP_MARKER_BYTES) break;
+								skip_samples(sample::load_gap_marker(
+									buffer.in_buffer(), reverse_byte_order));
+								buffer.consume(GAP_MARKER_BYTES);
+							}
+							if (!batch[n]) batch[n] = factory->new_sample(0.0, false);
+							if (!(len = batch[n]->load_buffer(buffer.in_buffer(),
+									  buffer.in_buffer_size(), reverse_byte_order,
+									  suppress_subnormals)))
+								break;
+							buffer.consume(len);
+							deduce_timestamp(*batch[n]);
+						}
+						// push them into the sample queue
+						sample_queue_.push_samples(batch, n);
+						conn_.metrics().samples_received.add(n);
+						// periodically update the last receive time to keep the watchdog happy
+						if (srate <= 16 || (k & ~0xF) != ((k + n) & ~0xF))
+							conn_.update_receive_time(lsl_clock());
+						k += n;
+					}
+				} else {
+					// delta-encoded values start from 0 after the (unencoded) test patterns
+					std::vector<int64_t> previous(
+						delta_encoding ? conn_.type_info().channel_count() : 0);
+					for (int k = 0; !conn_.lost() && !conn_.shutdown() && !closing_stream_; k++) {
+						buffer.busy_poll(busy_poll_us_.load(std::memory_order_relaxed));
+						// allocate and fetch a new sample
+						read_gaps();
+						sample_p samp(factory->new_sample(0.0, false));
+						if (delta_encoding)
+							samp->load_streambuf_delta(buffer, reverse_byte_order, previous.data());
+						else if (data_protocol_version >= 110)
+							samp->load_streambuf(buffer, data_protocol_version, reverse_byte_order,
+								suppress_subnormals);
+						else
+							*inarch >> *samp;
+						// deduce timestamp if necessary
+						deduce_timestamp(*samp);
+						// push it into the sample queue
+						sample_queue_.push_sample(samp);
+						conn_.metrics().samples_received.add();
+						// periodically update the last receive time to keep the watchdog happy
+						if (srate <= 16 || (k & 0xF) == 0) conn_.update_receive_time(lsl_clock());
 					}
-					last_timestamp = samp->timestamp();
-					// push it into the sample queue
-					sample_queue_.push_sample(samp);
-					// periodically update the last receive time to keep the watchdog happy
-					if (srate <= 16 || (k & 0xF) == 0) conn_.update_receive_time(lsl_clock());
 				}
 			} catch (err_t) {
 				// connection-level error: closed, reset, refused, etc.
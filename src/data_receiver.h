@@ -10,6 +10,7 @@
 #include <cstdint>
 #include <mutex>
 #include <thread>
+#include <utility>
 
 namespace lsl {
 
@@ -36,8 +37,10 @@ public:
 	 * (the default corresponds to the chunk sizes used by the sender). Recording applications can
 	 * use a generous size here (leaving it to the network how to pack things), while real-time
 	 * applications may want a finer (perhaps 1-sample) granularity.
+	 * @param delta_encoding Ask for delta-encoded integer values to save bandwidth.
 	 */
-	data_receiver(inlet_connection &conn, int max_buflen = 360, int max_chunklen = 0);
+	data_receiver(inlet_connection &conn, int max_buflen = 360, int max_chunklen = 0,
+		bool delta_encoding = false);
 
 	/// Destructor. Stops the background activities.
 	~data_receiver();
@@ -69,13 +72,43 @@ public:
 	/// Read sample from the inlet and read it into a pointer to raw data.
 	double pull_sample_untyped(void *buffer, int buffer_bytes, double timeout = FOREVER);
 
+	/**
+	 * Retrieve up to `max` samples from the sample queue in one go.
+	 *
+	 * Unlike the other pull functions, this doesn't account for lost samples; the caller has to
+	 * call count_pulled() for each sample.
+	 * @return The number of samples written to `out`; 0 if none arrived before the timeout.
+	 */
+	std::size_t pull_samples(sample_p *out, std::size_t max, double timeout = 0.0);
+
+	/**
+	 * Account for the samples that were lost before the pulled sample `s`, i.e. those the outlet
+	 * dropped (as announced by the outlet) and those dropped by the full sample queue.
+	 */
+	void count_pulled(const sample &s);
+
+	/// Get and reset the number of samples lost before the samples pulled since the last call.
+	uint32_t take_skipped() { return std::exchange(skipped_, 0); }
+
+	/// The total number of samples lost before the pulled samples.
+	uint64_t dropped_samples() const { return dropped_.load(std::memory_order_relaxed); }
+
 	/// Check whether the underlying buffer is empty. This value may be inaccurate.
 	bool empty() { return sample_queue_.empty(); }
 
 	std::size_t samples_available() { return sample_queue_.read_available(); }
 
 	/// Flush the queue, return the number of dropped samples
-	uint32_t flush() noexcept { return sample_queue_.flush(); }
+	uint32_t flush() noexcept;
+
+	/**
+	 * Spin for up to `spin_us` microseconds before blocking, both when pulling samples and when
+	 * reading from the data socket (0 to always block right away).
+	 */
+	void busy_poll(uint32_t spin_us) {
+		busy_poll_us_.store(spin_us, std::memory_order_relaxed);
+		sample_queue_.set_spin_time(spin_us);
+	}
 
 private:
 	/// The data reader thread.
@@ -83,6 +116,9 @@ private:
 
 	sample_p try_get_next_sample(double timeout);
 
+	/// Throw if the connection was lost and start the data thread if necessary.
+	void check_connection();
+
 	/// the underlying connection
 	inlet_connection &conn_;
 
@@ -99,6 +135,8 @@ private:
 	bool connected_;
 	/// queue of samples ready to be picked up (populated by the data thread)
 	consumer_queue sample_queue_;
+	/// time to busy-poll the data socket before waiting for data, in microseconds
+	std::atomic<uint32_t> busy_poll_us_{0};
 	/// mutex to protect the connected state
 	std::mutex connected_mut_;
 	/// condition variable to indicate that an update for the connected state is available
@@ -109,6 +147,24 @@ private:
 	int max_buflen_;
 	// the desired maximum chunklen for received samples
 	int max_chunklen_;
+	/// whether to ask for delta-encoded integer values
+	bool delta_encoding_;
+	/// timestamp of the last received sample, used to deduce the next one
+	double last_timestamp_{0.0};
+	/// whether samples have been received, so a reconnect resumes after last_timestamp_
+	bool resume_{false};
+	/// whether the outlet's shared memory couldn't be opened, so only TCP is requested
+	bool shm_failed_{false};
+	/// sequence number of the next received sample, counted by the inlet (see sample::seq())
+	uint64_t next_seq_{0};
+
+	// accounting of lost samples, updated by the pulling thread
+	/// sequence number of the next pulled sample if none is lost
+	uint64_t pulled_seq_{0};
+	/// number of lost samples not yet returned by take_skipped()
+	uint32_t skipped_{0};
+	/// total number of lost samples
+	std::atomic<uint64_t> dropped_{0};
 };
 
 } // namespace lsl
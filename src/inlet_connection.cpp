@@ -210,6 +210,7 @@ void inlet_connection::try_recover() {
 						// unlock recover mutex because onrecover callbacks may acquire the lock themselves
 						lock_recover_host_info.unlock();
 						for (auto &pair : onrecover_) (pair.second)();
+						metrics_.reconnects.add();
 						LOG_F(INFO, "Connection recovered");
 					} else {
 						// there are multiple possible streams to connect to in a recovery attempt:
@@ -2,6 +2,7 @@
 #define INLET_CONNECTION_H
 
 #include "cancellation.h"
+#include "metrics.h"
 #include "resolver_impl.h"
 #include "stream_info_impl.h"
 #include <asio/ip/tcp.hpp>
@@ -148,6 +149,8 @@ public:
 	/// be strongly discouraged).
 	double current_srate();
 
+	/// The inlet's metrics, updated by the connection and the receivers.
+	inlet_metrics &metrics() { return metrics_; }
 
 private:
 	/// A thread that periodically checks whether the connection should be recovered.
@@ -208,6 +211,9 @@ private:
 	std::mutex onrecover_mut_;
 	/// when number of active_transmissions_ is updated
 	std::condition_variable active_transmissions_upd_;
+
+	/// the inlet's metrics
+	inlet_metrics metrics_;
 };
 } // namespace lsl
 
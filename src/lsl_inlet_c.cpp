@@ -18,8 +18,8 @@ LIBLSL_C_API lsl_inlet lsl_create_inlet_ex(lsl_streaminfo info, int32_t max_bufl
 	int32_t max_chunklen, int32_t recover, lsl_transport_options_t flags) {
 	try {
 		int32_t buf_samples = info->calc_transport_buf_samples(max_buflen, flags);
-		return create_object_noexcept<stream_inlet_impl>(
-			*info, buf_samples, max_chunklen, recover != 0);
+		return create_object_noexcept<stream_inlet_impl>(*info, buf_samples, max_chunklen,
+			recover != 0, (flags & transp_delta_encoding) != 0);
 	}
 	LSLCATCHANDSTORE(nullptr, std::invalid_argument, lsl_argument_error);
 	return nullptr;
@@ -103,6 +103,15 @@ LIBLSL_C_API int32_t lsl_set_postprocessing(lsl_inlet in, uint32_t flags) {
 	}
 }
 
+LIBLSL_C_API int32_t lsl_set_inlet_mode(lsl_inlet in, lsl_inlet_mode_t mode, int32_t spin_us) {
+	try {
+		in->set_mode(mode, spin_us);
+		return lsl_no_error;
+	} catch (std::invalid_argument &) { return lsl_argument_error; } catch (std::exception &) {
+		return lsl_internal_error;
+	}
+}
+
 
 /* === Pulling a sample from the inlet === */
 
@@ -308,6 +317,16 @@ LIBLSL_C_API uint32_t lsl_inlet_flush(lsl_inlet in) {
 	return in->flush();
 }
 
+LIBLSL_C_API uint64_t lsl_inlet_dropped_samples(lsl_inlet in) { return in->dropped_samples(); }
+
+LIBLSL_C_API int32_t lsl_get_inlet_stats(lsl_inlet in, lsl_inlet_stats *stats) {
+	if (!stats) return lsl_argument_error;
+	try {
+		in->stats(*stats);
+		return lsl_no_error;
+	} catch (std::exception &) { return lsl_internal_error; }
+}
+
 LIBLSL_C_API uint32_t lsl_was_clock_reset(lsl_inlet in) {
 	try {
 		return (uint32_t)in->was_clock_reset();
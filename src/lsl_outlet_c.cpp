@@ -416,6 +416,34 @@ LIBLSL_C_API int32_t lsl_wait_for_consumers(lsl_outlet out, double timeout) {
 	}
 }
 
+LIBLSL_C_API int32_t lsl_set_outlet_flush_policy(
+	lsl_outlet out, int32_t max_samples, int32_t max_bytes, int32_t max_delay_us) {
+	try {
+		out->set_flush_policy(max_samples, max_bytes, max_delay_us);
+		return lsl_no_error;
+	} catch (std::invalid_argument &) { return lsl_argument_error; } catch (std::exception &) {
+		return lsl_internal_error;
+	}
+}
+
+LIBLSL_C_API int32_t lsl_set_outlet_history(
+	lsl_outlet out, const char *filename, double max_history) {
+	try {
+		out->set_history(filename ? filename : "", max_history);
+		return lsl_no_error;
+	} catch (std::invalid_argument &) { return lsl_argument_error; } catch (std::exception &) {
+		return lsl_internal_error;
+	}
+}
+
+LIBLSL_C_API int32_t lsl_get_outlet_stats(lsl_outlet out, lsl_outlet_stats *stats) {
+	if (!stats) return lsl_argument_error;
+	try {
+		out->stats(*stats);
+		return lsl_no_error;
+	} catch (std::exception &) { return lsl_internal_error; }
+}
+
 LIBLSL_C_API lsl_streaminfo lsl_get_info(lsl_outlet out) {
 	return create_object_noexcept<stream_info_impl>(out->info());
 }
@@ -0,0 +1,215 @@
+#include "metrics.h"
+#include "stream_info_impl.h"
+#include "stream_inlet_impl.h"
+#include "stream_outlet_impl.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace lsl;
+
+/// position of the most significant set bit of a non-zero value
+static int msb(uint64_t value) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+	return 63 - __builtin_clzll(value);
+#else
+	int pos = 0;
+	while (value >>= 1) ++pos;
+	return pos;
+#endif
+}
+
+int histogram::bucket(uint64_t value) noexcept {
+	if (value < sub_buckets) return static_cast<int>(value);
+	const int shift = msb(value) - sub_bucket_bits;
+	// the bits after the most significant one select the sub bucket
+	return (shift + 1) * sub_buckets + static_cast<int>((value >> shift) & (sub_buckets - 1));
+}
+
+uint64_t histogram::bucket_limit(int bucket) noexcept {
+	if (bucket < sub_buckets) return static_cast<uint64_t>(bucket);
+	const int shift = bucket / sub_buckets - 1;
+	const uint64_t lowest = static_cast<uint64_t>(sub_buckets + bucket % sub_buckets) << shift;
+	return lowest + ((uint64_t(1) << shift) - 1);
+}
+
+void histogram::record(uint64_t value) noexcept {
+	buckets_[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(value, std::memory_order_relaxed);
+	uint64_t prev = max_.load(std::memory_order_relaxed);
+	while (prev < value && !max_.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {}
+}
+
+uint64_t histogram::count() const noexcept {
+	uint64_t n = 0;
+	for (const auto &b : buckets_) n += b.load(std::memory_order_relaxed);
+	return n;
+}
+
+uint64_t histogram::quantile(double q) const noexcept {
+	const uint64_t total = count();
+	if (!total) return 0;
+	const auto rank =
+		std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::min(q, 1.0) * total)));
+	uint64_t seen = 0;
+	for (int b = 0; b < num_buckets; ++b) {
+		seen += buckets_[b].load(std::memory_order_relaxed);
+		if (seen >= rank) return std::min(bucket_limit(b), max());
+	}
+	return max();
+}
+
+metrics_registry &metrics_registry::instance() {
+	// never destroyed, so outlets in static objects can unregister at any time
+	static auto *registry = new metrics_registry();
+	return *registry;
+}
+
+void metrics_registry::add(stream_outlet_impl *outlet) {
+	std::lock_guard<std::mutex> lock(mut_);
+	outlets_.push_back(outlet);
+}
+
+void metrics_registry::remove(stream_outlet_impl *outlet) {
+	std::lock_guard<std::mutex> lock(mut_);
+	outlets_.erase(std::remove(outlets_.begin(), outlets_.end(), outlet), outlets_.end());
+}
+
+void metrics_registry::add(stream_inlet_impl *inlet) {
+	std::lock_guard<std::mutex> lock(mut_);
+	inlets_.push_back(inlet);
+}
+
+void metrics_registry::remove(stream_inlet_impl *inlet) {
+	std::lock_guard<std::mutex> lock(mut_);
+	inlets_.erase(std::remove(inlets_.begin(), inlets_.end(), inlet), inlets_.end());
+}
+
+/// Write a label value with the characters the text format requires escaped.
+static void write_label(std::ostream &os, const char *name, const std::string &value) {
+	os << name << "=\"";
+	for (char c : value) switch (c) {
+		case '\\': os << "\\\\"; break;
+		case '"': os << "\\\""; break;
+		case '\n': os << "\\n"; break;
+		default: os << c;
+		}
+	os << '"';
+}
+
+static std::string labels_of(const stream_info_impl &info) {
+	std::ostringstream os;
+	write_label(os, "name", info.name());
+	os << ',';
+	write_label(os, "type", info.type());
+	os << ',';
+	write_label(os, "source_id", info.source_id());
+	os << ',';
+	write_label(os, "uid", info.uid());
+	return os.str();
+}
+
+namespace {
+/// The statistics of one stream, with the labels identifying it
+template <class Stats> struct labeled_stats {
+	std::string labels;
+	Stats stats;
+};
+
+/// A metric and how to get it from the statistics struct
+template <class Stats> struct metric_def {
+	const char *name, *type, *help;
+	double (*get)(const Stats &);
+};
+
+/// A distribution summarized by the fields of a statistics struct
+template <class Stats> struct distribution_def {
+	const char *name, *help;
+	uint64_t Stats::*p50, Stats::*p99, Stats::*max;
+};
+} // namespace
+
+template <class Stats>
+static void write_metrics(std::ostream &os, const char *prefix,
+	const std::vector<labeled_stats<Stats>> &streams,
+	std::initializer_list<metric_def<Stats>> metrics,
+	std::initializer_list<distribution_def<Stats>> distributions) {
+	if (streams.empty()) return;
+	for (const auto &m : metrics) {
+		os << "# HELP " << prefix << m.name << ' ' << m.help << '\n';
+		os << "# TYPE " << prefix << m.name << ' ' << m.type << '\n';
+		for (const auto &s : streams)
+			os << prefix << m.name << '{' << s.labels << "} " << m.get(s.stats) << '\n';
+	}
+	for (const auto &d : distributions) {
+		os << "# HELP " << prefix << d.name << ' ' << d.help << '\n';
+		os << "# TYPE " << prefix << d.name << " gauge\n";
+		for (const auto &s : streams) {
+			os << prefix << d.name << '{' << s.labels << ",quantile=\"0.5\"} " << s.stats.*d.p50
+			   << '\n';
+			os << prefix << d.name << '{' << s.labels << ",quantile=\"0.99\"} " << s.stats.*d.p99
+			   << '\n';
+			os << prefix << d.name << '{' << s.labels << ",quantile=\"1\"} " << s.stats.*d.max
+			   << '\n';
+		}
+	}
+}
+
+std::string metrics_registry::prometheus_text() {
+	std::vector<labeled_stats<lsl_outlet_stats>> outlets;
+	std::vector<labeled_stats<lsl_inlet_stats>> inlets;
+	{
+		// only collect the statistics under the lock, the formatting happens afterwards
+		std::lock_guard<std::mutex> lock(mut_);
+		for (auto *outlet : outlets_) {
+			outlets.push_back({labels_of(outlet->info()), {}});
+			outlet->stats(outlets.back().stats);
+		}
+		for (auto *inlet : inlets_) {
+			inlets.push_back({labels_of(inlet->type_info()), {}});
+			inlet->stats(inlets.back().stats);
+		}
+	}
+
+	using os_t = lsl_outlet_stats;
+	using is_t = lsl_inlet_stats;
+	std::ostringstream os;
+	os.precision(17);
+	write_metrics<os_t>(os, "lsl_outlet_", outlets,
+		{{"samples_pushed_total", "counter", "Samples pushed into the outlet.",
+			 [](const os_t &s) { return double(s.samples_pushed); }},
+			{"samples_dropped_total", "counter", "Samples dropped because an inlet fell behind.",
+				[](const os_t &s) { return double(s.samples_dropped); }},
+			{"samples_queued", "gauge", "Samples waiting to be sent.",
+				[](const os_t &s) { return double(s.samples_queued); }},
+			{"sessions_accepted_total", "counter", "Inlets that connected to the data port.",
+				[](const os_t &s) { return double(s.sessions_accepted); }},
+			{"sessions_active", "gauge", "Inlets connected to the data port.",
+				[](const os_t &s) { return double(s.sessions_active); }},
+			{"chunks_sent_total", "counter", "Chunks sent to inlets.",
+				[](const os_t &s) { return double(s.chunks_sent); }},
+			{"bytes_sent_total", "counter", "Bytes sent to inlets.",
+				[](const os_t &s) { return double(s.bytes_sent); }}},
+		{{"chunk_samples", "Samples per chunk.", &os_t::chunk_samples_p50,
+			 &os_t::chunk_samples_p99, &os_t::chunk_samples_max},
+			{"write_microseconds", "Time until a chunk was written to the socket.",
+				&os_t::write_us_p50, &os_t::write_us_p99, &os_t::write_us_max}});
+	write_metrics<is_t>(os, "lsl_inlet_", inlets,
+		{{"samples_received_total", "counter", "Samples received from the outlet.",
+			 [](const is_t &s) { return double(s.samples_received); }},
+			{"samples_dropped_total", "counter", "Samples lost before the pulled samples.",
+				[](const is_t &s) { return double(s.samples_dropped); }},
+			{"samples_queued", "gauge", "Samples waiting to be pulled.",
+				[](const is_t &s) { return double(s.samples_queued); }},
+			{"reconnects_total", "counter", "Times the connection was re-established.",
+				[](const is_t &s) { return double(s.reconnects); }},
+			{"time_probes_total", "counter", "Time synchronization probes answered.",
+				[](const is_t &s) { return double(s.time_probes); }},
+			{"time_correction_seconds", "gauge", "Estimated clock offset to the outlet's host.",
+				[](const is_t &s) { return s.time_correction; }},
+			{"time_uncertainty_seconds", "gauge", "Uncertainty of the clock offset estimate.",
+				[](const is_t &s) { return s.time_uncertainty; }}},
+		{{"rtt_microseconds", "Round trip time of the time synchronization probes.",
+			&is_t::rtt_us_p50, &is_t::rtt_us_p99, &is_t::rtt_us_max}});
+	return os.str();
+}
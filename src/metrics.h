@@ -0,0 +1,133 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lsl {
+class stream_inlet_impl;
+class stream_outlet_impl;
+
+/// A monotonically increasing count; updating it doesn't lock
+class counter {
+public:
+	void add(uint64_t n = 1) noexcept { value_.fetch_add(n, std::memory_order_relaxed); }
+	uint64_t value() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> value_{0};
+};
+
+/// A value that can go up and down
+class gauge {
+public:
+	void set(double value) noexcept { value_.store(value, std::memory_order_relaxed); }
+	double value() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<double> value_{0.0};
+};
+
+/**
+ * A histogram of non-negative integers (e.g. microseconds or sizes) with logarithmic buckets.
+ *
+ * Like in an HdrHistogram, each power of two is split into `sub_buckets` equally wide buckets,
+ * so a value is known with a relative error below 1/sub_buckets at any magnitude while the
+ * histogram has a fixed size. Recording a value is wait-free.
+ */
+class histogram {
+public:
+	static constexpr int sub_bucket_bits = 3;
+	static constexpr int sub_buckets = 1 << sub_bucket_bits;
+	static constexpr int num_buckets = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+	void record(uint64_t value) noexcept;
+
+	/// Number of recorded values
+	uint64_t count() const noexcept;
+
+	/// Sum of all recorded values
+	uint64_t sum() const noexcept { return sum_.load(std::memory_order_relaxed); }
+
+	/// The largest recorded value
+	uint64_t max() const noexcept { return max_.load(std::memory_order_relaxed); }
+
+	/// The value below which the fraction `q` (0..1) of the recorded values lie (0 if empty).
+	uint64_t quantile(double q) const noexcept;
+
+	/// The bucket a value is counted in
+	static int bucket(uint64_t value) noexcept;
+
+	/// The largest value counted in a bucket
+	static uint64_t bucket_limit(int bucket) noexcept;
+
+private:
+	std::array<std::atomic<uint64_t>, num_buckets> buckets_{};
+	std::atomic<uint64_t> sum_{0}, max_{0};
+};
+
+/// The metrics of an outlet that aren't tracked elsewhere, shared by its send buffer and server
+struct outlet_metrics {
+	/// samples dropped by the consumer queues
+	counter samples_dropped;
+	/// data connections accepted and currently open
+	counter sessions_accepted;
+	std::atomic<int64_t> sessions_active{0};
+	/// chunks and bytes written to the data connections
+	counter chunks_sent, bytes_sent;
+	/// samples per chunk
+	histogram chunk_samples;
+	/// duration of the chunk writes, in microseconds
+	histogram write_us;
+};
+
+/// The metrics of an inlet that aren't tracked elsewhere, shared by its connection and receivers
+struct inlet_metrics {
+	/// samples received by the data receiver
+	counter samples_received;
+	/// recoveries of a lost connection
+	counter reconnects;
+	/// round trip times of the time synchronization probes, in microseconds
+	histogram rtt_us;
+	/// the last clock offset estimate and its uncertainty
+	gauge time_correction, time_uncertainty;
+};
+
+/**
+ * Keeps track of all outlets and inlets of this process, so their statistics can be exported
+ * together, e.g. in the Prometheus text format.
+ *
+ * The metrics themselves are updated without involving the registry; only creating and
+ * destroying outlets and inlets and exporting the statistics lock it.
+ */
+class metrics_registry {
+public:
+	static metrics_registry &instance();
+
+	void add(stream_outlet_impl *outlet);
+	void remove(stream_outlet_impl *outlet);
+	void add(stream_inlet_impl *inlet);
+	void remove(stream_inlet_impl *inlet);
+
+	/**
+	 * The statistics of all outlets and inlets in the Prometheus text exposition format.
+	 *
+	 * Each metric is labeled with the stream's name, type and source id and the stream's uid,
+	 * distributions are exported as gauges with a `quantile` label (0.5, 0.99 and 1).
+	 */
+	std::string prometheus_text();
+
+private:
+	std::mutex mut_;
+	std::vector<stream_outlet_impl *> outlets_;
+	std::vector<stream_inlet_impl *> inlets_;
+};
+
+} // namespace lsl
+
+#endif
@@ -3,7 +3,24 @@
 #include "portable_archive/portable_iarchive.hpp"
 #include "portable_archive/portable_oarchive.hpp"
 #include "util/cast.hpp"
+#include "util/simd.hpp"
+#include <algorithm>
 #include <boost/endian/conversion.hpp>
+#include <cstring>
+#include <initializer_list>
+#include <loguru.hpp>
+#include <memory>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 using namespace lsl;
 using lslboost::endian::endian_reverse_inplace;
@@ -28,11 +45,21 @@ public:
 
 /// range-for helper. Sample usage: `for(auto &val: samplevalues<int32_t>()) val = 2;`
 template <typename T> inline dataiter<T> samplevals(sample &s) noexcept {
-	return dataiter<T>(iterhelper(s), s.num_channels());
+	return dataiter<T>(iterhelper(s), s.num_values());
 }
 
 template <typename T> inline dataiter<const T> samplevals(const sample &s) noexcept {
-	return dataiter<const T>(iterhelper(s), s.num_channels());
+	return dataiter<const T>(iterhelper(s), s.num_values());
+}
+
+/// range-for helper for the values of the `k`th sample in a chunk
+template <typename T> inline dataiter<T> samplevals(sample &s, uint32_t k) noexcept {
+	return dataiter<T>(reinterpret_cast<T *>(iterhelper(s)) + k * s.num_channels(), s.num_channels());
+}
+
+template <typename T> inline dataiter<const T> samplevals(const sample &s, uint32_t k) noexcept {
+	return dataiter<const T>(
+		reinterpret_cast<const T *>(iterhelper(s)) + k * s.num_channels(), s.num_channels());
 }
 
 /// Copy an array, converting between LSL types if needed
@@ -47,6 +74,20 @@ template <typename T> inline void copyconvert_array(const T *src, T *dst, std::s
 	memcpy(dst, src, n * sizeof(T));
 }
 
+/// Copy an array, special cases: conversions with vectorized kernels
+inline void copyconvert_array(const int16_t *src, float *dst, std::size_t n) noexcept {
+	simd::convert(src, dst, n);
+}
+inline void copyconvert_array(const float *src, int16_t *dst, std::size_t n) noexcept {
+	simd::convert(src, dst, n);
+}
+inline void copyconvert_array(const float *src, double *dst, std::size_t n) noexcept {
+	simd::convert(src, dst, n);
+}
+inline void copyconvert_array(const double *src, float *dst, std::size_t n) noexcept {
+	simd::convert(src, dst, n);
+}
+
 /// Copy an array, special case: destination is a string array
 template <typename T> inline void copyconvert_array(const T *src, std::string *dst, std::size_t n) {
 	for (const T *end = src + n; src < end;) *dst++ = lsl::to_string(*src++);
@@ -57,51 +98,102 @@ template <typename U> inline void copyconvert_array(const std::string *src, U *d
 	for (const auto *end = src + n; src < end;) *dst++ = lsl::from_string<U>(*src++);
 }
 
-/// Copy an array, special case: both arrays are string arrays
-inline void copyconvert_array(const std::string *src, std::string *dst, std::size_t n) {
-	std::copy_n(src, n, dst);
-}
-
 template <typename T, typename U> void lsl::sample::conv_from(const U *src) {
-	copyconvert_array(src, reinterpret_cast<T *>(&data_), num_channels_);
+	copyconvert_array(src, reinterpret_cast<T *>(&data_), num_values());
 }
 
 template <typename T, typename U> void lsl::sample::conv_into(U *dst) {
-	copyconvert_array(reinterpret_cast<const T *>(&data_), dst, num_channels_);
+	copyconvert_array(reinterpret_cast<const T *>(&data_), dst, num_values());
+}
+
+char *sample::string_space(std::size_t used, std::size_t len) {
+	if (used + len > strings_capacity_) {
+		// grow geometrically so that a recycled sample soon doesn't need to grow at all
+		const std::size_t capacity =
+			std::max<std::size_t>({used + len, 2 * strings_capacity_, 64});
+		char *grown = new char[capacity];
+		if (used) memcpy(grown, strings_, used);
+		delete[] strings_;
+		strings_ = grown;
+		strings_capacity_ = capacity;
+	}
+	return strings_ + used;
 }
 
-void sample::operator delete(void *x) noexcept {
-	if(x == nullptr) return;
+void sample::assign_string(std::size_t i, const char *str, std::size_t len) {
+	string_slot *slots = samplevals<string_slot>(*this).begin();
+	const std::size_t used = i ? slots[i - 1].offset + slots[i - 1].length : 0;
+	if (len) memcpy(string_space(used, len), str, len);
+	slots[i] = {used, len};
+}
 
-	lsl::factory *factory = reinterpret_cast<sample *>(x)->factory_;
+template <typename U> void sample::strings_from(const U *src) {
+	for (std::size_t i = 0; i < num_values(); ++i) {
+		const std::string str = lsl::to_string(src[i]);
+		assign_string(i, str.data(), str.size());
+	}
+}
 
-	// delete the underlying memory only if it wasn't allocated in the factory's storage area
-	if (x < factory->storage_ || x >= factory->storage_ + factory->storage_size_)
-		delete[](char *) x;
+template <> void sample::strings_from(const std::string *src) {
+	// reserve the space for all values at once
+	std::size_t total = 0;
+	for (std::size_t i = 0; i < num_values(); ++i) total += src[i].size();
+	string_space(0, total);
+	for (std::size_t i = 0; i < num_values(); ++i) assign_string(i, src[i].data(), src[i].size());
+}
+
+template <typename U> void sample::strings_into(U *dst) const {
+	for (const auto &slot : samplevals<string_slot>(*this))
+		*dst++ = lsl::from_string<U>(std::string(strings_ + slot.offset, slot.length));
+}
+
+template <> void sample::strings_into(std::string *dst) const {
+	for (const auto &slot : samplevals<string_slot>(*this))
+		(dst++)->assign(strings_ + slot.offset, slot.length);
+}
+
+void sample::operator delete(void *x) noexcept {
+	// only chunks are deleted, pooled samples are destroyed in place by their factory
+	delete[](char *) x;
 }
 
 /// ensure that a given value is a multiple of some base, round up if necessary
-constexpr uint32_t ensure_multiple(uint32_t v, unsigned base) {
+constexpr std::size_t ensure_multiple(std::size_t v, std::size_t base) {
 	return (v % base) ? v - (v % base) + base : v;
 }
 
 // Sample functions
 
+double *sample::timestamps() noexcept {
+	if (num_samples_ == 1) return &timestamp_;
+	// a chunk's timestamps are stored right after its channel data
+	return reinterpret_cast<double *>(reinterpret_cast<char *>(&data_) +
+									  ensure_multiple(datasize() * num_samples_, sizeof(double)));
+}
+
 lsl::sample::~sample() noexcept {
-	if (format_ == cft_string)
-		for (auto &val : samplevals<std::string>(*this)) val.~basic_string<char>();
+	clear_serialized();
+	delete[] strings_;
 }
 
 bool sample::operator==(const sample &rhs) const noexcept {
 	if ((timestamp_ != rhs.timestamp_) || (format_ != rhs.format_) ||
-		(num_channels_ != rhs.num_channels_))
+		(num_channels_ != rhs.num_channels_) || (num_samples_ != rhs.num_samples_))
+		return false;
+	if (num_samples_ > 1 &&
+		memcmp(timestamps(), rhs.timestamps(), num_samples_ * sizeof(double)) != 0)
 		return false;
 	if (format_ != cft_string)
-		return memcmp(&(rhs.data_), &data_, datasize()) == 0;
+		return memcmp(&(rhs.data_), &data_, datasize() * num_samples_) == 0;
 
 	// For string values, each value has to be compared individually
-	auto thisvals = samplevals<const std::string>(*this);
-	return std::equal(thisvals.begin(), thisvals.end(), samplevals<std::string>(rhs).begin());
+	auto thisslots = samplevals<string_slot>(*this);
+	return std::equal(thisslots.begin(), thisslots.end(), samplevals<string_slot>(rhs).begin(),
+		[&](const string_slot &l, const string_slot &r) {
+			return l.length == r.length &&
+				   (!l.length ||
+					   memcmp(strings_ + l.offset, rhs.strings_ + r.offset, l.length) == 0);
+		});
 }
 
 template <class T> void lsl::sample::assign_typed(const T *src) {
@@ -114,7 +206,7 @@ template <class T> void lsl::sample::assign_typed(const T *src) {
 #ifndef BOOST_NO_INT64_T
 	case cft_int64: conv_from<int64_t>(src); break;
 #endif
-	case cft_string: conv_from<std::string>(src); break;
+	case cft_string: strings_from(src); break;
 	default: throw std::invalid_argument("Unsupported channel format.");
 	}
 }
@@ -129,7 +221,7 @@ template <class T> void lsl::sample::retrieve_typed(T *dst) {
 #ifndef BOOST_NO_INT64_T
 	case cft_int64: conv_into<int64_t>(dst); break;
 #endif
-	case cft_string: conv_into<std::string>(dst); break;
+	case cft_string: strings_into(dst); break;
 	default: throw std::invalid_argument("Unsupported channel format.");
 	}
 }
@@ -188,38 +280,125 @@ template <typename T> void save_value(std::streambuf &sb, T v, bool reverse_byte
 
 void sample::save_streambuf(
 	std::streambuf &sb, int /*protocol_version*/, bool reverse_byte_order, void *scratchpad) const {
+	for (uint32_t k = 0; k < num_samples_; ++k)
+		save_streambuf_sample(sb, k, reverse_byte_order, scratchpad);
+}
+
+/// A stream buffer appending to a std::vector
+class vector_streambuf : public std::streambuf {
+public:
+	explicit vector_streambuf(std::vector<char> &vec) : vec_(vec) {}
+
+protected:
+	int_type overflow(int_type ch) override {
+		if (ch != traits_type::eof()) vec_.push_back(static_cast<char>(ch));
+		return ch;
+	}
+	std::streamsize xsputn(const char *s, std::streamsize n) override {
+		vec_.insert(vec_.end(), s, s + n);
+		return n;
+	}
+
+private:
+	std::vector<char> &vec_;
+};
+
+/// One serialization of a sample, in a list of all serializations of the sample
+struct sample::serialization {
+	bool reverse_byte_order;
+	std::vector<char> bytes;
+	serialization *next;
+};
+
+const std::vector<char> &sample::serialized(bool reverse_byte_order) const {
+	serialization *head = serialized_.load(std::memory_order_acquire);
+	for (serialization *s = head; s; s = s->next)
+		if (s->reverse_byte_order == reverse_byte_order) return s->bytes;
+
+	// serialize without holding a lock, if another thread was faster its bytes are used instead
+	std::unique_ptr<serialization> fresh(new serialization{reverse_byte_order, {}, head});
+	if (format_ != cft_string)
+		fresh->bytes.reserve(num_samples_ * (max_header_bytes + datasize()));
+	vector_streambuf sb(fresh->bytes);
+	std::unique_ptr<char[]> scratch(reverse_byte_order ? new char[datasize()] : nullptr);
+	save_streambuf(sb, LSL_PROTOCOL_VERSION, reverse_byte_order, scratch.get());
+
+	while (!serialized_.compare_exchange_weak(
+		fresh->next, fresh.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+		// only the serializations added since the last attempt need to be checked
+		for (serialization *s = fresh->next; s != head; s = s->next)
+			if (s->reverse_byte_order == reverse_byte_order) return s->bytes;
+		head = fresh->next;
+	}
+	return fresh.release()->bytes;
+}
+
+void sample::clear_serialized() noexcept {
+	if (!serialized_.load(std::memory_order_relaxed)) return;
+	serialization *s = serialized_.exchange(nullptr, std::memory_order_acquire);
+	while (s) delete std::exchange(s, s->next);
+}
+
+std::size_t sample::save_header_raw(char *dst, uint32_t k) const {
+	const double timestamp = timestamps()[k];
+	if (timestamp == DEDUCED_TIMESTAMP) {
+		*dst = static_cast<char>(TAG_DEDUCED_TIMESTAMP);
+		return 1;
+	}
+	*dst = static_cast<char>(TAG_TRANSMITTED_TIMESTAMP);
+	memcpy(dst + 1, &timestamp, sizeof(timestamp));
+	return max_header_bytes;
+}
+
+void sample::save_gap_marker(char *dst, uint32_t missing, bool reverse_byte_order) {
+	if (reverse_byte_order) endian_reverse_inplace(missing);
+	*dst = static_cast<char>(TAG_GAP);
+	memcpy(dst + 1, &missing, sizeof(missing));
+}
+
+uint32_t sample::load_gap_marker(const char *src, bool reverse_byte_order) {
+	uint32_t missing;
+	memcpy(&missing, src + 1, sizeof(missing));
+	if (reverse_byte_order) endian_reverse_inplace(missing);
+	return missing;
+}
+
+void sample::save_streambuf_sample(
+	std::streambuf &sb, uint32_t k, bool reverse_byte_order, void *scratchpad) const {
 	// write sample header
-	if (timestamp_ == DEDUCED_TIMESTAMP) {
+	const double timestamp = timestamps()[k];
+	if (timestamp == DEDUCED_TIMESTAMP) {
 		save_byte(sb, TAG_DEDUCED_TIMESTAMP);
 	} else {
 		save_byte(sb, TAG_TRANSMITTED_TIMESTAMP);
-		save_value(sb, timestamp_, reverse_byte_order);
+		save_value(sb, timestamp, reverse_byte_order);
 	}
 	// write channel data
 	if (format_ == cft_string) {
-		for (const auto &str : samplevals<std::string>(*this)) {
+		for (const auto &slot : samplevals<string_slot>(*this, k)) {
 			// write string length as variable-length integer
-			if (str.size() <= 0xFF) {
+			if (slot.length <= 0xFF) {
 				save_byte(sb, static_cast<uint8_t>(sizeof(uint8_t)));
-				save_byte(sb, static_cast<uint8_t>(str.size()));
+				save_byte(sb, static_cast<uint8_t>(slot.length));
 			} else {
-				if (str.size() <= 0xFFFFFFFF) {
+				if (slot.length <= 0xFFFFFFFF) {
 					save_byte(sb, static_cast<uint8_t>(sizeof(uint32_t)));
-					save_value(sb, static_cast<uint32_t>(str.size()), reverse_byte_order);
+					save_value(sb, static_cast<uint32_t>(slot.length), reverse_byte_order);
 				} else {
 					save_byte(sb, static_cast<uint8_t>(sizeof(uint64_t)));
-					save_value(sb, static_cast<std::size_t>(str.size()), reverse_byte_order);
+					save_value(sb, static_cast<std::size_t>(slot.length), reverse_byte_order);
 				}
 			}
 			// write string contents
-			if (!str.empty()) save_raw(sb, str.data(), str.size());
+			if (slot.length) save_raw(sb, strings_ + slot.offset, slot.length);
 		}
 	} else {
 		// write numeric data in binary
+		const char *data = reinterpret_cast<const char *>(&data_) + k * datasize();
 		if (!reverse_byte_order || format_sizes[format_] == 1) {
-			save_raw(sb, &data_, datasize());
+			save_raw(sb, data, datasize());
 		} else {
-			memcpy(scratchpad, &data_, datasize());
+			memcpy(scratchpad, data, datasize());
 			convert_endian(scratchpad, num_channels_, format_sizes[format_]);
 			save_raw(sb, scratchpad, datasize());
 		}
@@ -238,7 +417,8 @@ void sample::load_streambuf(
 
 	// read channel data
 	if (format_ == cft_string) {
-		for (auto &str : samplevals<std::string>(*this)) {
+		std::size_t used = 0;
+		for (auto &slot : samplevals<string_slot>(*this)) {
 			// read string length as variable-length integer
 			std::size_t len = 0;
 			auto lenbytes = load_byte(sb);
@@ -256,86 +436,209 @@ void sample::load_streambuf(
 			default: throw std::runtime_error("Stream contents corrupted (invalid varlen int).");
 			}
 			// read string contents
-			str.resize(len);
-			if (len > 0) load_raw(sb, &(str[0]), len);
+			if (len > 0) load_raw(sb, string_space(used, len), len);
+			slot = {used, len};
+			used += len;
 		}
 	} else {
 		// read numeric channel data
 		load_raw(sb, &data_, datasize());
 		if (reverse_byte_order && format_sizes[format_] > 1)
 			convert_endian(&data_, num_channels(), format_sizes[format_]);
-		if (suppress_subnormals && format_float[format_]) {
-			if (format_ == cft_float32) {
-				for (auto &val : samplevals<uint32_t>(*this))
-					if (val && ((val & UINT32_C(0x7fffffff)) <= UINT32_C(0x007fffff)))
-						val &= UINT32_C(0x80000000);
-			} else {
-#ifndef BOOST_NO_INT64_T
-				for (auto &val : samplevals<uint64_t>(*this))
-					if (val &&
-						((val & UINT64_C(0x7fffffffffffffff)) <= UINT64_C(0x000fffffffffffff)))
-						val &= UINT64_C(0x8000000000000000);
-#endif
+		if (suppress_subnormals && format_float[format_]) zero_subnormals();
+	}
+}
+
+/// Write the values as zig-zag varints of their differences to `previous`
+template <typename T>
+static char *encode_deltas(const T *values, uint32_t n, int64_t *previous, char *out) noexcept {
+	for (uint32_t i = 0; i < n; ++i) {
+		// wrap around instead of overflowing for 64 bit values
+		const auto value = static_cast<int64_t>(values[i]);
+		const uint64_t delta = static_cast<uint64_t>(value) - static_cast<uint64_t>(previous[i]);
+		previous[i] = value;
+		uint64_t zigzag = (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+		for (; zigzag >= 0x80; zigzag >>= 7) *out++ = static_cast<char>(zigzag | 0x80);
+		*out++ = static_cast<char>(zigzag);
+	}
+	return out;
+}
+
+/// Read the values written by encode_deltas()
+template <typename T>
+static void decode_deltas(std::streambuf &sb, T *values, uint32_t n, int64_t *previous) {
+	for (uint32_t i = 0; i < n; ++i) {
+		uint64_t zigzag = 0;
+		for (unsigned shift = 0;; shift += 7) {
+			if (shift > 63) throw std::runtime_error("Stream contents corrupted (invalid varint).");
+			const uint8_t byte = load_byte(sb);
+			zigzag |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) break;
+		}
+		const uint64_t delta = (zigzag >> 1) ^ (0 - (zigzag & 1));
+		previous[i] = static_cast<int64_t>(static_cast<uint64_t>(previous[i]) + delta);
+		values[i] = static_cast<T>(previous[i]);
+	}
+}
+
+void sample::save_streambuf_delta(
+	std::streambuf &sb, bool reverse_byte_order, int64_t *previous) const {
+	// encode the values in batches, a varint takes up to 10 bytes
+	const uint32_t batch = 64;
+	char buf[max_header_bytes + batch * 10];
+	for (uint32_t k = 0; k < num_samples_; ++k) {
+		char *out = buf;
+		const double timestamp = timestamps()[k];
+		if (timestamp == DEDUCED_TIMESTAMP)
+			*out++ = static_cast<char>(TAG_DEDUCED_TIMESTAMP);
+		else {
+			double ts = timestamp;
+			if (reverse_byte_order) endian_reverse_inplace(ts);
+			*out++ = static_cast<char>(TAG_TRANSMITTED_TIMESTAMP);
+			memcpy(out, &ts, sizeof(ts));
+			out += sizeof(ts);
+		}
+		const char *data = static_cast<const char *>(raw_data(k));
+		for (uint32_t i = 0; i < num_channels_; i += batch) {
+			const uint32_t n = std::min(batch, num_channels_ - i);
+			const char *values = data + i * format_sizes[format_];
+			switch (format_) {
+			case cft_int8:
+				out = encode_deltas(reinterpret_cast<const int8_t *>(values), n, previous + i, out);
+				break;
+			case cft_int16:
+				out = encode_deltas(reinterpret_cast<const int16_t *>(values), n, previous + i, out);
+				break;
+			case cft_int32:
+				out = encode_deltas(reinterpret_cast<const int32_t *>(values), n, previous + i, out);
+				break;
+			case cft_int64:
+				out = encode_deltas(reinterpret_cast<const int64_t *>(values), n, previous + i, out);
+				break;
+			default: throw std::invalid_argument("Delta encoding requires an integer format.");
 			}
+			save_raw(sb, buf, static_cast<std::size_t>(out - buf));
+			out = buf;
 		}
+		if (out != buf) save_raw(sb, buf, static_cast<std::size_t>(out - buf));
 	}
 }
 
-void lsl::sample::convert_endian(void *data, uint32_t n, uint32_t width) {
-	void *dataptr = reinterpret_cast<void *>(data);
-	switch (width) {
-	case 1: break;
-	case sizeof(int16_t):
-		for (auto &val : dataiter<int16_t>(dataptr, n)) endian_reverse_inplace(val);
+void sample::load_streambuf_delta(std::streambuf &sb, bool reverse_byte_order, int64_t *previous) {
+	if (load_byte(sb) == TAG_DEDUCED_TIMESTAMP)
+		timestamp_ = DEDUCED_TIMESTAMP;
+	else
+		timestamp_ = load_value<double>(sb, reverse_byte_order);
+	switch (format_) {
+	case cft_int8:
+		decode_deltas(sb, reinterpret_cast<int8_t *>(&data_), num_channels_, previous);
 		break;
-	case sizeof(int32_t):
-		for (auto &val : dataiter<int32_t>(dataptr, n)) endian_reverse_inplace(val);
+	case cft_int16:
+		decode_deltas(sb, reinterpret_cast<int16_t *>(&data_), num_channels_, previous);
+		break;
+	case cft_int32:
+		decode_deltas(sb, reinterpret_cast<int32_t *>(&data_), num_channels_, previous);
 		break;
-	case sizeof(int64_t):
-		for (auto &val : dataiter<int64_t>(dataptr, n)) endian_reverse_inplace(val);
+	case cft_int64:
+		decode_deltas(sb, reinterpret_cast<int64_t *>(&data_), num_channels_, previous);
 		break;
+	default: throw std::invalid_argument("Delta encoding requires an integer format.");
+	}
+}
+
+std::size_t sample::load_buffer(
+	const char *buf, std::size_t len, bool reverse_byte_order, bool suppress_subnormals) {
+	if (len == 0) return 0;
+	// read sample header
+	const bool deduced = static_cast<uint8_t>(buf[0]) == TAG_DEDUCED_TIMESTAMP;
+	const std::size_t header_len = deduced ? 1 : max_header_bytes;
+	if (len < header_len + datasize()) return 0;
+	if (deduced)
+		timestamp_ = DEDUCED_TIMESTAMP;
+	else {
+		memcpy(&timestamp_, buf + 1, sizeof(timestamp_));
+		if (reverse_byte_order) endian_reverse_inplace(timestamp_);
+	}
+	// read numeric channel data
+	memcpy(&data_, buf + header_len, datasize());
+	if (reverse_byte_order && format_sizes[format_] > 1)
+		convert_endian(&data_, num_channels(), format_sizes[format_]);
+	if (suppress_subnormals && format_float[format_]) zero_subnormals();
+	return header_len + datasize();
+}
+
+void sample::zero_subnormals() noexcept {
+	if (format_ == cft_float32)
+		simd::zero_subnormals(reinterpret_cast<uint32_t *>(&data_), num_values());
+	else
+		simd::zero_subnormals(reinterpret_cast<uint64_t *>(&data_), num_values());
+}
+
+void lsl::sample::convert_endian(void *data, uint32_t n, uint32_t width) {
+	switch (width) {
+	case 1: break;
+	case sizeof(int16_t): simd::byteswap(reinterpret_cast<uint16_t *>(data), n); break;
+	case sizeof(int32_t): simd::byteswap(reinterpret_cast<uint32_t *>(data), n); break;
+	case sizeof(int64_t): simd::byteswap(reinterpret_cast<uint64_t *>(data), n); break;
 	default: throw std::runtime_error("Unsupported channel format for endian conversion.");
 	}
 }
 
-template <class Archive> void sample::serialize_channels(Archive &ar, const uint32_t /*unused*/) {
+template <class Archive>
+void sample::serialize_channels(Archive &ar, const uint32_t /*unused*/, uint32_t k) {
 	switch (format_) {
 	case cft_float32:
-		for (auto &val : samplevals<float>(*this)) ar &val;
+		for (auto &val : samplevals<float>(*this, k)) ar &val;
 		break;
 	case cft_double64:
-		for (auto &val : samplevals<double>(*this)) ar &val;
-		break;
-	case cft_string:
-		for (auto &val : samplevals<std::string>(*this)) ar &val;
+		for (auto &val : samplevals<double>(*this, k)) ar &val;
 		break;
+	case cft_string: serialize_strings(ar, k); break;
 	case cft_int8:
-		for (auto &val : samplevals<int8_t>(*this)) ar &val;
+		for (auto &val : samplevals<int8_t>(*this, k)) ar &val;
 		break;
 	case cft_int16:
-		for (auto &val : samplevals<int16_t>(*this)) ar &val;
+		for (auto &val : samplevals<int16_t>(*this, k)) ar &val;
 		break;
 	case cft_int32:
-		for (auto &val : samplevals<int32_t>(*this)) ar &val;
+		for (auto &val : samplevals<int32_t>(*this, k)) ar &val;
 		break;
 #ifndef BOOST_NO_INT64_T
 	case cft_int64:
-		for (auto &val : samplevals<int64_t>(*this)) ar &val;
+		for (auto &val : samplevals<int64_t>(*this, k)) ar &val;
 		break;
 #endif
 	default: throw std::runtime_error("Unsupported channel format.");
 	}
 }
 
+void sample::serialize_strings(eos::portable_oarchive &ar, uint32_t k) const {
+	for (const auto &slot : samplevals<string_slot>(*this, k)) {
+		std::string str(strings_ + slot.offset, slot.length);
+		ar &str;
+	}
+}
+
+void sample::serialize_strings(eos::portable_iarchive &ar, uint32_t k) {
+	std::string str;
+	for (uint32_t i = 0; i < num_channels_; ++i) {
+		ar &str;
+		assign_string(k * num_channels_ + i, str.data(), str.size());
+	}
+}
+
 void lsl::sample::serialize(eos::portable_oarchive &ar, const uint32_t archive_version) const {
-	// write sample header
-	if (timestamp_ == DEDUCED_TIMESTAMP) {
-		ar &TAG_DEDUCED_TIMESTAMP;
-	} else {
-		ar &TAG_TRANSMITTED_TIMESTAMP &timestamp_;
+	for (uint32_t k = 0; k < num_samples_; ++k) {
+		// write sample header
+		const double &timestamp = timestamps()[k];
+		if (timestamp == DEDUCED_TIMESTAMP) {
+			ar &TAG_DEDUCED_TIMESTAMP;
+		} else {
+			ar &TAG_TRANSMITTED_TIMESTAMP &timestamp;
+		}
+		// write channel data
+		const_cast<sample *>(this)->serialize_channels(ar, archive_version, k);
 	}
-	// write channel data
-	const_cast<sample *>(this)->serialize_channels(ar, archive_version);
 }
 
 void lsl::sample::serialize(eos::portable_iarchive &ar, const uint32_t archive_version) {
@@ -373,12 +676,12 @@ sample &sample::assign_test_pattern(int offset) {
 	case cft_double64:
 		test_pattern(samplevals<double>(*this).begin(), num_channels_, offset + 16777217);
 		break;
-	case cft_string: {
-		std::string *data = samplevals<std::string>(*this).begin();
-		for (int32_t k = 0u; k < (int)num_channels_; k++)
-			data[k] = to_string((k + 10) * (k % 2 == 0 ? 1 : -1));
+	case cft_string:
+		for (int32_t k = 0u; k < (int)num_channels_; k++) {
+			const std::string str = to_string((k + 10) * (k % 2 == 0 ? 1 : -1));
+			assign_string(k, str.data(), str.size());
+		}
 		break;
-	}
 	case cft_int32:
 		test_pattern(samplevals<int32_t>(*this).begin(), num_channels_, offset + 65537);
 		break;
@@ -405,46 +708,137 @@ sample &sample::assign_test_pattern(int offset) {
 	return *this;
 }
 
-lsl::sample::sample(lsl_channel_format_t fmt, uint32_t num_channels, factory *fact)
-	: format_(fmt), num_channels_(num_channels), refcount_(0), next_(nullptr), factory_(fact) {
-	// construct std::strings in the data section via placement new
+lsl::sample::sample(
+	lsl_channel_format_t fmt, uint32_t num_channels, factory *fact, uint32_t num_samples)
+	: format_(fmt), num_channels_(num_channels), num_samples_(num_samples), refcount_(0),
+	  next_(nullptr), factory_(fact) {
+	// all string values start out empty
 	if (format_ == cft_string)
-		for (auto &val : samplevals<std::string>(*this)) new (&val) std::string();
+		for (auto &slot : samplevals<string_slot>(*this)) slot = {0, 0};
+}
+
+/// Allocate the memory for a slab, on the NUMA node of the calling thread if requested
+static char *allocate_slab(std::size_t size, bool numa_local) {
+#ifdef __linux__
+	if (numa_local) {
+		// fresh pages from the kernel are placed on the node of the thread touching them first,
+		// i.e. the one constructing the samples; the memory policy keeps them there
+		void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED) throw std::bad_alloc();
+		unsigned cpu = 0, node = 0;
+		const unsigned long mpol_preferred = 1;
+		if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 && node < sizeof(unsigned long) * 8) {
+			unsigned long nodemask = 1ul << node;
+			// fails without NUMA support in the kernel, which is fine
+			syscall(SYS_mbind, mem, size, mpol_preferred, &nodemask, sizeof(nodemask) * 8, 0);
+		}
+		return static_cast<char *>(mem);
+	}
+#else
+	(void)numa_local;
+#endif
+	return new char[size];
 }
 
-factory::factory(lsl_channel_format_t fmt, uint32_t num_chans, uint32_t num_reserve)
-	: fmt_(fmt), num_chans_(num_chans),
-	  sample_size_(ensure_multiple(
-		  sizeof(sample) - sizeof(sample::data_) + format_sizes[fmt] * num_chans, 16)),
-	  storage_size_(sample_size_ * std::max(2u, num_reserve + 1)),
-	  storage_(new char[storage_size_]), head_(sentinel()), tail_(sentinel()) {
+static void free_slab(char *mem, std::size_t size, bool numa_local) {
+#ifdef __linux__
+	if (numa_local) {
+		munmap(mem, size);
+		return;
+	}
+#else
+	(void)numa_local;
+	(void)size;
+#endif
+	delete[] mem;
+}
 
-	// pre-construct an array of samples in the storage area and chain into a freelist
-	// this is functionally identical to calling `reclaim_sample()` for each sample, but alters
-	// the head_/tail_ positions only once
-	sample *s = sample_by_index(0);
-	for (char *p = storage_, *e = p + storage_size_; p < e;) {
-		s = new (reinterpret_cast<sample *>(p)) sample(fmt, num_chans, this);
-		s->next_ = reinterpret_cast<sample *>(p += sample_size_);
+factory::factory(
+	lsl_channel_format_t fmt, uint32_t num_chans, uint32_t num_reserve, bool numa_local)
+	: fmt_(fmt), num_chans_(num_chans),
+	  sample_size_(static_cast<uint32_t>(ensure_multiple(
+		  sizeof(sample) - sizeof(sample::data_) + format_sizes[fmt] * num_chans, 16))),
+	  slab_samples_(std::max(16u, num_reserve / 4)), numa_local_(numa_local),
+	  deferred_reserve_(numa_local ? num_reserve : 0),
+	  sentinel_(new (new char[sample_size_]) sample(fmt, num_chans, this)), head_(sentinel_),
+	  tail_(sentinel_) {
+	if (!numa_local_) add_slab(std::max(1u, num_reserve));
+}
+
+void factory::add_slab(uint32_t num_samples) {
+	const std::size_t size = static_cast<std::size_t>(sample_size_) * num_samples;
+	char *mem = allocate_slab(size, numa_local_);
+	slabs_.push_back({mem, size});
+
+	// construct the samples and chain them into a freelist; this is functionally identical to
+	// calling `push_freelist()` for each sample, but alters the head_ position only once
+	sample *first = nullptr, *last = nullptr;
+	for (char *p = mem, *e = mem + size; p < e; p += sample_size_) {
+		auto *s = new (reinterpret_cast<sample *>(p)) sample(fmt_, num_chans_, this);
+		if (last)
+			last->next_.store(s, std::memory_order_relaxed);
+		else
+			first = s;
+		last = s;
 	}
-	s->next_ = nullptr;
-	head_.store(s);
+	sample *prev = head_.exchange(last, std::memory_order_acq_rel);
+	prev->next_.store(first, std::memory_order_release);
+
+	num_slabs_.fetch_add(1, std::memory_order_relaxed);
+	capacity_.fetch_add(num_samples, std::memory_order_relaxed);
+	if (slabs_.size() > 1)
+		LOG_F(1, "Sample factory grew to %u samples in %u slabs",
+			capacity_.load(std::memory_order_relaxed), static_cast<unsigned>(slabs_.size()));
 }
 
 sample_p factory::new_sample(double timestamp, bool pushthrough) {
 	sample *result;
-	// try to retrieve a free sample, adding fresh samples until it succeeds
-	while((result = pop_freelist()) == nullptr)
-		reclaim_sample(new (new char[sample_size_]) sample(fmt_, num_chans_, this));
+	// try to retrieve a free sample, adding a new slab until it succeeds
+	for (int retries = 0; (result = pop_freelist()) == nullptr; ++retries) {
+		// the freelist looks empty while a sample is being reclaimed, so retry a few times
+		// before growing the pool if not all samples are in use
+		const bool reclaiming =
+			in_use_.load(std::memory_order_relaxed) < capacity_.load(std::memory_order_relaxed);
+		if (reclaiming && retries < max_pop_retries) {
+			// give the reclaiming thread a moment to link its sample, then its time slice
+			if (retries < max_pop_retries / 2)
+				cpu_relax();
+			else
+				std::this_thread::yield();
+			continue;
+		}
+		if (reclaiming) {
+			reclaim_slabs_.fetch_add(1, std::memory_order_relaxed);
+			LOG_F(1, "Sample factory adds a slab while samples are being reclaimed");
+		}
+		add_slab(std::max(deferred_reserve_, slab_samples_));
+		deferred_reserve_ = 0;
+		retries = 0;
+	}
+
+	const uint32_t in_use = in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+	if (in_use > high_water_mark_.load(std::memory_order_relaxed))
+		high_water_mark_.store(in_use, std::memory_order_relaxed);
 
 	result->timestamp_ = timestamp;
 	result->pushthrough = pushthrough;
 	return {result};
 }
 
+sample_p factory::new_chunk(uint32_t num_samples, bool pushthrough) {
+	if (num_samples < 2) throw std::invalid_argument("A chunk must hold at least two samples.");
+	const std::size_t values_size = ensure_multiple(
+		static_cast<std::size_t>(format_sizes[fmt_]) * num_chans_ * num_samples, sizeof(double));
+	char *mem = new char[sizeof(sample) - sizeof(sample::data_) + values_size +
+						 num_samples * sizeof(double)];
+	sample *result = new (mem) sample(fmt_, num_chans_, this, num_samples);
+	result->pushthrough = pushthrough;
+	return {result};
+}
+
 sample *factory::pop_freelist() {
 	sample *tail = tail_, *next = tail->next_.load(std::memory_order_acquire);
-	if (tail == sentinel()) {
+	if (tail == sentinel_) {
 		// no samples available
 		if (!next) return nullptr;
 		tail_.store(next, std::memory_order_relaxed);
@@ -456,9 +850,9 @@ sample *factory::pop_freelist() {
 		return tail;
 	}
 	sample *head = head_.load(std::memory_order_acquire);
-	//
+	// a reclaim is in flight, its sample isn't linked yet
 	if (tail != head) return nullptr;
-	reclaim_sample(sentinel());
+	push_freelist(sentinel_);
 	next = tail->next_.load(std::memory_order_acquire);
 	if (next) {
 		tail_ = next;
@@ -468,19 +862,37 @@ sample *factory::pop_freelist() {
 }
 
 factory::~factory() {
+	// destroy the samples in place; samples still in use at this point are leaked
 	for (sample *cur = tail_, *next = cur->next_;; cur = next, next = next->next_) {
-		if (cur != sentinel()) delete cur;
+		cur->~sample();
 		if (!next) break;
 	}
-	delete[] storage_;
+	// the slabs of leaked samples are leaked as well, instead of being freed under their owners
+	if (const uint32_t in_use = in_use_.load(std::memory_order_acquire))
+		LOG_F(WARNING, "Sample factory destroyed with %u samples in use", in_use);
+	else
+		for (const auto &s : slabs_) free_slab(s.mem, s.size, numa_local_);
+	delete[] reinterpret_cast<char *>(sentinel_);
 }
 
 void factory::reclaim_sample(sample *s) {
+	s->clear_serialized();
+	in_use_.fetch_sub(1, std::memory_order_relaxed);
+	push_freelist(s);
+}
+
+void factory::push_freelist(sample *s) {
 	s->next_.store(nullptr, std::memory_order_release); // TODO: might be _relaxed?
 	sample *prev = head_.exchange(s, std::memory_order_acq_rel);
 	prev->next_.store(s, std::memory_order_release);
 }
 
+factory_stats factory::stats() const {
+	return {num_slabs_.load(std::memory_order_relaxed), capacity_.load(std::memory_order_relaxed),
+		in_use_.load(std::memory_order_relaxed), high_water_mark_.load(std::memory_order_relaxed),
+		reclaim_slabs_.load(std::memory_order_relaxed)};
+}
+
 // template instantiations
 template void lsl::sample::assign_typed(float const *);
 template void lsl::sample::assign_typed(double const *);
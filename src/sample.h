@@ -11,6 +11,7 @@
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 
 namespace lsl {
@@ -20,9 +21,20 @@ static_assert(sizeof(double) == 8, "Target arch has unexpected double size (!=8)
 // constants used in the network protocol
 const uint8_t TAG_DEDUCED_TIMESTAMP = 1;
 const uint8_t TAG_TRANSMITTED_TIMESTAMP = 2;
+/// announces samples the outlet couldn't send, e.g. because the inlet's queue overflowed; it's
+/// followed by the number of missing samples (uint32) and only sent with `Sequence-Numbers: 1`
+const uint8_t TAG_GAP = 3;
+/// size of a gap marker (see TAG_GAP)
+constexpr std::size_t GAP_MARKER_BYTES = 1 + sizeof(uint32_t);
+
+/// Location of a string value in the string storage of its sample
+struct string_slot {
+	std::size_t offset;
+	std::size_t length;
+};
 
-/// channel format properties
-const uint8_t format_sizes[] = {0, sizeof(float), sizeof(double), sizeof(std::string),
+/// channel format properties (string values are stored as string_slot, see sample)
+const uint8_t format_sizes[] = {0, sizeof(float), sizeof(double), sizeof(string_slot),
 	sizeof(int32_t), sizeof(int16_t), sizeof(int8_t), 8};
 const bool format_ieee754[] = {false, std::numeric_limits<float>::is_iec559,
 	std::numeric_limits<double>::is_iec559, false, false, false, false, false};
@@ -33,7 +45,28 @@ const bool format_subnormal[] = {false,
 const bool format_integral[] = {false, false, false, false, true, true, true, true};
 const bool format_float[] = {false, true, true, false, false, false, false, false};
 
-/// A factory to create samples of a given format/size. Must outlive all of its created samples.
+/// Memory usage statistics of a factory
+struct factory_stats {
+	/// number of slabs of pooled samples
+	uint32_t slabs;
+	/// number of pooled samples, i.e. the capacity of all slabs
+	uint32_t capacity;
+	/// number of pooled samples that are currently in use
+	uint32_t in_use;
+	/// the highest number of pooled samples in use at the same time
+	uint32_t high_water_mark;
+	/// number of slabs added because the freelist looked empty during a reclaim, although not
+	/// all samples were in use
+	uint32_t reclaim_slabs;
+};
+
+/**
+ * A factory to create samples of a given format/size. Must outlive all of its created samples.
+ *
+ * Samples are allocated in slabs and recycled via a freelist. Once all samples are in use, the
+ * factory adds another slab, so the pool grows to the highest number of samples in use at the
+ * same time and never falls back to allocating single samples.
+ */
 class factory {
 public:
 	/**
@@ -41,8 +74,11 @@ public:
 	 * @param fmt Sample format
 	 * @param num_chans nr of channels
 	 * @param num_reserve nr of samples to pre-allocate in the storage pool
+	 * @param numa_local Place the slabs on the NUMA node of the thread calling new_sample().
+	 * The pre-allocated samples are then only allocated by the first new_sample() call.
 	 */
-	factory(lsl_channel_format_t fmt, uint32_t num_chans, uint32_t num_reserve);
+	factory(lsl_channel_format_t fmt, uint32_t num_chans, uint32_t num_reserve,
+		bool numa_local = false);
 
 	/// Destroy the factory and delete all of its samples.
 	~factory();
@@ -51,22 +87,42 @@ public:
 	/// Only one thread may call this function for a given factory object.
 	sample_p new_sample(double timestamp, bool pushthrough);
 
+	/**
+	 * Create a new chunk holding `num_samples` (>1) consecutive samples in one allocation.
+	 *
+	 * A chunk is passed through the send buffer and the consumer queues as a single unit; its
+	 * timestamps are stored in a separate array (see sample::timestamps()).
+	 * Chunks are not pooled, they are freed once they are no longer referenced.
+	 */
+	sample_p new_chunk(uint32_t num_samples, bool pushthrough);
+
 	/// Reclaim a sample that's no longer used.
 	void reclaim_sample(sample *s);
 
+	/// Get the memory usage statistics. Can be called from any thread.
+	factory_stats stats() const;
+
+	factory(const factory &) = delete;
+	factory &operator=(const factory &) = delete;
+
 private:
+	/// A contiguous block of memory holding pooled samples
+	struct slab {
+		char *mem;
+		std::size_t size;
+	};
+
 	/// Pop a sample from the freelist (multi-producer/single-consumer queue by Dmitry Vjukov)
 	sample *pop_freelist();
 
-	/// Return the address of a pre-allocated sample, #0 is the sentinel value
-	sample *sample_by_index(std::size_t idx) const {
-		return reinterpret_cast<sample*>(storage_ + idx * sample_size_);
-	}
+	/// how often new_sample() retries pop_freelist() during a reclaim before adding a slab
+	static constexpr int max_pop_retries = 16;
 
-	/// Return the address of the sentinel value
-	sample *sentinel() const {
-		return sample_by_index(0);
-	}
+	/// Push a sample to the freelist
+	void push_freelist(sample *s);
+
+	/// Allocate a slab of `num_samples` samples and add them to the freelist.
+	void add_slab(uint32_t num_samples);
 
 	friend class sample;
 	/// the channel format to construct samples with
@@ -75,20 +131,33 @@ private:
 	const uint32_t num_chans_;
 	/// size of a sample, in bytes
 	const uint32_t sample_size_;
-	/// size of the allocated storage, in bytes
-	const uint32_t storage_size_;
-	/// a slab of storage for pre-allocated samples
-	char *const storage_;
+	/// number of samples in slabs added once all samples are in use
+	const uint32_t slab_samples_;
+	/// whether slabs are placed on the NUMA node of the allocating thread
+	const bool numa_local_;
+	/// number of samples in a deferred first slab (numa_local_ only)
+	uint32_t deferred_reserve_;
+	/// the slabs of pooled samples, only accessed by the thread calling new_sample()
+	std::vector<slab> slabs_;
+	/// the sentinel value of the freelist
+	sample *const sentinel_;
 	/// head of the freelist
 	std::atomic<sample *> head_;
 	/// tail of the freelist
 	std::atomic<sample *> tail_;
+	/// statistics, see factory_stats
+	std::atomic<uint32_t> num_slabs_{0}, capacity_{0}, in_use_{0}, high_water_mark_{0},
+		reclaim_slabs_{0};
 };
 
 /**
  * The sample data type.
  * Used to represent samples across the library's various buffers and can be serialized (e.g., over
  * the network).
+ *
+ * The values of string samples are stored back to back in one heap region per sample, which is
+ * kept when the sample is recycled by its factory, so string samples of a similar size don't need
+ * any allocations once the region has grown large enough.
  */
 class sample {
 public:
@@ -101,14 +170,25 @@ private:
 	const lsl_channel_format_t format_;
 	/// number of channels
 	const uint32_t num_channels_;
+	/// number of samples (>1 for chunks)
+	const uint32_t num_samples_;
 	/// reference count used by sample_p
 	std::atomic<int> refcount_;
 	/// linked list of samples, for use in a freelist
 	std::atomic<sample *> next_;
 	/// the factory used to reclaim this sample
 	factory *const factory_;
+	/// the contents of all string values (cft_string only)
+	char *strings_{nullptr};
+	/// allocated size of strings_
+	std::size_t strings_capacity_{0};
+	/// serializations of this sample created so far (see serialized())
+	struct serialization;
+	mutable std::atomic<serialization *> serialized_{nullptr};
 	/// time-stamp of the sample
 	double timestamp_{0.0};
+	/// sequence number of the (first) sample, counted by the outlet's send buffer
+	uint64_t seq_{0};
 	/// the data payload begins here
 	alignas(8) int32_t data_{0};
 
@@ -120,6 +200,14 @@ public:
 
 	double &timestamp() { return timestamp_; }
 
+	/// Sequence number of the sample; the samples of a chunk have consecutive numbers
+	uint64_t &seq() { return seq_; }
+	uint64_t seq() const { return seq_; }
+
+	/// Timestamps of all samples, i.e. a pointer to timestamp() unless this is a chunk
+	double *timestamps() noexcept;
+	const double *timestamps() const noexcept { return const_cast<sample *>(this)->timestamps(); }
+
 	/// Delete a sample.
 	void operator delete(void *x) noexcept;
 
@@ -131,12 +219,22 @@ public:
 
 	uint32_t num_channels() const { return num_channels_; }
 
+	lsl_channel_format_t format() const { return format_; }
+
+	/// Number of samples in this object (>1 for chunks created by factory::new_chunk())
+	uint32_t num_samples() const { return num_samples_; }
+
+	/// Total number of channel values, i.e. num_channels() * num_samples()
+	std::size_t num_values() const {
+		return static_cast<std::size_t>(num_channels_) * num_samples_;
+	}
+
 	// === type-safe accessors ===
 
-	/// Assign an array of numeric values (with type conversions).
+	/// Assign an array of numeric values (with type conversions), num_values() in total.
 	template <class T> void assign_typed(const T *s);
 
-	/// Retrieve an array of numeric values (with type conversions).
+	/// Retrieve an array of numeric values (with type conversions), num_values() in total.
 	template <class T> void retrieve_typed(T *d);
 
 	// === untyped accessors ===
@@ -147,9 +245,42 @@ public:
 	/// Retrieve numeric data from the sample.
 	void retrieve_untyped(void *newdata);
 
+	/// Pointer to the raw channel data of the `k`th sample.
+	const void *raw_data(uint32_t k = 0) const {
+		return reinterpret_cast<const char *>(&data_) + k * datasize();
+	}
+
 	// === serialization functions ===
 
-	/// Serialize a sample to a stream buffer (protocol 1.10).
+	/**
+	 * Get the protocol 1.10 serialization of this sample (or all samples of a chunk).
+	 *
+	 * The first caller for a byte order serializes the sample, all later callers get the same
+	 * bytes, so a sample sent to many inlets is only serialized once. The bytes remain valid as
+	 * long as the sample is referenced. Can be called from any thread.
+	 */
+	const std::vector<char> &serialized(bool reverse_byte_order) const;
+
+	/// Delete all serializations, e.g. before the sample is reused.
+	void clear_serialized() noexcept;
+
+	/// Maximum size of a sample header as written by save_header_raw().
+	static constexpr std::size_t max_header_bytes = 1 + sizeof(double);
+
+	/**
+	 * Write the protocol 1.10 header (tag and, if needed, timestamp) of the `k`th sample in
+	 * native byte order to `dst`, which must hold at least max_header_bytes.
+	 * @return The number of bytes written.
+	 */
+	std::size_t save_header_raw(char *dst, uint32_t k = 0) const;
+
+	/// Write a gap marker for `missing` samples (see TAG_GAP) to `dst`.
+	static void save_gap_marker(char *dst, uint32_t missing, bool reverse_byte_order);
+
+	/// Read the number of missing samples from the gap marker at `src`.
+	static uint32_t load_gap_marker(const char *src, bool reverse_byte_order);
+
+	/// Serialize a sample (or all samples of a chunk) to a stream buffer (protocol 1.10).
 	void save_streambuf(std::streambuf &sb, int protocol_version, bool reverse_byte_order,
 		void *scratchpad = nullptr) const;
 
@@ -157,24 +288,49 @@ public:
 	void load_streambuf(std::streambuf &sb, int protocol_version, bool reverse_byte_order,
 		bool suppress_subnormals);
 
+	/**
+	 * Deserialize a numeric sample (protocol 1.10) from a memory buffer.
+	 * @return The number of bytes read, or 0 if `buf` doesn't hold a complete sample.
+	 */
+	std::size_t load_buffer(
+		const char *buf, std::size_t len, bool reverse_byte_order, bool suppress_subnormals);
+
+	/**
+	 * Serialize an integer sample (or all samples of a chunk) with delta-encoded values.
+	 *
+	 * This is the protocol 1.10 format negotiated with `Value-Encoding: delta`: the header is
+	 * unchanged, but each channel value is sent as the zig-zag LEB128 varint of its difference to
+	 * the same channel's value in the previous sample, so slowly varying signals need only one or
+	 * two bytes per value.
+	 * @param previous The values of the previous sample, one per channel (initially 0). They're
+	 * updated to the values of this sample.
+	 */
+	void save_streambuf_delta(
+		std::streambuf &sb, bool reverse_byte_order, int64_t *previous) const;
+
+	/// Deserialize a sample serialized by save_streambuf_delta().
+	void load_streambuf_delta(std::streambuf &sb, bool reverse_byte_order, int64_t *previous);
+
 	/// Convert the endianness of channel data in-place.
 	static void convert_endian(void *data, uint32_t n, uint32_t width);
 
-	/// Serialize a sample into a portable archive (protocol 1.00).
+	/// Serialize a sample (or all samples of a chunk) into a portable archive (protocol 1.00).
 	void serialize(eos::portable_oarchive &ar, uint32_t archive_version) const;
 
 	/// Deserialize a sample from a portable archive (protocol 1.00).
 	void serialize(eos::portable_iarchive &ar, uint32_t archive_version);
 
-	/// Serialize (read/write) the channel data.
-	template <class Archive> void serialize_channels(Archive &ar, uint32_t archive_version);
+	/// Serialize (read/write) the channel data of the `k`th sample.
+	template <class Archive>
+	void serialize_channels(Archive &ar, uint32_t archive_version, uint32_t k = 0);
 
 	/// Assign a test pattern to the sample (for protocol validation)
 	sample &assign_test_pattern(int offset = 1);
 
 private:
-	/// Construct a new sample for a given channel format/count combination.
-	sample(lsl_channel_format_t fmt, uint32_t num_channels, factory *fact);
+	/// Construct a new sample (or chunk) for a given channel format/count combination.
+	sample(lsl_channel_format_t fmt, uint32_t num_channels, factory *fact,
+		uint32_t num_samples = 1);
 
 	/// Increment ref count.
 	friend void intrusive_ptr_add_ref(sample *s) {
@@ -185,7 +341,10 @@ private:
 	friend void intrusive_ptr_release(sample *s) {
 		if (s->refcount_.fetch_sub(1, std::memory_order_release) == 1) {
 			std::atomic_thread_fence(std::memory_order_acquire);
-			s->factory_->reclaim_sample(s);
+			if (s->num_samples_ > 1)
+				delete s;
+			else
+				s->factory_->reclaim_sample(s);
 		}
 	}
 
@@ -194,6 +353,32 @@ private:
 		return reinterpret_cast<const void *>(&s.data_);
 	}
 
+	/// Serialize the `k`th sample to a stream buffer (protocol 1.10).
+	void save_streambuf_sample(
+		std::streambuf &sb, uint32_t k, bool reverse_byte_order, void *scratchpad) const;
+
+	/// Flush subnormal floating point values to zero.
+	void zero_subnormals() noexcept;
+
+	/**
+	 * Make room for `len` more bytes of string contents after the first `used` bytes.
+	 * @return A pointer to the space for the new contents.
+	 */
+	char *string_space(std::size_t used, std::size_t len);
+
+	/// Store the `i`th string value; all values before it have to be assigned already.
+	void assign_string(std::size_t i, const char *str, std::size_t len);
+
+	/// Assign all string values, converting them from `src`.
+	template <typename U> void strings_from(const U *src);
+
+	/// Retrieve all string values, converting them into `dst`.
+	template <typename U> void strings_into(U *dst) const;
+
+	/// Serialize the string values of the `k`th sample (protocol 1.00).
+	void serialize_strings(eos::portable_oarchive &ar, uint32_t k) const;
+	void serialize_strings(eos::portable_iarchive &ar, uint32_t k);
+
 	template <typename T, typename U> void conv_from(const U *src);
 	template <typename T, typename U> void conv_into(U *dst);
 };
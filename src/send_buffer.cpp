@@ -1,15 +1,47 @@
 #include "send_buffer.h"
 #include "consumer_queue.h"
+#include "sample.h"
 #include <algorithm>
+#include <cassert>
 #include <chrono>
+#include <iterator>
 #include <loguru.hpp>
 #include <memory>
+#include <thread>
 
 using namespace lsl;
 
-std::shared_ptr<consumer_queue> send_buffer::new_consumer(int max_buffered) {
+send_buffer::send_buffer(int max_capacity)
+	: max_capacity_(max_capacity), metrics_(std::make_shared<outlet_metrics>()),
+	  consumers_(new consumer_set()) {
+	readers_[0] = 0;
+	readers_[1] = 0;
+}
+
+send_buffer::~send_buffer() { delete consumers_.load(); }
+
+std::shared_ptr<consumer_queue> send_buffer::new_consumer(
+	int max_buffered, std::function<void()> on_ready) {
 	max_buffered = max_buffered ? std::min(max_buffered, max_capacity_) : max_capacity_;
-	return std::make_shared<consumer_queue>(max_buffered, shared_from_this());
+	return std::make_shared<consumer_queue>(
+		max_buffered, shared_from_this(), std::move(on_ready));
+}
+
+/// number of read_guards held by the current thread, see publish()
+static thread_local int guards_held = 0;
+
+send_buffer::read_guard::read_guard(send_buffer &buf) noexcept
+	: buf_(buf), slot_(buf.epoch_.load() & 1) {
+	++guards_held;
+	buf_.readers_[slot_].fetch_add(1);
+	// loaded only after announcing the reader, so publish() either waits for this reader or the
+	// reader sees the new set
+	consumers_ = buf_.consumers_.load();
+}
+
+send_buffer::read_guard::~read_guard() noexcept {
+	buf_.readers_[slot_].fetch_sub(1);
+	--guards_held;
 }
 
 
@@ -18,19 +50,42 @@ std::shared_ptr<consumer_queue> send_buffer::new_consumer(int max_buffered) {
  * Will subsequently be seen by all consumers.
  */
 void send_buffer::push_sample(const sample_p &s) {
-	std::lock_guard<std::mutex> lock(consumers_mut_);
-	for (auto &consumer : consumers_) consumer->push_sample(s);
+	if (s) s->seq() = next_seq_.fetch_add(s->num_samples(), std::memory_order_relaxed);
+	read_guard guard(*this);
+	for (auto *consumer : guard.consumers()) consumer->push_sample(s);
 }
 
+void send_buffer::push_control_sample(const sample_p &s) {
+	if (s) s->seq() = consumer_queue::no_seq;
+	read_guard guard(*this);
+	for (auto *consumer : guard.consumers()) consumer->push_sample(s);
+}
+
+void send_buffer::publish(const consumer_set *next) {
+	// waiting for our own read_guard would never finish
+	assert(guards_held == 0);
+	const consumer_set *prev = consumers_.exchange(next);
+	// Two grace periods: a reader might have picked its slot before the first flip, but
+	// announced itself only after the writer checked that slot. The second pass covers it.
+	for (int pass = 0; pass < 2; ++pass) {
+		uint32_t slot = epoch_.fetch_add(1) & 1;
+		while (readers_[slot].load() != 0) std::this_thread::yield();
+	}
+	delete prev;
+}
 
 /// Registered a new consumer.
 void send_buffer::register_consumer(consumer_queue *q) {
 	{
 		std::lock_guard<std::mutex> lock(consumers_mut_);
-		if (std::find(consumers_.begin(), consumers_.end(), q) != consumers_.end())
+		const consumer_set &current = *consumers_.load();
+		if (std::find(current.begin(), current.end(), q) != current.end()) {
 			LOG_F(WARNING, "Duplicate consumer queue in send buffer");
-		else
-			consumers_.push_back(q);
+			return;
+		}
+		auto *next = new consumer_set(current);
+		next->push_back(q);
+		publish(next);
 	}
 	some_registered_.notify_all();
 }
@@ -38,19 +93,31 @@ void send_buffer::register_consumer(consumer_queue *q) {
 /// Unregister a previously registered consumer.
 void send_buffer::unregister_consumer(consumer_queue *q) {
 	std::lock_guard<std::mutex> lock(consumers_mut_);
-	auto pos = std::find(consumers_.begin(), consumers_.end(), q);
-	if (pos == consumers_.end()) LOG_F(ERROR, "Trying to remove consumer queue not in send buffer");
-
-	// Put the element to be removed at the end (if it isn't there already) and
-	// remove the last element
-	if (*pos != consumers_.back()) std::swap(*pos, consumers_.back());
-	consumers_.pop_back();
+	const consumer_set &current = *consumers_.load();
+	auto pos = std::find(current.begin(), current.end(), q);
+	if (pos == current.end()) {
+		LOG_F(ERROR, "Trying to remove consumer queue not in send buffer");
+		return;
+	}
+	auto *next = new consumer_set();
+	next->reserve(current.size() - 1);
+	std::copy(current.begin(), pos, std::back_inserter(*next));
+	std::copy(pos + 1, current.end(), std::back_inserter(*next));
+	// once publish() returns, no producer is pushing to q anymore
+	publish(next);
 }
 
 /// Check whether there currently are consumers.
 bool send_buffer::have_consumers() {
-	std::lock_guard<std::mutex> lock(consumers_mut_);
-	return some_registered();
+	read_guard guard(*this);
+	return !guard.consumers().empty();
+}
+
+std::size_t send_buffer::samples_queued() {
+	read_guard guard(*this);
+	std::size_t n = 0;
+	for (const auto *consumer : guard.consumers()) n += consumer->read_available();
+	return n;
 }
 
 /// Wait until some consumers are present.
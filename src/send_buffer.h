@@ -3,7 +3,11 @@
 
 #include "common.h"
 #include "forward.h"
+#include "metrics.h"
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -11,7 +15,7 @@
 namespace lsl {
 
 /**
- * A thread-safe single-producer multiple-consumer queue where each consumer gets every pushed
+ * A thread-safe multiple-producer multiple-consumer queue where each consumer gets every pushed
  * sample. If the bounded capacity is exhausted, the oldest samples will be erased.
  *
  * @note The send_buffer is actually just a dispatcher that distributes the data to
@@ -28,7 +32,9 @@ public:
 	 * @param max_capacity Hard upper bound on queue capacity beyond which the oldest samples will
 	 * be dropped.
 	 */
-	send_buffer(int max_capacity) : max_capacity_(max_capacity) {}
+	send_buffer(int max_capacity);
+
+	~send_buffer();
 
 	/**
 	 * Add a new consumer queue to the buffer.
@@ -38,35 +44,100 @@ public:
 	 * @param max_buffered If non-zero, the queue size for this consumer will be constrained to be
 	 * no larger than this value. Note that the actual queue size will never exceed the max_capacity
 	 * of the send_buffer (so this is a global limit).
+	 * @param on_ready Optional readiness notification, see consumer_queue::consumer_queue().
 	 * @return Shared pointer to the newly created consumer.
 	 */
-	std::shared_ptr<consumer_queue> new_consumer(int max_buffered = 0);
+	std::shared_ptr<consumer_queue> new_consumer(
+		int max_buffered = 0, std::function<void()> on_ready = nullptr);
 
-	/// Push a sample onto the send buffer that will subsequently be received by all consumers.
+	/**
+	 * Push a sample onto the send buffer that will subsequently be received by all consumers.
+	 *
+	 * Chunks (see factory::new_chunk()) are distributed as one unit, i.e. they occupy one slot in
+	 * each consumer queue, but count with all their samples against its capacity.
+	 * The samples are numbered consecutively (see sample::seq()), so the sessions can tell the
+	 * inlets how many samples their queues dropped.
+	 * This doesn't acquire any lock, so consumers connecting or disconnecting don't delay it.
+	 * It can be called by multiple threads at once, in which case the samples can reach the
+	 * consumer queues out of sequence order.
+	 */
 	void push_sample(const sample_p &s);
 
+	/**
+	 * Push a control sample (e.g. the end-of-transfer marker) to all consumers.
+	 *
+	 * Unlike push_sample(), the sample doesn't get a sequence number, so it doesn't count as a
+	 * sample dropped by the consumers that don't see it.
+	 */
+	void push_control_sample(const sample_p &s);
+
 	/// Wait until some consumers are present.
 	bool wait_for_consumers(double timeout = FOREVER);
 
 	/// Check whether any consumer is currently registered.
 	bool have_consumers();
 
+	/// Number of samples pushed so far.
+	uint64_t samples_pushed() const { return next_seq_.load(std::memory_order_relaxed); }
+
+	/// Number of samples (or chunks) currently waiting in the consumer queues, summed over all.
+	std::size_t samples_queued();
+
+	/// The outlet's metrics, updated by the consumer queues and the sessions.
+	const std::shared_ptr<outlet_metrics> &metrics() const { return metrics_; }
+
 private:
 	friend class consumer_queue;
 
-	/// Registered a new consumer (called by the consumer_queue).
+	/**
+	 * Keeps the current consumer set alive while it's being read.
+	 *
+	 * The consumer set is immutable and replaced as a whole when a consumer registers or
+	 * unregisters (read-copy-update). Readers announce themselves in one of two counters selected
+	 * by the current epoch, so the writer can wait for a grace period before freeing the old set.
+	 */
+	class read_guard {
+	public:
+		explicit read_guard(send_buffer &buf) noexcept;
+		~read_guard() noexcept;
+		const consumer_set &consumers() const noexcept { return *consumers_; }
+
+	private:
+		send_buffer &buf_;
+		uint32_t slot_;
+		const consumer_set *consumers_;
+	};
+
+	/**
+	 * Register a new consumer (called by the consumer_queue).
+	 *
+	 * Like unregister_consumer(), this waits for all readers of the consumer set, so it must not
+	 * be called while the calling thread reads it, e.g. from a consumer's on_ready function.
+	 */
 	void register_consumer(consumer_queue *q);
 	/// Unregister a previously registered consumer (called by the consumer_queue).
 	void unregister_consumer(consumer_queue *q);
 
+	/// Replace the consumer set and free the old one once no reader uses it anymore.
+	/// The caller has to hold consumers_mut_ and must not hold a read_guard.
+	void publish(const consumer_set *next);
+
 	/// wait_for_consumers is waiting for this
-	bool some_registered() const { return !consumers_.empty(); }
+	bool some_registered() const { return !consumers_.load()->empty(); }
 
 	/// maximum capacity beyond which the oldest samples will be dropped
 	int max_capacity_;
-	/// a set of registered consumer queues
-	consumer_set consumers_;
-	/// mutex to protect the integrity of consumers_
+	/// the outlet's metrics
+	std::shared_ptr<outlet_metrics> metrics_;
+	/// sequence number of the next pushed sample
+	std::atomic<uint64_t> next_seq_{0};
+	/// the current (immutable) set of registered consumer queues
+	std::atomic<const consumer_set *> consumers_;
+	/// grace period counter, its lowest bit selects the reader counter for new readers
+	std::atomic<uint32_t> epoch_{0};
+	/// number of readers in each of the two epoch slots
+	std::atomic<int32_t> readers_[2];
+	/// mutex to serialize modifications of consumers_ and for waiting on consumers
 	std::mutex consumers_mut_;
 	/// condition variable signaling that a consumer has registered
 	std::condition_variable some_registered_;
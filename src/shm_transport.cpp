@@ -0,0 +1,446 @@
+#include "shm_transport.h"
+#include "common.h"
+#include "consumer_queue.h"
+#include "sample.h"
+#include "send_buffer.h"
+#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <loguru.hpp>
+#include <new>
+#include <stdexcept>
+#include <streambuf>
+
+#ifdef LSL_SHM_TRANSPORT
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace lsl;
+
+#ifdef LSL_SHM_TRANSPORT
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory atomics must be lock-free");
+
+/// marks the unused space at the end of the record area, the next record starts at its beginning
+const uint32_t PADDING_RECORD = 0xFFFFFFFF;
+const uint32_t RING_MAGIC = 0x4C534C52; // "LSLR"
+const uint32_t RING_VERSION = 2;
+/// readers consider the writer gone once its heartbeat is older than this
+const int64_t WRITER_TIMEOUT_NS = 5000000000;
+
+/// Layout of the first page of the file, the only part that readers map writable
+struct shm_ring::wait_area {
+	/// futex word, incremented to wake up waiting readers
+	std::atomic<uint32_t> wake_seq;
+	/// number of readers waiting for records
+	std::atomic<uint32_t> waiters;
+};
+
+/// Layout of the start of the ring, followed by the record area
+struct shm_ring::header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+	/// the writer's last sign of life, in nanoseconds of CLOCK_MONOTONIC (which, unlike process
+	/// ids, is the same for all processes on the host)
+	std::atomic<uint64_t> heartbeat;
+	/// set once the writer closed the ring
+	std::atomic<uint32_t> closed;
+	/// end of the record the writer is currently writing (or has last written)
+	alignas(CACHELINE_BYTES) std::atomic<uint64_t> reserve_pos;
+	/// end of the last published record
+	std::atomic<uint64_t> write_pos;
+	/// start of the oldest record that hasn't been overwritten
+	std::atomic<uint64_t> tail_pos;
+};
+
+/// Size reserved for the header
+const std::size_t HEADER_BYTES = 2 * CACHELINE_BYTES;
+
+/// Size of the wait area; the ring starts at the next page, so it can be mapped separately
+static std::size_t wait_area_bytes() { return static_cast<std::size_t>(sysconf(_SC_PAGESIZE)); }
+
+static uint64_t monotonic_ns() {
+	struct timespec ts {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/// Records are stored with a 4 byte length prefix, aligned to 8 bytes
+static uint64_t record_size(std::size_t len) { return (sizeof(uint32_t) + len + 7) & ~uint64_t(7); }
+
+shm_ring::shm_ring(const std::string &path, std::size_t capacity, bool exclusive)
+	: path_(path), writer_(true) {
+	static_assert(sizeof(header) <= HEADER_BYTES, "header doesn't fit");
+	capacity_ = 4096;
+	while (capacity_ < capacity) capacity_ *= 2;
+	const std::size_t size = wait_area_bytes() + HEADER_BYTES + capacity_;
+
+	const int fd = ::open(
+		path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (exclusive ? O_EXCL : O_TRUNC), 0600);
+	if (fd < 0) throw std::runtime_error("Couldn't create " + path_ + ": " + strerror(errno));
+	// reserve the memory now, so a full /dev/shm fails here instead of raising SIGBUS later
+	if (int err = posix_fallocate(fd, 0, static_cast<off_t>(size))) {
+		::close(fd);
+		unlink(path_.c_str());
+		throw std::runtime_error("Couldn't allocate " + path_ + ": " + strerror(err));
+	}
+	try {
+		map(fd, size);
+	} catch (std::exception &) {
+		unlink(path_.c_str());
+		throw;
+	}
+	new (wait_) wait_area();
+	hdr_ = new (mem_) header();
+	hdr_->capacity = capacity_;
+	hdr_->heartbeat.store(monotonic_ns(), std::memory_order_relaxed);
+	hdr_->version = RING_VERSION;
+	// the magic value tells readers that the header is initialized
+	std::atomic_thread_fence(std::memory_order_release);
+	hdr_->magic = RING_MAGIC;
+}
+
+shm_ring::shm_ring(const std::string &path) : path_(path), writer_(false) {
+	const int fd = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+	if (fd < 0) throw std::runtime_error("Couldn't open " + path_ + ": " + strerror(errno));
+	struct stat st {};
+	if (fstat(fd, &st) != 0 ||
+		static_cast<std::size_t>(st.st_size) < wait_area_bytes() + HEADER_BYTES) {
+		::close(fd);
+		throw std::runtime_error(path_ + " is not a sample ring");
+	}
+	map(fd, static_cast<std::size_t>(st.st_size));
+	hdr_ = static_cast<header *>(mem_);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (hdr_->magic != RING_MAGIC || hdr_->version != RING_VERSION ||
+		hdr_->capacity != mem_size_ - HEADER_BYTES) {
+		munmap(mem_, mem_size_);
+		munmap(wait_, wait_area_bytes());
+		throw std::runtime_error(path_ + " is not a compatible sample ring");
+	}
+	capacity_ = hdr_->capacity;
+}
+
+void shm_ring::map(int fd, std::size_t size) {
+	const std::size_t offset = wait_area_bytes();
+	void *wait = mmap(nullptr, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	// readers can't modify the ring, so a misbehaving one can't garble it for the others
+	void *ring = wait == MAP_FAILED ? MAP_FAILED
+									: mmap(nullptr, size - offset,
+										  writer_ ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+										  fd, static_cast<off_t>(offset));
+	const int err = errno;
+	::close(fd);
+	if (ring == MAP_FAILED) {
+		if (wait != MAP_FAILED) munmap(wait, offset);
+		throw std::runtime_error("Couldn't map " + path_ + ": " + strerror(err));
+	}
+	wait_ = static_cast<wait_area *>(wait);
+	mem_ = ring;
+	mem_size_ = size - offset;
+	data_ = static_cast<char *>(mem_) + HEADER_BYTES;
+}
+
+shm_ring::~shm_ring() {
+	if (writer_) {
+		close();
+		// readers that have it mapped already keep their mapping
+		unlink(path_.c_str());
+	}
+	munmap(mem_, mem_size_);
+	munmap(wait_, wait_area_bytes());
+}
+
+std::size_t shm_ring::max_record() const { return capacity_ / 4; }
+
+uint64_t shm_ring::write_pos() const { return hdr_->write_pos.load(std::memory_order_acquire); }
+
+char *shm_ring::append(std::size_t len) {
+	if (len > max_record()) return nullptr;
+	const uint64_t size = record_size(len);
+	uint64_t offset = append_pos_ & (capacity_ - 1);
+	const bool wrap = offset + size > capacity_;
+	const uint64_t end = append_pos_ + (wrap ? capacity_ - offset : 0) + size;
+	// move the tail past the records that will be overwritten
+	while (end - tail_pos_ > capacity_) {
+		const uint64_t tail = tail_pos_ & (capacity_ - 1);
+		uint32_t tail_len;
+		memcpy(&tail_len, data_ + tail, sizeof(tail_len));
+		tail_pos_ += tail_len == PADDING_RECORD ? capacity_ - tail : record_size(tail_len);
+	}
+	hdr_->tail_pos.store(tail_pos_, std::memory_order_relaxed);
+	// announce the overwritten range before overwriting it, see advance()
+	hdr_->reserve_pos.store(end, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (wrap) {
+		memcpy(data_ + offset, &PADDING_RECORD, sizeof(PADDING_RECORD));
+		offset = 0;
+	}
+	const auto len32 = static_cast<uint32_t>(len);
+	memcpy(data_ + offset, &len32, sizeof(len32));
+	append_pos_ = end;
+	return data_ + offset + sizeof(len32);
+}
+
+void shm_ring::publish() {
+	hdr_->write_pos.store(append_pos_, std::memory_order_release);
+	beat();
+	// pairs with the fence in wait(): either the reader sees the new records or we see the reader
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (wait_->waiters.load(std::memory_order_relaxed)) {
+		wait_->wake_seq.fetch_add(1, std::memory_order_release);
+		syscall(SYS_futex, &wait_->wake_seq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+	}
+}
+
+void shm_ring::beat() { hdr_->heartbeat.store(monotonic_ns(), std::memory_order_relaxed); }
+
+void shm_ring::close() {
+	hdr_->closed.store(1, std::memory_order_release);
+	wait_->wake_seq.fetch_add(1, std::memory_order_release);
+	syscall(SYS_futex, &wait_->wake_seq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+shm_ring::cursor shm_ring::make_cursor(uint64_t pos) const {
+	const uint64_t end = write_pos();
+	return {pos > end || end - pos > capacity_ ? end : pos};
+}
+
+shm_ring::cursor shm_ring::oldest() const {
+	return make_cursor(hdr_->tail_pos.load(std::memory_order_relaxed));
+}
+
+const char *shm_ring::next(cursor &c, std::size_t &len) const {
+	for (;;) {
+		const uint64_t end = write_pos();
+		if (c.pos == end) return nullptr;
+		if (end - c.pos > capacity_) {
+			// the writer lapped us
+			c.lost++;
+			c.pos = end;
+			return nullptr;
+		}
+		const uint64_t offset = c.pos & (capacity_ - 1);
+		uint32_t len32;
+		memcpy(&len32, data_ + offset, sizeof(len32));
+		if (len32 == PADDING_RECORD) {
+			c.pos += capacity_ - offset;
+			continue;
+		}
+		// a garbled length means the record was overwritten while we read it
+		if (len32 > max_record() || offset + record_size(len32) > capacity_) {
+			c.lost++;
+			c.pos = write_pos();
+			return nullptr;
+		}
+		len = len32;
+		return data_ + offset + sizeof(len32);
+	}
+}
+
+bool shm_ring::advance(cursor &c, std::size_t len) const {
+	// the record is intact unless the writer announced writing past its end, minus one lap
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (hdr_->reserve_pos.load(std::memory_order_relaxed) - c.pos > capacity_) {
+		c.lost++;
+		c.pos = write_pos();
+		return false;
+	}
+	c.pos += record_size(len);
+	return true;
+}
+
+void shm_ring::wait(const cursor &c, double timeout) const {
+	const uint32_t seq = wait_->wake_seq.load(std::memory_order_acquire);
+	wait_->waiters.fetch_add(1, std::memory_order_relaxed);
+	// pairs with the fence in publish()
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (write_pos() == c.pos && !hdr_->closed.load(std::memory_order_acquire)) {
+		struct timespec ts {};
+		ts.tv_sec = static_cast<time_t>(timeout);
+		ts.tv_nsec = static_cast<long>((timeout - static_cast<double>(ts.tv_sec)) * 1e9);
+		syscall(SYS_futex, &wait_->wake_seq, FUTEX_WAIT, seq, &ts, nullptr, 0);
+	}
+	wait_->waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool shm_ring::closed() const {
+	if (hdr_->closed.load(std::memory_order_acquire)) return true;
+	// a writer that exited without closing the ring (or hangs) doesn't renew its heartbeat
+	const auto heartbeat = static_cast<int64_t>(hdr_->heartbeat.load(std::memory_order_relaxed));
+	return static_cast<int64_t>(monotonic_ns()) - heartbeat > WRITER_TIMEOUT_NS;
+}
+
+#else
+
+shm_ring::shm_ring(const std::string &path, std::size_t /*capacity*/, bool /*exclusive*/)
+	: path_(path), writer_(true) {
+	throw std::runtime_error("Shared memory transport not supported on this platform");
+}
+
+shm_ring::shm_ring(const std::string &path) : path_(path), writer_(false) {
+	throw std::runtime_error("Shared memory transport not supported on this platform");
+}
+
+shm_ring::~shm_ring() = default;
+std::size_t shm_ring::max_record() const { return 0; }
+uint64_t shm_ring::write_pos() const { return 0; }
+char *shm_ring::append(std::size_t /*len*/) { return nullptr; }
+void shm_ring::publish() {}
+void shm_ring::beat() {}
+void shm_ring::close() {}
+shm_ring::cursor shm_ring::make_cursor(uint64_t pos) const { return {pos}; }
+shm_ring::cursor shm_ring::oldest() const { return {0}; }
+const char *shm_ring::next(cursor & /*c*/, std::size_t & /*len*/) const { return nullptr; }
+bool shm_ring::advance(cursor & /*c*/, std::size_t /*len*/) const { return false; }
+void shm_ring::wait(const cursor & /*c*/, double /*timeout*/) const {}
+bool shm_ring::closed() const { return true; }
+
+#endif
+
+/// How often an idle publisher renews the ring's heartbeat, well within WRITER_TIMEOUT_NS
+const auto HEARTBEAT_INTERVAL = std::chrono::milliseconds(500);
+
+/// A stream buffer reading from a memory range
+class memory_streambuf : public std::streambuf {
+public:
+	memory_streambuf(char *begin, std::size_t len) { setg(begin, begin, begin + len); }
+};
+
+shm_publisher::shm_publisher(
+	const std::string &path, std::size_t capacity, const send_buffer_p &sendbuf, bool exclusive)
+	: ring_(path, capacity, exclusive) {
+	queue_ = sendbuf->new_consumer(0, [this]() { drain(); });
+	drain();
+	heartbeat_ = std::thread([this]() {
+		loguru::set_thread_name("shm_heartbeat");
+		std::unique_lock<std::mutex> lock(heartbeat_mut_);
+		while (!heartbeat_cv_.wait_for(lock, HEARTBEAT_INTERVAL, [this]() { return stopping_; }))
+			ring_.beat();
+	});
+}
+
+shm_publisher::~shm_publisher() {
+	{
+		std::lock_guard<std::mutex> lock(heartbeat_mut_);
+		stopping_ = true;
+	}
+	heartbeat_cv_.notify_all();
+	heartbeat_.join();
+}
+
+void shm_publisher::drain() {
+	do {
+		sample_p batch[64];
+		std::size_t n;
+		while ((n = queue_->pop_samples(batch, sizeof(batch) / sizeof(batch[0]))) != 0) {
+			for (std::size_t k = 0; k < n; ++k) {
+				if (!batch[k]) continue;
+				// a special timestamp indicates end_serving()
+				if (batch[k]->timestamp() == END_OF_TRANSFER_TIMESTAMP) {
+					ring_.publish();
+					return ring_.close();
+				}
+				LSL_TRACE_POINT(dequeue, batch[k]->timestamp());
+				append(*batch[k]);
+				batch[k] = sample_p();
+			}
+			LSL_TRACE_POINT(written, 0.0);
+			ring_.publish();
+		}
+		// the queue is drained: the next push calls us again, unless samples arrived meanwhile
+	} while (!queue_->request_ready_callback());
+}
+
+void shm_publisher::append(const sample &s) {
+	next_seq_ += gaps_.missing_before(s, queue_.get());
+	const uint64_t seq = next_seq_;
+	next_seq_ += s.num_samples();
+	if (s.format() != cft_string) {
+		// numeric samples: one record per sample, written straight into the ring
+		for (uint32_t k = 0; k < s.num_samples(); ++k) {
+			char header[sample::max_header_bytes];
+			const std::size_t header_len = s.save_header_raw(header, k);
+			char *dst = ring_.append(sizeof(seq) + header_len + s.datasize());
+			if (!dst) {
+				LOG_F(WARNING, "Sample too large for %s, dropped", ring_.path().c_str());
+				return;
+			}
+			const uint64_t sample_seq = seq + k;
+			memcpy(dst, &sample_seq, sizeof(sample_seq));
+			memcpy(dst + sizeof(seq), header, header_len);
+			memcpy(dst + sizeof(seq) + header_len, s.raw_data(k), s.datasize());
+		}
+		return;
+	}
+	// string samples: one record holding the serialization shared with the TCP sessions
+	const std::vector<char> &bytes = s.serialized(false);
+	char *dst = ring_.append(sizeof(seq) + bytes.size());
+	if (!dst) {
+		LOG_F(WARNING, "Sample too large for %s, dropped", ring_.path().c_str());
+		return;
+	}
+	memcpy(dst, &seq, sizeof(seq));
+	memcpy(dst + sizeof(seq), bytes.data(), bytes.size());
+}
+
+shm_subscriber::shm_subscriber(const std::string &path, uint64_t position)
+	: ring_(path), cursor_(ring_.make_cursor(position)) {}
+
+std::size_t shm_subscriber::read(factory &fac, sample_p *out, std::size_t max, double timeout) {
+	std::size_t n = 0, len;
+	const char *rec;
+	while (n < max) {
+		// string samples left over from the previous record
+		if (record_pos_ < record_.size()) {
+			memory_streambuf sb(record_.data() + record_pos_, record_.size() - record_pos_);
+			while (n < max && sb.in_avail() > 0) {
+				out[n] = fac.new_sample(0.0, false);
+				out[n]->load_streambuf(sb, LSL_PROTOCOL_VERSION, false, false);
+				out[n++]->seq() = record_seq_++;
+			}
+			record_pos_ = record_.size() - static_cast<std::size_t>(sb.in_avail());
+			continue;
+		}
+		if (!(rec = ring_.next(cursor_, len))) {
+			if (n) break;
+			if (ring_.closed() && !ring_.next(cursor_, len))
+				throw lost_error("The outlet has stopped publishing.");
+			if (timeout <= 0) break;
+			ring_.wait(cursor_, timeout);
+			timeout = 0;
+			continue;
+		}
+		uint64_t seq;
+		if (len < sizeof(seq)) {
+			ring_.advance(cursor_, len);
+			continue;
+		}
+		memcpy(&seq, rec, sizeof(seq));
+		out[n] = fac.new_sample(0.0, false);
+		if (out[n]->format() != cft_string) {
+			// numeric samples are decoded in place and discarded if the writer overwrote them
+			const std::size_t data_len = len - sizeof(seq);
+			const bool complete =
+				out[n]->load_buffer(rec + sizeof(seq), data_len, false, false) == data_len;
+			out[n]->seq() = seq;
+			if (ring_.advance(cursor_, len) && complete) ++n;
+		} else {
+			// string records are copied first since they're decoded element by element
+			record_.assign(rec + sizeof(seq), rec + len);
+			record_seq_ = seq;
+			record_pos_ = ring_.advance(cursor_, len) ? 0 : record_.size();
+		}
+	}
+	return n;
+}
@@ -0,0 +1,227 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include "consumer_queue.h"
+#include "forward.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// on Linux, inlets on the same host as the outlet can receive samples via shared memory
+#if defined(__linux__) && !defined(LSL_NO_SHM)
+#define LSL_SHM_TRANSPORT
+#endif
+
+namespace lsl {
+
+/**
+ * A ring of variable-size records in a memory-mapped file, written by one outlet and read by any
+ * number of inlets on the same host (or by the outlet's sessions replaying its history).
+ *
+ * Each record holds the sequence number of a sample (or chunk) and its protocol 1.10 serialization
+ * in native byte order.
+ * Readers keep their own position and never slow down the writer; a reader that falls behind by
+ * more than the ring's capacity loses the overwritten records, just like a full consumer_queue
+ * drops the oldest samples.
+ */
+class shm_ring {
+public:
+	/// A reader's position in the ring
+	struct cursor {
+		/// position of the next record
+		uint64_t pos;
+		/// number of records that were overwritten before they could be read
+		uint64_t lost{0};
+	};
+
+	/**
+	 * Create a new ring (writer side).
+	 * @param path The file to map, e.g. in /dev/shm for a ring that's only kept in memory.
+	 * @param capacity The minimum size of the record area, in bytes.
+	 * @param exclusive Fail if the file exists already instead of replacing it.
+	 * @throws std::runtime_error if the file couldn't be created.
+	 */
+	shm_ring(const std::string &path, std::size_t capacity, bool exclusive = true);
+
+	/**
+	 * Open an existing ring (reader side).
+	 * @throws std::runtime_error if the ring doesn't exist or can't be accessed.
+	 */
+	explicit shm_ring(const std::string &path);
+
+	/// Destructor. The writer also closes the ring and removes its file.
+	~shm_ring();
+
+	shm_ring(const shm_ring &) = delete;
+	shm_ring &operator=(const shm_ring &) = delete;
+
+	const std::string &path() const { return path_; }
+
+	/// The largest record the ring accepts, in bytes
+	std::size_t max_record() const;
+
+	/// The position after the last published record
+	uint64_t write_pos() const;
+
+	// === writer ===
+
+	/**
+	 * Append a record of `len` bytes.
+	 * @return The space for the record's contents, or nullptr if it's larger than max_record().
+	 * The record is visible to readers after the next publish() call.
+	 */
+	char *append(std::size_t len);
+
+	/// Make all appended records visible to the readers and wake up waiting readers.
+	void publish();
+
+	/// Renew the heartbeat that tells readers the writer is still around (see closed()).
+	void beat();
+
+	/// Mark the ring as closed, i.e. no more records will follow.
+	void close();
+
+	// === reader ===
+
+	/// Create a cursor at `pos`, or at the write position if `pos` is no longer in the ring.
+	cursor make_cursor(uint64_t pos) const;
+
+	/// Create a cursor at the oldest record that hasn't been overwritten yet.
+	cursor oldest() const;
+
+	/**
+	 * Get the next record at the cursor without moving past it.
+	 * @param[out] len The size of the record.
+	 * @return The record's contents, or nullptr if no record is available.
+	 */
+	const char *next(cursor &c, std::size_t &len) const;
+
+	/**
+	 * Move the cursor past the record returned by next().
+	 * @return false if the record was overwritten while it was read. Its contents have to be
+	 * discarded then and the cursor is moved to the current write position.
+	 */
+	bool advance(cursor &c, std::size_t len) const;
+
+	/// Wait until a record is available at the cursor or the timeout (in seconds) expires.
+	void wait(const cursor &c, double timeout) const;
+
+	/// Whether the writer closed the ring, or hasn't renewed its heartbeat for a few seconds.
+	bool closed() const;
+
+private:
+	struct wait_area;
+	struct header;
+
+	/// Map the wait area and the ring of the file of size `size` referred to by `fd`.
+	void map(int fd, std::size_t size);
+
+	std::string path_;
+	/// whether this is the writer
+	bool writer_;
+	/// the mapped wait area, where readers announce that they're waiting for records
+	wait_area *wait_{nullptr};
+	/// the mapped ring (read-only for readers)
+	void *mem_{nullptr};
+	/// size of the mapped ring
+	std::size_t mem_size_{0};
+	header *hdr_{nullptr};
+	/// the record area
+	char *data_{nullptr};
+	/// size of the record area (a power of two)
+	uint64_t capacity_{0};
+	/// the writer's position after the last appended record
+	uint64_t append_pos_{0};
+	/// the writer's position of the oldest record that hasn't been overwritten
+	uint64_t tail_pos_{0};
+};
+
+/**
+ * Publishes the samples pushed into an outlet's send buffer into a shm_ring.
+ *
+ * The samples are serialized by the pushing thread right away, so neither a transfer thread nor a
+ * socket is involved.
+ */
+class shm_publisher {
+public:
+	/**
+	 * Create the ring and start publishing the samples of the send buffer.
+	 * @param path, capacity, exclusive See shm_ring::shm_ring().
+	 * @throws std::runtime_error if the ring couldn't be created.
+	 */
+	shm_publisher(const std::string &path, std::size_t capacity, const send_buffer_p &sendbuf,
+		bool exclusive = true);
+
+	/// Stop renewing the ring's heartbeat.
+	~shm_publisher();
+
+	const std::string &path() const { return ring_.path(); }
+
+	/// The position readers start at to receive all samples pushed from now on.
+	uint64_t position() const { return ring_.write_pos(); }
+
+private:
+	/// Publish all queued samples; runs on the pushing thread once samples are available.
+	void drain();
+
+	/// Append one sample (or chunk) to the ring.
+	void append(const sample &s);
+
+	shm_ring ring_;
+	/// counts the samples dropped by queue_ before each published sample
+	gap_tracker gaps_;
+	/// sequence number of the next record; the records are numbered in the order they're
+	/// published, so the readers only see holes for dropped samples
+	uint64_t next_seq_{0};
+	/// renews the ring's heartbeat while no samples are pushed, so readers can tell an idle
+	/// outlet from one that's gone
+	std::thread heartbeat_;
+	std::mutex heartbeat_mut_;
+	std::condition_variable heartbeat_cv_;
+	bool stopping_{false};
+	/// the samples to publish; declared last so it's unregistered before anything else goes away
+	std::shared_ptr<class consumer_queue> queue_;
+};
+
+/// Reads the samples published by a shm_publisher.
+class shm_subscriber {
+public:
+	/**
+	 * Open the ring of a publisher.
+	 * @param path The file of the publisher's ring.
+	 * @param position The position to start reading at, as reported by the publisher.
+	 * @throws std::runtime_error if the ring couldn't be opened.
+	 */
+	shm_subscriber(const std::string &path, uint64_t position);
+
+	/// Continue reading at the oldest sample still in the ring.
+	void rewind() { cursor_ = ring_.oldest(); }
+
+	/**
+	 * Read up to `max` samples, with their sequence numbers (see sample::seq()).
+	 * @return The number of samples written to `out`; 0 if none arrived before the timeout.
+	 * @throws lost_error if the publisher has gone away.
+	 */
+	std::size_t read(factory &fac, sample_p *out, std::size_t max, double timeout);
+
+	/// The number of records that were overwritten before they could be read.
+	uint64_t lost() const { return cursor_.lost; }
+
+private:
+	shm_ring ring_;
+	shm_ring::cursor cursor_;
+	/// copy of a string record, decoded after it's been validated
+	std::vector<char> record_;
+	/// the position of the next undecoded sample in record_
+	std::size_t record_pos_{0};
+	/// the sequence number of the next undecoded sample in record_
+	uint64_t record_seq_{0};
+};
+
+} // namespace lsl
+
+#endif
@@ -1,6 +1,8 @@
 #include "socket_utils.h"
 #include "api_config.h"
 #include "common.h"
+#include <cstring>
+#include <ctime>
 
 template <typename Socket, typename Protocol>
 uint16_t bind_port_in_range_(Socket &sock, Protocol protocol) {
@@ -34,3 +36,49 @@ uint16_t lsl::bind_and_listen_to_port_in_range(
 	acc.listen(backlog);
 	return port;
 }
+
+#ifdef LSL_RX_TIMESTAMPS
+static_assert(CMSG_SPACE(sizeof(timespec)) <= lsl::rx_timestamp_control_size,
+	"the control buffer can't hold a time stamp");
+
+bool lsl::enable_rx_timestamps(udp_socket &sock) {
+	int on = 1;
+	return setsockopt(sock.native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+}
+
+double lsl::rx_timestamp(const msghdr &msg, double fallback) {
+	for (const cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		 cmsg = CMSG_NXTHDR(const_cast<msghdr *>(&msg), const_cast<cmsghdr *>(cmsg))) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPNS) continue;
+		timespec stamp, now_real;
+		memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+		// the time stamp is in CLOCK_REALTIME, so it's mapped via the age of the packet
+		clock_gettime(CLOCK_REALTIME, &now_real);
+		const double now = lsl_clock();
+		const int64_t age_ns = (static_cast<int64_t>(now_real.tv_sec) - stamp.tv_sec) * 1000000000 +
+							   (now_real.tv_nsec - stamp.tv_nsec);
+		// a packet from the future or from long ago means the realtime clock was adjusted
+		if (age_ns < 0 || age_ns > 1000000000) return fallback;
+		return now - static_cast<double>(age_ns) / 1e9;
+	}
+	return fallback;
+}
+
+long lsl::receive_timestamped(udp_socket &sock, char *buf, std::size_t len,
+	asio::ip::udp::endpoint &sender, double &rx_time) {
+	char control[rx_timestamp_control_size];
+	iovec iov{buf, len};
+	msghdr msg{};
+	msg.msg_name = sender.data();
+	msg.msg_namelen = static_cast<socklen_t>(sender.capacity());
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	const auto received = recvmsg(sock.native_handle(), &msg, MSG_DONTWAIT);
+	if (received < 0) return -1;
+	sender.resize(msg.msg_namelen);
+	rx_time = rx_timestamp(msg, lsl_clock());
+	return static_cast<long>(received);
+}
+#endif
@@ -4,6 +4,12 @@
 #include <asio/ip/tcp.hpp>
 #include <asio/ip/udp.hpp>
 
+// on Linux, the kernel can tell when a packet was received (used for time probes)
+#if defined(__linux__)
+#define LSL_RX_TIMESTAMPS
+#include <sys/socket.h>
+#endif
+
 using udp_socket = asio::basic_datagram_socket<asio::ip::udp, asio::io_context::executor_type>;
 using tcp_socket = asio::basic_stream_socket<asio::ip::tcp, asio::io_context::executor_type>;
 using tcp_acceptor = asio::basic_socket_acceptor<asio::ip::tcp, asio::io_context::executor_type>;
@@ -19,6 +25,31 @@ uint16_t bind_port_in_range(udp_socket &sock, asio::ip::udp protocol);
 /// Bind and listen to an acceptor on a free port in the configured port range or throw an error.
 uint16_t bind_and_listen_to_port_in_range(
 	tcp_acceptor &acc, asio::ip::tcp protocol, int backlog);
+
+#ifdef LSL_RX_TIMESTAMPS
+/// The size of the control buffer a packet's receive time stamp is received in
+constexpr std::size_t rx_timestamp_control_size = 64;
+
+/**
+ * Let the kernel time stamp the packets received by a socket (SO_TIMESTAMPNS).
+ * @return false if the kernel doesn't support it.
+ */
+bool enable_rx_timestamps(udp_socket &sock);
+
+/**
+ * The time a packet was received, in the lsl_clock() domain.
+ * @param msg The received message including its control messages.
+ * @param fallback The time to return if the packet wasn't time stamped.
+ */
+double rx_timestamp(const msghdr &msg, double fallback);
+
+/**
+ * Receive a packet without blocking, along with the time it was received (see rx_timestamp()).
+ * @return The size of the packet, or -1 if no packet was available.
+ */
+long receive_timestamped(udp_socket &sock, char *buf, std::size_t len,
+	asio::ip::udp::endpoint &sender, double &rx_time);
+#endif
 } // namespace lsl
 
 #endif
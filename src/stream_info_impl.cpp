@@ -3,7 +3,9 @@
 #include "util/cast.hpp"
 #include "util/uuid.hpp"
 #include <algorithm>
+#include <cctype>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <loguru.hpp>
 #include <sstream>
@@ -156,15 +158,29 @@ void stream_info_impl::read_xml(xml_document &doc) {
 
 // === Protocol Support Operations Implementation ===
 
-std::string stream_info_impl::to_shortinfo_message() {
-	// make a new document (with an empty <desc> field)
-	xml_document tmp;
-	write_xml(tmp);
-	// write it to a stream
-	std::ostringstream os;
-	tmp.save(os);
-	// and get the string
-	return os.str();
+template <typename Fn>
+std::shared_ptr<const std::string> stream_info_impl::rendered(rendered_message &msg, Fn &&render) {
+	std::lock_guard<std::mutex> lock(rendered_mut_);
+	// the revision is read before rendering, so a concurrent change renders the message again
+	const uint64_t current = revision();
+	if (!msg.text || msg.revision != current) {
+		msg.text = std::make_shared<const std::string>(render());
+		msg.revision = current;
+	}
+	return msg.text;
+}
+
+std::shared_ptr<const std::string> stream_info_impl::shortinfo_message() {
+	return rendered(shortinfo_, [this]() {
+		// make a new document (with an empty <desc> field)
+		xml_document tmp;
+		write_xml(tmp);
+		// write it to a stream
+		std::ostringstream os;
+		tmp.save(os);
+		// and get the string
+		return os.str();
+	});
 }
 
 void stream_info_impl::from_shortinfo_message(const std::string &m) {
@@ -172,6 +188,7 @@ void stream_info_impl::from_shortinfo_message(const std::string &m) {
 	doc_.load_buffer(m.c_str(), m.size());
 	// and assign all the struct fields, too...
 	read_xml(doc_);
+	changed();
 }
 
 std::string stream_info_impl::to_fullinfo_message() {
@@ -182,78 +199,139 @@ std::string stream_info_impl::to_fullinfo_message() {
 	return os.str();
 }
 
+std::shared_ptr<const std::string> stream_info_impl::fullinfo_message() {
+	return rendered(fullinfo_, [this]() { return to_fullinfo_message(); });
+}
+
 void stream_info_impl::from_fullinfo_message(const std::string &m) {
 	// load the doc from the message string
 	doc_.load_buffer(m.c_str(), m.size());
 	// and assign all the struct fields, too...
 	read_xml(doc_);
+	changed();
 }
 
 bool stream_info_impl::matches_query(const std::string &query, bool nocache) {
-	return cached_.matches_query(doc_, query, nocache);
+	int trivial = matches_trivial_query(query);
+	if (trivial >= 0) return trivial == 1;
+	return cached_.matches_query(doc_, query, revision(), nocache);
+}
+
+const std::string *stream_info_impl::string_field(const char *name, std::size_t len) const {
+	auto is = [name, len](const char *field) {
+		return strlen(field) == len && memcmp(field, name, len) == 0;
+	};
+	if (is("name")) return &name_;
+	if (is("type")) return &type_;
+	if (is("source_id")) return &source_id_;
+	if (is("uid")) return &uid_;
+	if (is("session_id")) return &session_id_;
+	if (is("hostname")) return &hostname_;
+	return nullptr;
+}
+
+int stream_info_impl::matches_trivial_query(const std::string &query) const {
+	// grammar: field = 'literal' [and field = 'literal' ...], with optional whitespace
+	const char *pos = query.c_str(), *end = pos + query.size();
+	// the whitespace characters of XPath
+	auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+	auto skip_space = [&pos, end, is_space]() {
+		while (pos != end && is_space(*pos)) ++pos;
+	};
+	bool matches = true;
+	while (true) {
+		skip_space();
+		// the field's name
+		const char *name = pos;
+		while (pos != end && (isalnum(static_cast<unsigned char>(*pos)) || *pos == '_')) ++pos;
+		const std::string *field = string_field(name, pos - name);
+		if (!field) return -1;
+		skip_space();
+		if (pos == end || *pos++ != '=') return -1;
+		skip_space();
+		// the literal, which can't contain its quote character
+		if (pos == end || (*pos != '\'' && *pos != '"')) return -1;
+		const char quote = *pos++;
+		const char *literal = pos;
+		while (pos != end && *pos != quote) ++pos;
+		if (pos == end) return -1;
+		const auto len = static_cast<std::size_t>(pos++ - literal);
+		matches = matches && field->size() == len && field->compare(0, len, literal, len) == 0;
+		// either the end of the query or `and` followed by the next comparison
+		const char *before_and = pos;
+		skip_space();
+		if (pos == end) return matches ? 1 : 0;
+		if (pos == before_and || end - pos < 4 || strncmp(pos, "and", 3) != 0 || !is_space(pos[3]))
+			return -1;
+		pos += 3;
+	}
 }
 
-bool query_cache::matches_query(const xml_document &doc, const std::string &query, bool nocache) {
+bool query_cache::matches_query(
+	const xml_document &doc, const std::string &query, uint64_t revision, bool nocache) {
 	if (query.empty()) return true;
 	std::lock_guard<std::mutex> lock(cache_mut_);
-
-	decltype(cache)::iterator it;
-	if (!nocache && (it = cache.find(query)) != cache.end()) {
-		// the sign bit encodes if the query matches or not
-		bool matches = it->second > 0;
-		// update the last-use time stamp
-		it->second = ++query_cache_age * (matches ? 1 : -1);
-		// return cached match
-		return matches;
+	const auto max_cached = static_cast<std::size_t>(
+		std::max(api_config::get_instance()->max_cached_queries(), 0));
+	auto evaluate = [&doc, &query](const xpath_query *compiled) {
+		if (!compiled) return false;
+		try {
+			return compiled->evaluate_boolean(doc.first_child());
+		} catch (std::exception &e) {
+			LOG_F(WARNING, "Query \"%s\" error: %s", query.c_str(), e.what());
+			return false;
+		}
+	};
+
+	auto it = index_.find(query);
+	if (it != index_.end())
+		// move the query to the front of the LRU list
+		lru_.splice(lru_.begin(), lru_, it->second);
+	else {
+		// not found in cache: compile the query
+		entry compiled;
+		compiled.query = query;
+		try {
+			compiled.compiled = std::make_unique<xpath_query>(query.c_str());
+		} catch (std::exception &e) {
+			LOG_F(WARNING, "Query \"%s\" error: %s", query.c_str(), e.what());
+		}
+		if (max_cached == 0) return evaluate(compiled.compiled.get());
+		lru_.push_front(std::move(compiled));
+		index_.emplace(query, lru_.begin());
+		// remove the least recently used queries
+		while (lru_.size() > max_cached) {
+			index_.erase(lru_.back().query);
+			lru_.pop_back();
+		}
 	}
 
-	// not found in cache
-	try {
-		// compute whether it matches
-		bool matched = pugi::xpath_query(query.c_str()).evaluate_boolean(doc.first_child());
-
-		auto max_cached = (std::size_t)api_config::get_instance()->max_cached_queries();
-		if (nocache || max_cached == 0) return matched;
-
-		cache.insert(std::make_pair(query, ++query_cache_age * (matched ? 1 : -1)));
-
-		// remove n/2 oldest results to make room for new entries
-		if (cache.size() > max_cached) {
-			// Find out the median cache entry age
-			std::vector<int> agevec;
-			agevec.reserve(cache.size());
-			for (auto &val : cache) agevec.push_back(std::abs(val.second));
-			auto middle = agevec.begin() + max_cached / 2;
-			std::nth_element(agevec.begin(), middle, agevec.end());
-			auto oldest_to_keep = *middle;
-
-			// Remove all elements older than the median age
-			for (auto it = cache.begin(); it != cache.end();)
-				if (abs(it->second) <= oldest_to_keep)
-					it = cache.erase(it);
-				else
-					++it;
-		}
-		return matched;
-	} catch (std::exception &e) {
-		LOG_F(WARNING, "Query \"%s\" error: %s", query.c_str(), e.what());
-		return false;
+	// reuse the result if the stream_info hasn't changed since it was evaluated
+	entry &e = lru_.front();
+	if (nocache || !e.evaluated || e.revision != revision) {
+		e.matched = evaluate(e.compiled.get());
+		e.evaluated = true;
+		e.revision = revision;
 	}
+	return e.matched;
 }
 
 void stream_info_impl::channel_count (uint32_t v) {
 	channel_count_ = v;
 	doc_.child("info").child("channel_count").first_child().set_value(to_string(v).c_str());
+	changed();
 }
 
 void stream_info_impl::nominal_srate (double v) {
 	nominal_srate_ = v;
 	doc_.child("info").child("nominal_srate").first_child().set_value(to_string(v).c_str());
+	changed();
 }
 
 void stream_info_impl::source_id (const std::string &v) {
 	source_id_ = v;
 	doc_.child("info").child("source_id").first_child().set_value(v.c_str());
+	changed();
 }
 
 int stream_info_impl::channel_bytes() const {
@@ -262,7 +340,11 @@ int stream_info_impl::channel_bytes() const {
 	return channel_format_sizes[channel_format_];
 }
 
-xml_node stream_info_impl::desc() { return doc_.child("info").child("desc"); }
+xml_node stream_info_impl::desc() {
+	// the description is likely modified by the caller
+	changed();
+	return doc_.child("info").child("desc");
+}
 xml_node stream_info_impl::desc() const { return doc_.child("info").child("desc"); }
 
 uint32_t lsl::stream_info_impl::calc_transport_buf_samples(
@@ -286,16 +368,19 @@ uint32_t lsl::stream_info_impl::calc_transport_buf_samples(
 void stream_info_impl::version(int v) {
 	version_ = v;
 	doc_.child("info").child("version").first_child().set_value(to_string(version_ / 100.).c_str());
+	changed();
 }
 
 void stream_info_impl::created_at(double v) {
 	created_at_ = v;
 	doc_.child("info").child("created_at").first_child().set_value(to_string(created_at_).c_str());
+	changed();
 }
 
 void stream_info_impl::uid(const std::string &v) {
 	uid_ = v;
 	doc_.child("info").child("uid").first_child().set_value(uid_.c_str());
+	changed();
 }
 
 const std::string& stream_info_impl::reset_uid()
@@ -307,41 +392,49 @@ const std::string& stream_info_impl::reset_uid()
 void stream_info_impl::session_id(const std::string &v) {
 	session_id_ = v;
 	doc_.child("info").child("session_id").first_child().set_value(session_id_.c_str());
+	changed();
 }
 
 void stream_info_impl::hostname(const std::string &v) {
 	hostname_ = v;
 	doc_.child("info").child("hostname").first_child().set_value(hostname_.c_str());
+	changed();
 }
 
 void stream_info_impl::v4address(const std::string &v) {
 	v4address_ = v;
 	doc_.child("info").child("v4address").first_child().set_value(v4address_.c_str());
+	changed();
 }
 
 void stream_info_impl::v4data_port(uint16_t v) {
 	v4data_port_ = v;
 	doc_.child("info").child("v4data_port").first_child().text().set(v4data_port_);
+	changed();
 }
 
 void stream_info_impl::v4service_port(uint16_t v) {
 	v4service_port_ = v;
 	doc_.child("info").child("v4service_port").first_child().text().set(v4service_port_);
+	changed();
 }
 
 void stream_info_impl::v6address(const std::string &v) {
 	v6address_ = v;
 	doc_.child("info").child("v6address").first_child().set_value(v6address_.c_str());
+	changed();
 }
 
 void stream_info_impl::v6data_port(uint16_t v) {
 	v6data_port_ = v;
 	doc_.child("info").child("v6data_port").first_child().text().set(v6data_port_);
+	changed();
 }
 
 void stream_info_impl::v6service_port(uint16_t v) {
 	v6service_port_ = v;
 	doc_.child("info").child("v6service_port").first_child().text().set(v6service_port_);
+	changed();
 }
 
 stream_info_impl &stream_info_impl::operator=(stream_info_impl const &rhs) {
@@ -365,6 +458,7 @@ stream_info_impl &stream_info_impl::operator=(stream_info_impl const &rhs) {
 	hostname_ = rhs.hostname_;
 	allow_remote_populate_ = rhs.allow_remote_populate_;
 	doc_.reset(rhs.doc_);
+	changed();
 	return *this;
 }
 
@@ -383,6 +477,7 @@ stream_info_impl::stream_info_impl(const stream_info_impl &rhs)
 void stream_info_impl::allow_remote_populate(bool allow) {
 	allow_remote_populate_ = allow;
 	doc_.child("info").child("allow_remote_populate").text() = (allow ? "true" : "false");
+	changed();
 }
 
 void stream_info_impl::process_commands(const std::string& commands) {
@@ -451,6 +546,7 @@ void stream_info_impl::process_commands(const std::string& commands) {
 	}
 
 	read_xml(doc_);
+	changed();
 }
 
 } // namespace lsl
@@ -2,7 +2,10 @@
 #define STREAM_INFO_IMPL_H
 
 #include "common.h"
+#include <atomic>
 #include <cstdint>
+#include <list>
+#include <memory>
 #include <mutex>
 #include <pugixml.hpp>
 #include <string>
@@ -10,14 +13,35 @@
 
 namespace lsl {
 
-/// LRU cache for queries
+/**
+ * LRU cache of compiled queries and their results.
+ *
+ * The results are only reused as long as the revision of the queried stream_info is the same.
+ * At most `tuning.MaxCachedQueries` queries are kept.
+ */
 class query_cache {
-	std::unordered_map<std::string, int> cache;
-	int query_cache_age{0};
-	std::mutex cache_mut_;
-
 public:
-	bool matches_query(const pugi::xml_document &doc, const std::string &query, bool nocache);
+	/**
+	 * Evaluate a query, compiling it only if it isn't in the cache already.
+	 * @param revision The stream_info's revision, see stream_info_impl::revision().
+	 * @param nocache Evaluate the query again even if there's a result for this revision.
+	 */
+	bool matches_query(const pugi::xml_document &doc, const std::string &query, uint64_t revision,
+		bool nocache);
+
+private:
+	struct entry {
+		std::string query;
+		/// the compiled query, or nullptr if it's invalid
+		std::unique_ptr<pugi::xpath_query> compiled;
+		/// the last result and the revision it was computed for
+		uint64_t revision{0};
+		bool evaluated{false}, matched{false};
+	};
+	/// the cached queries, the most recently used first
+	std::list<entry> lru_;
+	std::unordered_map<std::string, std::list<entry>::iterator> index_;
+	std::mutex cache_mut_;
 };
 
 /**
@@ -66,7 +90,14 @@ public:
 	 * .desc() field (which can be megabytes in size).
 	 * This message is sent by a stream outlet in response to a variety of queries.
 	 */
-	std::string to_shortinfo_message();
+	std::string to_shortinfo_message() { return *shortinfo_message(); }
+
+	/**
+	 * The short-info message, rendered only when the stream_info has changed since the last call.
+	 *
+	 * The message can be kept e.g. until an asynchronous write has completed.
+	 */
+	std::shared_ptr<const std::string> shortinfo_message();
 
 	/**
 	 * Initialize a stream_info from a short-info message.
@@ -83,6 +114,15 @@ public:
 	 */
 	std::string to_fullinfo_message();
 
+	/**
+	 * The full-info message, rendered only when the stream_info has changed since the last call.
+	 *
+	 * Modifications of the description are noticed when desc() is called, so changes made via an
+	 * xml_node obtained earlier are only visible after the next call to desc() or any setter.
+	 * Use to_fullinfo_message() when such changes have to be included.
+	 */
+	std::shared_ptr<const std::string> fullinfo_message();
+
 	/**
 	 * Initialize a stream_info from a full-info message.
 	 *
@@ -94,6 +134,10 @@ public:
 	 * Test whether this stream info matches the given query string.
 	 *
 	 * The info "matches" if the given XPath 1.0 query string returns a non-empty node set.
+	 * Queries that only compare fields to strings, e.g. `name='X' and type='EEG'`, are matched
+	 * without evaluating XPath at all.
+	 * @param nocache Don't reuse a cached result, e.g. because the description might have been
+	 * modified via an xml_node (the compiled query is cached anyway).
 	 * @return Whether stream info is matched by the query string.
 	 */
 	bool matches_query(const std::string &query, bool nocache = false);
@@ -222,7 +266,7 @@ public:
 	uint16_t v6service_port() const { return v6service_port_; }
 	void v6service_port(uint16_t v);
 
-	/// Get the (editable) XML description of a stream.
+	/// Get the (editable) XML description of a stream. Invalidates the rendered full-info message.
 	pugi::xml_node desc();
 	pugi::xml_node desc() const;
 
@@ -234,6 +278,9 @@ public:
 
 	void process_commands(const std::string& commands);
 
+	/// The number of changes of the stream_info so far, e.g. to tell whether a message is current.
+	uint64_t revision() const { return revision_.load(std::memory_order_acquire); }
+
 protected:
 	/// Create and assign the XML DOM structure based on the class fields.
 	void write_xml(pugi::xml_document &doc);
@@ -242,6 +289,28 @@ protected:
 	void read_xml(pugi::xml_document &doc);
 
 private:
+	/**
+	 * Match queries that are a conjunction of comparisons of string fields with literals.
+	 * @return 1 or 0 if the query matches or not, -1 if it has to be evaluated as XPath.
+	 */
+	int matches_trivial_query(const std::string &query) const;
+
+	/// The string field with the element name `name` of length `len`, or nullptr.
+	const std::string *string_field(const char *name, std::size_t len) const;
+
+	/// Note a change of the stream_info, so the rendered messages are regenerated.
+	void changed() { revision_.fetch_add(1, std::memory_order_acq_rel); }
+
+	/// A message rendered at a revision of the stream_info
+	struct rendered_message {
+		std::shared_ptr<const std::string> text;
+		uint64_t revision{0};
+	};
+
+	/// Return `msg` if it's current or replace it with the result of `render()`.
+	template <typename Fn>
+	std::shared_ptr<const std::string> rendered(rendered_message &msg, Fn &&render);
+
 	// global flag to allow remote update of streaminfo
 	bool allow_remote_populate_;
 	// data information
@@ -267,6 +336,10 @@ private:
 	pugi::xml_document doc_;
 	// cached query results
 	query_cache cached_;
+	// the rendered messages and the revision they were rendered at (see revision())
+	std::atomic<uint64_t> revision_{0};
+	rendered_message shortinfo_, fullinfo_;
+	std::mutex rendered_mut_;
 };
 
 
@@ -5,8 +5,11 @@
 #include "data_receiver.h"
 #include "info_receiver.h"
 #include "inlet_connection.h"
+#include "metrics.h"
 #include "time_postprocessor.h"
 #include "time_receiver.h"
+#include "trace.h"
+#include <algorithm>
 #include <loguru.hpp>
 
 namespace lsl {
@@ -36,20 +39,24 @@ public:
 	 * In all other cases (recover is false or the stream is not recoverable) a lsl::lost_error
 	 * is thrown where indicated if the stream's source is lost (e.g. due to an app or computer
 	 * crash).
+	 * @param delta_encoding Ask the outlet to delta-encode integer values (see
+	 * transp_delta_encoding).
 	 */
 	stream_inlet_impl(const stream_info_impl &info, int32_t max_buflen = 360,
-		int32_t max_chunklen = 0, bool recover = true)
+		int32_t max_chunklen = 0, bool recover = true, bool delta_encoding = false)
 		: conn_(info, recover), info_receiver_(conn_), time_receiver_(conn_),
-		  data_receiver_(conn_, max_buflen, max_chunklen), 
-		  postprocessor_([this]() { return time_receiver_.time_correction(5); },
+		  data_receiver_(conn_, max_buflen, max_chunklen, delta_encoding), 
+		  postprocessor_([this]() { return time_receiver_.correction_model(5); },
 			  [this]() { return conn_.current_srate(); },
 			  [this]() { return time_receiver_.was_reset(); }) {
 		ensure_lsl_initialized();
 		conn_.engage();
+		metrics_registry::instance().add(this);
 	}
 
 	/// Destructor. The stream will stop reading from the source if destroyed.
 	~stream_inlet_impl() {
+		metrics_registry::instance().remove(this);
 		try {
 			conn_.disengage();
 		} catch (std::exception &e) {
@@ -201,13 +208,22 @@ public:
 		if (timestamp_buffer && max_samples != timestamp_buffer_elements)
 			throw std::runtime_error(
 				"The timestamp buffer must hold the same number of samples as the data buffer.");
+		// samples are dequeued in batches, so the clock is only consulted once per batch
+		constexpr std::size_t batch_size = 128;
+		sample_p batch[batch_size];
 		double end_time = timeout ? lsl_clock() + timeout : 0.0;
-		for (samples_written = 0; samples_written < max_samples; samples_written++) {
-			if (double ts = pull_sample(&data_buffer[samples_written * num_chans], (int) num_chans,
-					timeout ? end_time - lsl_clock() : 0.0)) {
+		while (samples_written < max_samples) {
+			std::size_t n = data_receiver_.pull_samples(batch,
+				std::min(batch_size, max_samples - samples_written),
+				timeout ? end_time - lsl_clock() : 0.0);
+			if (!n) break;
+			for (std::size_t k = 0; k < n; k++, samples_written++) {
+				batch[k]->retrieve_typed(&data_buffer[samples_written * num_chans]);
+				data_receiver_.count_pulled(*batch[k]);
+				double ts = postprocess(batch[k]->timestamp());
 				if (timestamp_buffer) timestamp_buffer[samples_written] = ts;
-			} else
-				break;
+				batch[k].reset();
+			}
 		}
 		return static_cast<uint32_t>(samples_written * num_chans);
 	}
@@ -304,6 +320,20 @@ public:
 	 */
 	void set_postprocessing(uint32_t flags = proc_ALL) { postprocessor_.set_options(flags); }
 
+	/**
+	 * Set the receive mode of the inlet.
+	 * @param mode inlet_mode_default or inlet_mode_busy_poll
+	 * @param spin_us How long to spin before blocking, in microseconds (busy poll mode only).
+	 */
+	void set_mode(lsl_inlet_mode_t mode, int32_t spin_us) {
+		if (spin_us < 0) throw std::invalid_argument("The spinning time must not be negative.");
+		switch (mode) {
+		case inlet_mode_default: data_receiver_.busy_poll(0); break;
+		case inlet_mode_busy_poll: data_receiver_.busy_poll(static_cast<uint32_t>(spin_us)); break;
+		default: throw std::invalid_argument("Unknown inlet mode.");
+		}
+	}
+
 	/**
 	 * Open a new data stream.
 	 *
@@ -332,6 +362,32 @@ public:
 	 */
 	std::size_t samples_available() { return data_receiver_.samples_available(); }
 
+	/**
+	 * The number of samples that were lost before the samples pulled so far.
+	 *
+	 * Counts the samples dropped by the outlet (if it supports sequence numbers) and by this
+	 * inlet's buffer when they weren't pulled in time, but not those discarded by flush().
+	 */
+	uint64_t dropped_samples() const { return data_receiver_.dropped_samples(); }
+
+	/// Get the runtime statistics of the inlet (see lsl_get_inlet_stats()).
+	void stats(lsl_inlet_stats &s) {
+		inlet_metrics &m = conn_.metrics();
+		s.samples_received = m.samples_received.value();
+		s.samples_dropped = data_receiver_.dropped_samples();
+		s.samples_queued = data_receiver_.samples_available();
+		s.reconnects = m.reconnects.value();
+		s.time_probes = m.rtt_us.count();
+		s.rtt_us_p50 = m.rtt_us.quantile(0.5);
+		s.rtt_us_p99 = m.rtt_us.quantile(0.99);
+		s.rtt_us_max = m.rtt_us.max();
+		s.time_correction = m.time_correction.value();
+		s.time_uncertainty = m.time_uncertainty.value();
+	}
+
+	/// The type and format of the connected stream, available without a round trip.
+	const stream_info_impl &type_info() const { return conn_.type_info(); }
+
 	/// Flush the queue, return the number of dropped samples
 	uint32_t flush() {
 		int nskipped = data_receiver_.flush();
@@ -351,8 +407,10 @@ public:
 	void smoothing_halftime(float value) { postprocessor_.smoothing_halftime(value); }
 
 private:
-	/// post-process a time stamp
+	/// post-process a time stamp, accounting for the samples lost before it
 	double postprocess(double stamp) {
+		if (uint32_t skipped = data_receiver_.take_skipped()) postprocessor_.skip_samples(skipped);
+		if (stamp != 0.0) LSL_TRACE_POINT(pulled, stamp);
 		return stamp ? postprocessor_.process_timestamp(stamp) : stamp;
 	}
 
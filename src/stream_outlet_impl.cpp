@@ -1,13 +1,17 @@
 #include "stream_outlet_impl.h"
 #include "api_config.h"
+#include "metrics.h"
 #include "sample.h"
 #include "send_buffer.h"
 #include "stream_info_impl.h"
 #include "tcp_server.h"
+#include "trace.h"
 #include "udp_server.h"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <memory>
+#include <stdexcept>
 
 namespace lsl {
 
@@ -18,10 +22,10 @@ stream_outlet_impl::stream_outlet_impl(stream_info_impl &info, int32_t chunk_siz
 			  info.nominal_srate()
 				  ? info.nominal_srate() * api_config::get_instance()->outlet_buffer_reserve_ms() /
 						1000
-				  : api_config::get_instance()->outlet_buffer_reserve_samples()))),
+				  : api_config::get_instance()->outlet_buffer_reserve_samples()),
+		  api_config::get_instance()->numa_local_samples())),
 	  chunk_size_(info.calc_transport_buf_samples(requested_bufsize, flags)),
-//	  info_(std::make_shared<stream_info_impl>(info)),
-	  info_(&info),
+	  info_(std::make_shared<stream_info_impl>(info)),
 	  send_buffer_(std::make_shared<send_buffer>(chunk_size_)),
 	  io_ctx_data_(std::make_shared<asio::io_context>(1)),
 	  io_ctx_service_(std::make_shared<asio::io_context>(1)) {
@@ -42,7 +46,7 @@ stream_outlet_impl::stream_outlet_impl(stream_info_impl &info, int32_t chunk_siz
 
 	// create TCP data server
 	tcp_server_ = std::make_shared<tcp_server>(info_, io_ctx_data_, send_buffer_, sample_factory_,
-		chunk_size_, cfg->allow_ipv4(), cfg->allow_ipv6());
+		chunk_size_, cfg->allow_ipv4(), cfg->allow_ipv6(), (flags & transp_async_sender) != 0);
 
 	// fail if both stacks failed to instantiate
 	if (udp_servers_.empty())
@@ -52,6 +56,7 @@ stream_outlet_impl::stream_outlet_impl(stream_info_impl &info, int32_t chunk_siz
 	tcp_server_->begin_serving();
 	for (auto &udp_server : udp_servers_) udp_server->begin_serving();
 	for (auto &responder : responders_) responder->begin_serving();
+	metrics_registry::instance().add(this);
 
 	// and start the IO threads to handle them
 	const std::string name{"O_" + this->info().name().substr(0, 10) + "_" + this->info().type().substr(0, 3)};
@@ -94,6 +99,7 @@ void stream_outlet_impl::instantiate_stack(udp udp_protocol) {
 }
 
 stream_outlet_impl::~stream_outlet_impl() {
+	metrics_registry::instance().remove(this);
 	try {
 		// cancel all request chains
 		tcp_server_->end_serving();
@@ -149,6 +155,7 @@ void stream_outlet_impl::push_numeric_raw(const void *data, double timestamp, bo
 	sample_p smp(
 		sample_factory_->new_sample(timestamp == 0.0 ? lsl_clock() : timestamp, pushthrough));
 	smp->assign_untyped(data);
+	LSL_TRACE_POINT(enqueue, smp->timestamp());
 	send_buffer_->push_sample(smp);
 }
 
@@ -158,15 +165,72 @@ bool stream_outlet_impl::wait_for_consumers(double timeout) {
 	return send_buffer_->wait_for_consumers(timeout);
 }
 
+void stream_outlet_impl::set_flush_policy(
+	int32_t max_samples, int32_t max_bytes, int32_t max_delay_us) {
+	if (max_samples < 0 || max_bytes < 0 || max_delay_us < 0)
+		throw std::invalid_argument("The flush policy limits must not be negative.");
+	flush_policy policy;
+	policy.max_samples = max_samples;
+	policy.max_bytes = static_cast<std::size_t>(max_bytes);
+	policy.max_delay = std::chrono::microseconds(max_delay_us);
+	tcp_server_->set_flush_policy(policy);
+}
+
+void stream_outlet_impl::set_history(const std::string &filename, double max_history) {
+	if (!filename.empty() && !(max_history > 0))
+		throw std::invalid_argument("The history length must be positive.");
+	const double srate = info().nominal_srate();
+	tcp_server_->set_history(filename,
+		static_cast<std::size_t>(std::ceil(srate > 0 ? max_history * srate : max_history * 100)));
+}
+
+void stream_outlet_impl::stats(lsl_outlet_stats &s) const {
+	const outlet_metrics &m = *send_buffer_->metrics();
+	s.samples_pushed = send_buffer_->samples_pushed();
+	s.samples_dropped = m.samples_dropped.value();
+	s.samples_queued = send_buffer_->samples_queued();
+	s.sessions_accepted = m.sessions_accepted.value();
+	s.sessions_active = static_cast<uint64_t>(m.sessions_active.load(std::memory_order_relaxed));
+	s.chunks_sent = m.chunks_sent.value();
+	s.bytes_sent = m.bytes_sent.value();
+	s.chunk_samples_p50 = m.chunk_samples.quantile(0.5);
+	s.chunk_samples_p99 = m.chunk_samples.quantile(0.99);
+	s.chunk_samples_max = m.chunk_samples.max();
+	s.write_us_p50 = m.write_us.quantile(0.5);
+	s.write_us_p99 = m.write_us.quantile(0.99);
+	s.write_us_max = m.write_us.max();
+}
+
 template <class T>
 void stream_outlet_impl::enqueue(const T *data, double timestamp, bool pushthrough) {
 	if (lsl::api_config::get_instance()->force_default_timestamps()) timestamp = 0.0;
 	sample_p smp(
 		sample_factory_->new_sample(timestamp == 0.0 ? lsl_clock() : timestamp, pushthrough));
 	smp->assign_typed(data);
+	LSL_TRACE_POINT(enqueue, smp->timestamp());
 	send_buffer_->push_sample(smp);
 }
 
+template <class T>
+void stream_outlet_impl::enqueue_chunk(const T *data, const double *timestamps,
+	std::size_t num_samples, double timestamp, bool pushthrough) {
+	if (num_samples == 1) return enqueue(data, timestamps ? *timestamps : timestamp, pushthrough);
+	const bool force_default = lsl::api_config::get_instance()->force_default_timestamps();
+	sample_p chunk(
+		sample_factory_->new_chunk(static_cast<uint32_t>(num_samples), pushthrough));
+	// the clock is only read once per chunk
+	double now = 0.0;
+	double *chunk_ts = chunk->timestamps();
+	for (std::size_t k = 0; k < num_samples; k++) {
+		double ts = timestamps ? timestamps[k] : (k ? DEDUCED_TIMESTAMP : timestamp);
+		if (force_default || ts == 0.0) ts = now != 0.0 ? now : (now = lsl_clock());
+		chunk_ts[k] = ts;
+	}
+	chunk->assign_typed(data);
+	LSL_TRACE_POINT(enqueue, chunk->timestamp());
+	send_buffer_->push_sample(chunk);
+}
+
 template void stream_outlet_impl::enqueue<char>(const char *data, double, bool);
 template void stream_outlet_impl::enqueue<int16_t>(const int16_t *data, double, bool);
 template void stream_outlet_impl::enqueue<int32_t>(const int32_t *data, double, bool);
@@ -175,4 +239,19 @@ template void stream_outlet_impl::enqueue<float>(const float *data, double, bool
 template void stream_outlet_impl::enqueue<double>(const double *data, double, bool);
 template void stream_outlet_impl::enqueue<std::string>(const std::string *data, double, bool);
 
+template void stream_outlet_impl::enqueue_chunk<char>(
+	const char *, const double *, std::size_t, double, bool);
+template void stream_outlet_impl::enqueue_chunk<int16_t>(
+	const int16_t *, const double *, std::size_t, double, bool);
+template void stream_outlet_impl::enqueue_chunk<int32_t>(
+	const int32_t *, const double *, std::size_t, double, bool);
+template void stream_outlet_impl::enqueue_chunk<int64_t>(
+	const int64_t *, const double *, std::size_t, double, bool);
+template void stream_outlet_impl::enqueue_chunk<float>(
+	const float *, const double *, std::size_t, double, bool);
+template void stream_outlet_impl::enqueue_chunk<double>(
+	const double *, const double *, std::size_t, double, bool);
+template void stream_outlet_impl::enqueue_chunk<std::string>(
+	const std::string *, const double *, std::size_t, double, bool);
+
 } // namespace lsl
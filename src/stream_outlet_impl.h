@@ -200,9 +200,8 @@ public:
 		if (!data_buffer) throw std::runtime_error("The data buffer pointer must not be NULL.");
 		if (!timestamp_buffer)
 			throw std::runtime_error("The timestamp buffer pointer must not be NULL.");
-		for (std::size_t k = 0; k < num_samples; k++)
-			enqueue(&data_buffer[k * num_chans], timestamp_buffer[k],
-				pushthrough && k == num_samples - 1);
+		if (num_samples > 0)
+			enqueue_chunk(data_buffer, timestamp_buffer, num_samples, 0.0, pushthrough);
 	}
 
 	template <class T>
@@ -254,10 +253,7 @@ public:
 			if (timestamp == 0.0) timestamp = lsl_clock();
 			if (info().nominal_srate() != IRREGULAR_RATE)
 				timestamp = timestamp - (num_samples - 1) / info().nominal_srate();
-			push_sample(buffer, timestamp, pushthrough && (num_samples == 1));
-			for (std::size_t k = 1; k < num_samples; k++)
-				push_sample(&buffer[k * num_chans], DEDUCED_TIMESTAMP,
-					pushthrough && (k == num_samples - 1));
+			enqueue_chunk(buffer, nullptr, num_samples, timestamp, pushthrough);
 		}
 	}
 
@@ -294,6 +290,19 @@ public:
 	/// Wait until some consumer shows up.
 	bool wait_for_consumers(double timeout = FOREVER);
 
+	/**
+	 * Set when buffered samples are sent to the consumers (see lsl_set_outlet_flush_policy()).
+	 *
+	 * Applies to consumers that connect afterwards.
+	 */
+	void set_flush_policy(int32_t max_samples, int32_t max_bytes, int32_t max_delay_us);
+
+	/// Keep the most recent samples in a file (see lsl_set_outlet_history()).
+	void set_history(const std::string &filename, double max_history);
+
+	/// Get the runtime statistics of the outlet (see lsl_get_outlet_stats()).
+	void stats(lsl_outlet_stats &s) const;
+
 private:
 	/// Instantiate a new server stack.
 	void instantiate_stack(udp udp_protocol);
@@ -301,6 +310,15 @@ private:
 	/// Allocate and enqueue a new sample into the send buffer.
 	template <class T> void enqueue(const T *data, double timestamp, bool pushthrough);
 
+	/**
+	 * Allocate and enqueue `num_samples` samples as one chunk into the send buffer.
+	 * @param timestamps Timestamps for each sample or nullptr, in which case the first sample is
+	 * stamped with `timestamp` and the following ones with DEDUCED_TIMESTAMP.
+	 */
+	template <class T>
+	void enqueue_chunk(const T *data, const double *timestamps, std::size_t num_samples,
+		double timestamp, bool pushthrough);
+
 	/**
 	 * Check whether some given number of channels matches the stream's channel_count.
 	 * Throws an error if not.
@@ -315,8 +333,8 @@ private:
 	factory_p sample_factory_;
 	/// the preferred chunk size
 	int32_t chunk_size_;
-	/// stream_info shared between the various server instances
-	stream_info_impl *info_;
+	/// the outlet's own copy of the stream_info, shared between the various server instances
+	stream_info_impl_p info_;
 	/// the single-producer, multiple-receiver send buffer
 	send_buffer_p send_buffer_;
 	/// the IO service objects
@@ -3,8 +3,10 @@
 #include "consumer_queue.h"
 #include "sample.h"
 #include "send_buffer.h"
+#include "shm_transport.h"
 #include "socket_utils.h"
 #include "stream_info_impl.h"
+#include "trace.h"
 #include "util/cast.hpp"
 #include "util/endian.hpp"
 #include "util/strfuns.hpp"
@@ -12,14 +14,22 @@
 #include <asio/ip/host_name.hpp>
 #include <asio/ip/tcp.hpp>
 #include <asio/read_until.hpp>
+#include <asio/steady_timer.hpp>
 #include <asio/streambuf.hpp>
 #include <asio/write.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <condition_variable>
 #include <cstdint>
 #include <exception>
 #include <istream>
+#include <limits>
 #include <loguru.hpp>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -65,7 +75,9 @@ class client_session : public std::enable_shared_from_this<client_session> {
 public:
 	/// Instantiate a new session & its socket.
 	client_session(const tcp_server_p &serv, tcp_socket &&sock)
-		: io_(serv->io_), serv_(serv), sock_(std::move(sock)), requeststream_(&requestbuf_) {}
+		: io_(serv->io_), factory_(serv->factory_), serv_(serv), sock_(std::move(sock)),
+		  requeststream_(&requestbuf_),
+		  flush_timer_(sock_.get_executor()) {}
 
 	/// Destructor.
 	~client_session();
@@ -97,15 +109,105 @@ private:
 	void handle_send_feedheader_outcome(err_t err, std::size_t n);
 
 	/// Transfers samples from the server's send buffer into the async send queues of IO threads
-	void transfer_samples_thread(std::shared_ptr<client_session> /*keepalive*/,
-		std::shared_ptr<consumer_queue> &&queue, int max_samples_per_chunk);
+	void transfer_samples_thread(
+		std::shared_ptr<client_session> /*keepalive*/, std::shared_ptr<consumer_queue> &&queue);
 
 	/// Handler that gets called when a sample transfer has been completed.
 	void handle_chunk_transfer_outcome(err_t err, std::size_t len);
 
+	/// Whether the other party runs on the same host.
+	bool is_local_peer();
+
+	/// Keep the shared memory publisher until the other party closes the connection.
+	void watch_shm_session();
+
+	/// Stop the async transfer once the other party closes the connection, even while idle.
+	void watch_async_session();
+
+	/**
+	 * Get the next sample from the server's history (for a resumed session).
+	 *
+	 * Samples up to the time the other party asked to resume after are skipped.
+	 * @return The sample, or nullptr if none arrived before the timeout.
+	 * @throws lost_error if the history has been closed.
+	 */
+	sample_p next_history_sample(double timeout);
+
+	/**
+	 * Serialize all available samples and send them, without blocking (async sender mode).
+	 *
+	 * Runs on the IO thread. If no flush is due yet, it asks the consumer queue to call it again
+	 * once more samples are available; otherwise it's called again when the write has finished.
+	 */
+	void transfer_samples_async();
+
+	/// Handler that gets called when a transfer started by transfer_samples_async() has finished.
+	void handle_async_transfer_outcome(err_t err, std::size_t len);
+
+	/// End the async transfer, i.e. release the queue and unregister from the server.
+	void stop_async_transfer();
+
+	/// Let the flush timer call transfer_samples_async() once the current chunk's delay expired.
+	void arm_flush_timer();
+
+	/**
+	 * Serialize a sample into the current chunk.
+	 * @return true if the chunk should be sent off according to the flush policy.
+	 */
+	bool add_to_chunk(sample_p &&samp);
+
+	/// Whether the current chunk is non-empty and its maximum delay has expired.
+	bool flush_delay_expired() const;
+
+	/// Time until the current chunk's maximum delay expires.
+	std::chrono::microseconds flush_delay_left() const;
+
+	/// Hold back partial TCP segments while a chunk is written (Linux only, no-op elsewhere).
+	void set_cork(bool cork);
+	/// whether the socket is currently corked
+	bool corked_{false};
+
+	/// Serialize a sample for the next transfer.
+	void serialize_sample(sample_p &&samp);
+
+	/// Announce the samples dropped before `samp` with a gap marker (see TAG_GAP), if any.
+	void serialize_gap(const sample &samp);
+
+	/// Start an async_write of all serialized samples.
+	template <typename Handler> void start_transfer(Handler &&handler);
+
+	/// Release the data of a successful transfer of `len` bytes.
+	void finish_transfer(std::size_t len);
+
+	/**
+	 * Queue a sample for the next vectored write.
+	 *
+	 * The headers of raw samples are copied to the feed buffer, their channel data is referenced
+	 * if it's large enough (see queue_bytes()). All other samples are sent in the serialization
+	 * they share with the other sessions using the same byte order.
+	 * @return whether the write references the sample's memory.
+	 */
+	bool queue_vectored(const sample &samp);
+
+	/**
+	 * Queue `len` bytes at `data` for the next write.
+	 *
+	 * Pieces smaller than min_reference_bytes are copied to the feed buffer, so consecutive
+	 * small pieces end up in one contiguous buffer. Larger ones are referenced in place, as
+	 * an extra iovec costs more than copying a few hundred bytes.
+	 * @return whether the piece is referenced, i.e. has to stay alive until the write completes.
+	 */
+	bool queue_bytes(const void *data, std::size_t len);
+
+	/// Build the buffer sequence for the feed buffer with the referenced pieces spliced in.
+	const std::vector<asio::const_buffer> &vectored_buffers();
+
 	/// shared pointer to IO service; ensures that the IO is still around by the time the serv_ and
 	/// sock_ need to be destroyed
 	io_context_p io_;
+	/// shared pointer to the outlet's sample factory; the samples held by this session return to
+	/// it when they're released, which may well be after the server is gone
+	factory_p factory_;
 	/// the server that is associated with this connection
 	std::weak_ptr<tcp_server> serv_;
 	/// connection socket
@@ -131,6 +233,67 @@ private:
 	/// maximum number of samples buffered
 	int max_buffered_{0};
 
+	// data used by the vectored (scatter-gather) transfer of samples (protocol 1.10)
+	/// whether samples are sent with vectored writes instead of via the feed buffer
+	bool vectored_transfer_{false};
+	/// whether the channel data is sent straight from the samples' memory
+	bool raw_transfer_{false};
+	/// the server's count of sessions that convert samples like this one, if it's counted
+	std::shared_ptr<std::atomic<int>> converting_sessions_;
+	/// pieces of sample memory below this size are copied rather than referenced by an iovec
+	static constexpr std::size_t min_reference_bytes = 1024;
+	/// the maximum number of buffers asio passes to a single sendmsg() call
+	static constexpr std::size_t max_write_buffers = 64;
+
+	// data used by the delta encoding of integer samples (see sample::save_streambuf_delta())
+	/// whether the values are delta-encoded
+	bool delta_encoding_{false};
+	/// the channel values of the last sent sample
+	std::vector<int64_t> delta_previous_;
+	/// samples referenced by the pending vectored write, kept alive until the write has completed
+	std::vector<sample_p> vectored_samples_;
+	/// a piece of sample memory that's written in place, after the first `offset` feed bytes
+	struct vectored_ref {
+		std::size_t offset;
+		const void *data;
+		std::size_t len;
+	};
+	/// the pieces referenced by the pending vectored write, in the order of their offsets
+	std::vector<vectored_ref> vectored_refs_;
+	/// number of referenced bytes in the pending vectored write (i.e. not in the feed buffer)
+	std::size_t vectored_bytes_{0};
+	/// buffer sequence for the pending vectored write
+	std::vector<asio::const_buffer> vectored_buffers_;
+
+	// data used to announce the samples dropped by the queue (see serialize_gap())
+	/// whether gap markers are sent
+	bool sequence_numbers_{false};
+	/// counts the samples missing before each sample
+	gap_tracker gaps_;
+	/// the queue the samples are popped from, nullptr if they're read from the history
+	const consumer_queue *gap_queue_{nullptr};
+
+	// data used to decide when the serialized samples are sent off
+	/// the server's flush policy at the time the transfer started
+	flush_policy policy_;
+	/// number of samples serialized since the last transfer
+	int samples_in_current_chunk_{0};
+	/// time the first sample of the current chunk was serialized
+	std::chrono::steady_clock::time_point chunk_started_;
+	/// time the current transfer was started
+	std::chrono::steady_clock::time_point transfer_started_;
+
+	/// the outlet's metrics, once the session transfers samples
+	std::shared_ptr<outlet_metrics> metrics_;
+
+	// data used by the async sender mode (see transfer_samples_async())
+	/// the queue of samples to send, calls back when samples are available
+	std::shared_ptr<consumer_queue> async_queue_;
+	/// calls transfer_samples_async() when the maximum delay of a partial chunk expires
+	asio::steady_timer flush_timer_;
+	/// whether a transfer started by transfer_samples_async() is in flight
+	bool sending_{false};
+
 	// data exchanged between the transfer completion handler and the transfer thread
 	/// whether the current transfer has finished (possibly with an error)
 	bool transfer_completed_;
@@ -142,12 +305,32 @@ private:
 	std::mutex completion_mut_;
 	/// a condition variable that signals completion
 	std::condition_variable completion_cond_;
+
+	/// the publisher serving the other party instead of this session's socket, if any
+	std::shared_ptr<shm_publisher> shm_;
+
+	// data used to resume a session from the server's history
+	/// whether the other party asked to resume after the sample with timestamp resume_after_
+	bool resume_{false};
+	double resume_after_{0.0};
+	/// the history the samples are read from instead of the send buffer, if resumed
+	std::unique_ptr<shm_subscriber> history_;
+	/// factory for the samples read from the history
+	std::unique_ptr<factory> history_factory_;
+	/// the samples read from the history but not sent yet
+	sample_p history_batch_[64];
+	std::size_t history_next_{0}, history_count_{0};
+	/// timestamp of the last sample read from the history and the rate to deduce the next one
+	double history_timestamp_{std::numeric_limits<double>::quiet_NaN()};
+	double history_srate_{IRREGULAR_RATE};
 };
 
-tcp_server::tcp_server(stream_info_impl *info, io_context_p io, send_buffer_p sendbuf,
-	factory_p factory, int chunk_size, bool allow_v4, bool allow_v6)
-	: chunk_size_(chunk_size), info_(std::move(info)), io_(std::move(io)),
+tcp_server::tcp_server(stream_info_impl_p info, io_context_p io, send_buffer_p sendbuf,
+	factory_p factory, int chunk_size, bool allow_v4, bool allow_v6, bool async_sender)
+	: async_sender_(async_sender), info_(std::move(info)), io_(std::move(io)),
 	  factory_(std::move(factory)), send_buffer_(std::move(sendbuf)) {
+	flush_policy_.max_samples = chunk_size;
+	for (auto &sessions : converting_sessions_) sessions = std::make_shared<std::atomic<int>>(0);
 	// assign connection-dependent fields
 	info_->session_id(api_config::get_instance()->session_id());
 	info_->reset_uid();
@@ -190,19 +373,79 @@ void tcp_server::begin_serving() {
 }
 
 void tcp_server::end_serving() {
+	// issue closure of all active client session sockets; cancels the related outstanding IO jobs.
+	// This goes first, because the IO thread may run out of work and return once the acceptors
+	// are closed, and a closure posted after that would keep its session alive forever
+	close_inflight_sessions();
 	// issue closure of the server socket; this will result in a cancellation of the associated IO
 	// operations
 	post(*io_, [this, shared_this = shared_from_this()]() {
 		if (acceptor_v4_) acceptor_v4_->close();
 		if (acceptor_v6_) acceptor_v6_->close();
 	});
-	// issue closure of all active client session sockets; cancels the related outstanding IO jobs
-	close_inflight_sessions();
 	// also notify any transfer threads that are blocked waiting for a sample by sending them one (=
 	// a ping)
-	// set timestamp to -1.0 to indicate end of the transfer
-//	send_buffer_->push_sample(factory_->new_sample(lsl_clock(), true));
-	send_buffer_->push_sample(factory_->new_sample(-1.0, true));
+	// a special timestamp indicates the end of the transfer
+	send_buffer_->push_control_sample(factory_->new_sample(END_OF_TRANSFER_TIMESTAMP, true));
+	// async sessions are kept alive by their pending handlers from here on
+	std::lock_guard<std::recursive_mutex> lock(inflight_mut_);
+	async_sessions_.clear();
+}
+
+void tcp_server::set_flush_policy(const flush_policy &policy) {
+	std::lock_guard<std::mutex> lock(flush_policy_mut_);
+	flush_policy_ = policy;
+}
+
+flush_policy tcp_server::get_flush_policy() {
+	std::lock_guard<std::mutex> lock(flush_policy_mut_);
+	return flush_policy_;
+}
+
+std::shared_ptr<shm_publisher> tcp_server::get_shm_publisher(int max_buffered) {
+	std::lock_guard<std::mutex> lock(shm_mut_);
+	auto publisher = shm_publisher_.lock();
+	if (publisher) return publisher;
+	const std::size_t capacity = std::min<std::size_t>(
+		std::max<std::size_t>(ring_bytes(static_cast<std::size_t>(max_buffered)), 1 << 20), 1 << 26);
+	// the path is sent in a header that the other party converts to lowercase
+	static std::atomic<uint32_t> instance{0};
+	std::string path = "/dev/shm/lsl-" + info_->uid() + "-" + std::to_string(instance++);
+	for (auto &c : path) c = static_cast<char>(::tolower(c));
+	try {
+		publisher = std::make_shared<shm_publisher>(path, capacity, send_buffer_);
+		shm_publisher_ = publisher;
+		LOG_F(1, "Publishing %s via shared memory %s", info_->name().c_str(), path.c_str());
+	} catch (std::exception &e) {
+		LOG_F(WARNING, "Shared memory transport unavailable: %s", e.what());
+	}
+	return publisher;
+}
+
+void tcp_server::set_history(const std::string &path, std::size_t max_samples) {
+	std::shared_ptr<shm_publisher> history;
+	if (!path.empty()) {
+		// a file left over from a crashed outlet is replaced
+		history = std::make_shared<shm_publisher>(
+			path, std::max<std::size_t>(ring_bytes(max_samples), 1 << 16), send_buffer_, false);
+		LOG_F(INFO, "Keeping the history of %s in %s", info_->name().c_str(), path.c_str());
+	}
+	// the previous history is closed, which ends the sessions replaying it
+	std::lock_guard<std::mutex> lock(shm_mut_);
+	history_.swap(history);
+}
+
+std::string tcp_server::history_path() {
+	std::lock_guard<std::mutex> lock(shm_mut_);
+	return history_ ? history_->path() : std::string();
+}
+
+std::size_t tcp_server::ring_bytes(std::size_t num_samples) const {
+	// a record holds a length prefix, padding and a sample, estimating 64 bytes per string value
+	const std::size_t value_bytes =
+		info_->channel_format() == cft_string ? 9 + 64 : info_->channel_bytes();
+	return num_samples * (2 * sizeof(uint32_t) + sample::max_header_bytes +
+							 value_bytes * info_->channel_count());
 }
 
 // === accept loop ===
@@ -246,12 +489,28 @@ void tcp_server::unregister_inflight_session(client_session *session) {
 	if (pos != inflight_.end()) inflight_.erase(pos);
 }
 
-void tcp_server::close_inflight_sessions() {
+void tcp_server::register_async_session(const std::shared_ptr<client_session> &session) {
+	std::lock_guard<std::recursive_mutex> lock(inflight_mut_);
+	async_sessions_.emplace(session.get(), session);
+}
+
+void tcp_server::unregister_async_session(client_session *session) {
 	std::lock_guard<std::recursive_mutex> lock(inflight_mut_);
-	for (auto &pair : inflight_) {
-		auto session = pair.second.lock();
-		// session has already expired on its own
-		if (!session) continue;
+	async_sessions_.erase(session);
+}
+
+void tcp_server::close_inflight_sessions() {
+	// the sessions are collected first: once the IO thread has run the posted closure, the last
+	// reference may be ours, and a destructor unregistering the session would break the iteration
+	std::vector<std::shared_ptr<client_session>> sessions;
+	{
+		std::lock_guard<std::recursive_mutex> lock(inflight_mut_);
+		for (auto &pair : inflight_)
+			// skip sessions that have already expired on their own
+			if (auto session = pair.second.lock()) sessions.push_back(std::move(session));
+		inflight_.clear();
+	}
+	for (auto &session : sessions) {
 		post(session->socket().get_executor(), [session]() {
 			asio::error_code ec;
 			auto &sock = session->socket();
@@ -262,14 +521,18 @@ void tcp_server::close_inflight_sessions() {
 			}
 		});
 	}
-	inflight_.clear();
 }
 
 // === implementation of the client_session class ===
 
 client_session::~client_session() {
 	LOG_F(3, "Destructing session %p", this);
+	// release the samples before the members they may be reclaimed into (history_factory_)
+	vectored_samples_.clear();
+	async_queue_.reset();
 	delete[] scratch_;
+	if (converting_sessions_) converting_sessions_->fetch_sub(1, std::memory_order_relaxed);
+	if (metrics_) metrics_->sessions_active.fetch_sub(1, std::memory_order_relaxed);
 	if (auto serv = serv_.lock()) serv->unregister_inflight_session(this);
 }
 
@@ -315,10 +578,12 @@ void client_session::handle_read_command_outcome(err_t read_err) {
 		else if (method == "LSL:fullinfo") {
 			// fullinfo request: reply right away
 			auto serv = serv_.lock();
-			if (serv)
-				async_write(sock_, asio::buffer(serv->info_->to_fullinfo_message()),
-					[shared_this = shared_from_this(), serv](
+			if (serv) {
+				auto msg = serv->info_->fullinfo_message();
+				async_write(sock_, asio::buffer(*msg),
+					[shared_this = shared_from_this(), serv, msg](
 						err_t /*unused*/, std::size_t /*unused*/) {});
+			}
 		} else if (method == "LSL:command") {
 			// command request: read the command
 			async_read_until(sock_, requestbuf_, "\r\n",
@@ -358,9 +623,10 @@ void client_session::handle_read_query_outcome(err_t err) {
 		if (!serv) return;
 		if (serv->info_->matches_query(query, true)) {
 			// matches: reply (otherwise just close the stream)
-			async_write(sock_, asio::buffer(serv->info_->to_shortinfo_message()),
-				[serv](err_t /*unused*/, std::size_t /*unused*/) {
-					/* keep the tcp_server alive until the shortinfo is sent completely*/
+			auto msg = serv->info_->shortinfo_message();
+			async_write(sock_, asio::buffer(*msg),
+				[serv, msg](err_t /*unused*/, std::size_t /*unused*/) {
+					/* keep the tcp_server and the message alive until it's sent completely */
 				});
 		} else {
 			DLOG_F(INFO, "%p got a shortinfo query response for the wrong query", this);
@@ -377,11 +643,12 @@ void client_session::handle_send_command_outcome(err_t err) {
 		getline(requeststream_, commands);
 
 		auto serv = serv_.lock();
-		if (serv)
-			serv->info_->process_commands(commands);
-			async_write(sock_, asio::buffer(serv->info_->to_fullinfo_message()),
-				[shared_this = shared_from_this(), serv](
-					err_t /*unused*/, std::size_t /*unused*/) {});
+		if (!serv) return;
+		serv->info_->process_commands(commands);
+		auto msg = serv->info_->fullinfo_message();
+		async_write(sock_, asio::buffer(*msg),
+			[shared_this = shared_from_this(), serv, msg](
+				err_t /*unused*/, std::size_t /*unused*/) {});
 	} catch (std::exception &e) {
 		LOG_F(WARNING, "Unexpected error while parsing a fullinfo request: %s", e.what());
 	}
@@ -429,6 +696,9 @@ void client_session::handle_read_feedparams(
 			int client_value_size = info->channel_bytes(); // assume that the client has a standard
 														   // size for the relevant data type
 			lsl_channel_format_t format = info->channel_format();
+			bool client_wants_shm = false; // the client can read from shared memory
+			bool client_wants_delta = false; // the client wants delta-encoded values
+			bool client_wants_seq = false;	 // the client wants to know about dropped samples
 
 			// read feed parameters
 			char buf[16384] = {0};
@@ -456,6 +726,13 @@ void client_session::handle_read_feedparams(
 					if (type == "max-buffer-length") max_buffered_ = std::stoi(rest);
 					if (type == "max-chunk-length") chunk_granularity_ = std::stoi(rest);
 					if (type == "protocol-version") client_protocol_version = std::stoi(rest);
+					if (type == "transport") client_wants_shm = rest == "shm";
+					if (type == "value-encoding") client_wants_delta = rest == "delta";
+					if (type == "sequence-numbers") client_wants_seq = from_string<bool>(rest);
+					if (type == "resume-after") {
+						resume_after_ = std::stod(rest);
+						resume_ = true;
+					}
 				} else {
 					DLOG_F(WARNING, "%p Request line '%s' contained no key-value pair", this,
 						hdrline.c_str());
@@ -496,6 +773,18 @@ void client_session::handle_read_feedparams(
 				// determine if subnormal suppression needs to be enabled
 				client_suppress_subnormals =
 					(format_subnormal[format] && !client_supports_subnormals);
+
+				// serve clients on the same host via shared memory, unless the samples have to
+				// be converted for them
+				if (client_wants_shm && client_byte_order == LSL_BYTE_ORDER &&
+					!client_suppress_subnormals && max_buffered_ > 0 && is_local_peer())
+					shm_ = serv->get_shm_publisher(max_buffered_);
+
+				// delta-encode integer values if asked to, unless they aren't sent via TCP anyway
+				delta_encoding_ = client_wants_delta && format_integral[format] && !shm_;
+
+				// announce dropped samples; shared memory records carry their sequence numbers
+				sequence_numbers_ = client_wants_seq && !shm_;
 			}
 
 			// send the response
@@ -505,6 +794,13 @@ void client_session::handle_read_feedparams(
 			response_stream << "Byte-Order: " << use_byte_order << "\r\n";
 			response_stream << "Suppress-Subnormals: " << client_suppress_subnormals << "\r\n";
 			response_stream << "Data-Protocol-Version: " << data_protocol_version_ << "\r\n";
+			if (shm_) {
+				response_stream << "Transport: shm\r\n";
+				response_stream << "Shm-Path: " << shm_->path() << "\r\n";
+				response_stream << "Shm-Position: " << shm_->position() << "\r\n";
+			}
+			if (delta_encoding_) response_stream << "Value-Encoding: delta\r\n";
+			if (sequence_numbers_) response_stream << "Sequence-Numbers: 1\r\n";
 			response_stream << "\r\n" << std::flush;
 		} else {
 			// read feed parameters
@@ -520,6 +816,12 @@ void client_session::handle_read_feedparams(
 		} else {
 			// allocate scratchpad memory for endian conversion, etc.
 			scratch_ = new char[format_sizes[info->channel_format()] * info->channel_count()];
+			// delta-encoded values depend on the previous sample sent, so they aren't shared
+			vectored_transfer_ = !delta_encoding_;
+			delta_previous_.assign(info->channel_count(), 0);
+			// numeric samples that don't need conversions can be sent without copying them
+			raw_transfer_ = info->channel_format() != cft_string &&
+							(!reverse_byte_order_ || info->channel_bytes() == 1);
 		}
 
 		// send test pattern samples
@@ -535,6 +837,11 @@ void client_session::handle_read_feedparams(
 				*outarch_ << *temp;
 		}
 
+		// from here on, the session's transfers are counted in the outlet's metrics
+		metrics_ = serv->send_buffer_->metrics();
+		metrics_->sessions_accepted.add();
+		metrics_->sessions_active.fetch_add(1, std::memory_order_relaxed);
+
 		// send off the newly created feedheader
 		async_write(
 			sock_, feedbuf_.data(), [shared_this = shared_from_this()](err_t err, std::size_t len) {
@@ -559,67 +866,350 @@ void client_session::handle_send_feedheader_outcome(err_t err, std::size_t n) {
 		// convenient for unit tests
 		if (max_buffered_ <= 0) return;
 
-		// determine transfer parameters
-		auto queue = serv->send_buffer_->new_consumer(max_buffered_);
+		// the samples are read from shared memory, the socket only signals the end of the session
+		if (shm_) return watch_shm_session();
+
+		// a reconnecting inlet gets the samples it missed from the history, followed by all
+		// later samples; it's always served by a transfer thread since reading the history blocks
+		const std::string history = resume_ ? serv->history_path() : std::string();
+		if (!history.empty()) try {
+				history_ = std::make_unique<shm_subscriber>(history, 0);
+				history_->rewind();
+				history_factory_ = std::make_unique<factory>(
+					serv->info_->channel_format(), serv->info_->channel_count(), 64);
+				history_srate_ = serv->info_->nominal_srate();
+				policy_ = serv->get_flush_policy();
+				if (chunk_granularity_) policy_.max_samples = chunk_granularity_;
+				std::thread(&client_session::transfer_samples_thread, this, shared_from_this(),
+					nullptr)
+					.detach();
+				return;
+			} catch (std::exception &e) {
+				LOG_F(WARNING, "Couldn't resume from %s: %s", history.c_str(), e.what());
+				history_.reset();
+			}
 
-		// determine the maximum chunk size
-		int max_samples_per_chunk = std::numeric_limits<int>::max();
-		if (chunk_granularity_)
-			max_samples_per_chunk = chunk_granularity_;
-		else if (serv->chunk_size_)
-			max_samples_per_chunk = serv->chunk_size_;
+		// determine when to send off the chunks; the inlet's chunk size takes precedence
+		policy_ = serv->get_flush_policy();
+		if (chunk_granularity_) policy_.max_samples = chunk_granularity_;
+
+		if (vectored_transfer_ && !raw_transfer_) {
+			converting_sessions_ = serv->converting_sessions_[reverse_byte_order_];
+			converting_sessions_->fetch_add(1, std::memory_order_relaxed);
+		}
+
+		if (serv->async_sender_) {
+			// let the queue kick off the transfer on the IO thread once samples are available
+			serv->register_async_session(shared_from_this());
+			async_queue_ = serv->send_buffer_->new_consumer(
+				max_buffered_, [weak_this = std::weak_ptr<client_session>(shared_from_this())]() {
+					if (auto shared_this = weak_this.lock())
+						post(shared_this->sock_.get_executor(),
+							[shared_this]() { shared_this->transfer_samples_async(); });
+				});
+			gap_queue_ = async_queue_.get();
+			watch_async_session();
+			transfer_samples_async();
+			return;
+		}
 
 		// spawn a sample transfer thread.
 		std::thread(&client_session::transfer_samples_thread, this, shared_from_this(),
-			std::move(queue), max_samples_per_chunk)
+			serv->send_buffer_->new_consumer(max_buffered_))
 			.detach();
 	} catch (std::exception &e) {
 		LOG_F(WARNING, "Unexpected error while handling the feedheader send outcome: %s", e.what());
 	}
 }
 
-void client_session::transfer_samples_thread(std::shared_ptr<client_session> /* keepalive */,
-	std::shared_ptr<consumer_queue> &&queue, int max_samples_per_chunk) {
-	int samples_in_current_chunk = 0;
+void client_session::transfer_samples_thread(
+	std::shared_ptr<client_session> /* keepalive */, std::shared_ptr<consumer_queue> &&queue) {
+	gap_queue_ = queue.get();
 	while (!serv_.expired()) {
 		try {
-			// get next sample from the sample queue (blocking)
-			sample_p samp(queue->pop_sample());
-
-			// ignore blank samples (they are basically wakeup notifiers from someone's
-			// end_serving())
-			if (!samp) continue;
-			// timestamp = -1.0 indicate end_serving()
-			if (samp->timestamp() < 0) break;
-
-			// serialize the sample into the stream
-			if (data_protocol_version_ >= 110)
-				samp->save_streambuf(
-					feedbuf_, data_protocol_version_, reverse_byte_order_, scratch_);
+			// get next sample from the sample queue (blocking until a partial chunk is due)
+			double timeout = FOREVER;
+			if (samples_in_current_chunk_ && policy_.max_delay.count())
+				timeout = static_cast<double>(flush_delay_left().count()) / 1e6;
+			sample_p samp(history_ ? next_history_sample(timeout) : queue->pop_sample(timeout));
+
+			bool flush;
+			// blank samples are wakeup notifiers from someone's end_serving() or a timeout
+			if (!samp)
+				flush = flush_delay_expired();
+			// a special timestamp indicates end_serving()
+			else if (samp->timestamp() == END_OF_TRANSFER_TIMESTAMP)
+				break;
 			else
-				*outarch_ << *samp;
-			// if the sample is marked as force-push or the configured chunk size is reached
-			if (samp->pushthrough || ++samples_in_current_chunk >= max_samples_per_chunk) {
+				flush = add_to_chunk(std::move(samp));
+
+			if (flush) {
 				// send off the chunk that we aggregated so far
 				std::unique_lock<std::mutex> lock(completion_mut_);
 				transfer_completed_ = false;
-				async_write(sock_, feedbuf_.data(),
-					[shared_this = shared_from_this()](err_t err, std::size_t len) {
-						shared_this->handle_chunk_transfer_outcome(err, len);
-					});
+				start_transfer([shared_this = shared_from_this()](err_t err, std::size_t len) {
+					shared_this->handle_chunk_transfer_outcome(err, len);
+				});
 				// wait for the completion condition
 				completion_cond_.wait(lock, [this]() { return transfer_completed_; });
+				set_cork(false);
 				// handle transfer outcome
 				if (!transfer_error_) {
-					feedbuf_.consume(transfer_amount_);
+					finish_transfer(transfer_amount_);
 				} else
 					break;
-				samples_in_current_chunk = 0;
 			}
+		} catch (lost_error &) {
+			// the history has been closed
+			break;
 		} catch (std::exception &e) {
 			LOG_F(WARNING, "Unexpected glitch in transfer_samples_thread: %s", e.what());
 		}
 	}
+	// the queued samples have to be released while the keepalive still holds the factory
+	queue.reset();
+}
+
+void client_session::transfer_samples_async() {
+	// called again by handle_async_transfer_outcome() or already stopped
+	if (sending_ || !async_queue_) return;
+	try {
+		const auto serv = serv_.lock();
+		bool flush = false;
+		while (serv && !flush) {
+			sample_p batch[64];
+			std::size_t n = async_queue_->pop_samples(batch, sizeof(batch) / sizeof(batch[0]));
+			for (std::size_t k = 0; k < n; k++) {
+				sample_p &samp = batch[k];
+				if (!samp) continue;
+				// a special timestamp indicates end_serving()
+				if (samp->timestamp() == END_OF_TRANSFER_TIMESTAMP) return stop_async_transfer();
+				if (add_to_chunk(std::move(samp))) flush = true;
+			}
+			if (n || flush) continue;
+			if (flush_delay_expired()) break;
+			// queue drained without reaching a flush condition: resume once more samples arrive
+			// or the partial chunk is due
+			if (async_queue_->request_ready_callback()) return arm_flush_timer();
+		}
+		if (!serv) return stop_async_transfer();
+		flush_timer_.cancel();
+		sending_ = true;
+		start_transfer([shared_this = shared_from_this()](err_t err, std::size_t len) {
+			shared_this->handle_async_transfer_outcome(err, len);
+		});
+	} catch (std::exception &e) {
+		LOG_F(WARNING, "Unexpected glitch in transfer_samples_async: %s", e.what());
+		stop_async_transfer();
+	}
+}
+
+void client_session::handle_async_transfer_outcome(err_t err, std::size_t len) {
+	sending_ = false;
+	if (err) return stop_async_transfer();
+	set_cork(false);
+	finish_transfer(len);
+	transfer_samples_async();
+}
+
+void client_session::stop_async_transfer() {
+	flush_timer_.cancel();
+	// unregister from the send buffer and release the queue's reference to us
+	gap_queue_ = nullptr;
+	async_queue_.reset();
+	if (auto serv = serv_.lock()) serv->unregister_async_session(this);
+}
+
+void client_session::arm_flush_timer() {
+	if (!samples_in_current_chunk_ || !policy_.max_delay.count()) return;
+	// re-arming cancels the previous wait, whose handler then gets operation_aborted
+	flush_timer_.expires_after(flush_delay_left());
+	flush_timer_.async_wait(
+		[weak_this = std::weak_ptr<client_session>(shared_from_this())](err_t err) {
+			if (err) return;
+			if (auto shared_this = weak_this.lock()) shared_this->transfer_samples_async();
+		});
+}
+
+bool client_session::add_to_chunk(sample_p &&samp) {
+	LSL_TRACE_POINT(dequeue, samp->timestamp());
+	if (!samples_in_current_chunk_) chunk_started_ = std::chrono::steady_clock::now();
+	samples_in_current_chunk_ += static_cast<int>(samp->num_samples());
+	bool flush = samp->pushthrough ||
+				 (policy_.max_samples && samples_in_current_chunk_ >= policy_.max_samples);
+	if (sequence_numbers_) serialize_gap(*samp);
+	serialize_sample(std::move(samp));
+	if (policy_.max_bytes && feedbuf_.size() + vectored_bytes_ >= policy_.max_bytes) flush = true;
+	return flush || flush_delay_expired();
+}
+
+bool client_session::flush_delay_expired() const {
+	return samples_in_current_chunk_ && policy_.max_delay.count() &&
+		   !flush_delay_left().count();
+}
+
+std::chrono::microseconds client_session::flush_delay_left() const {
+	auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+		chunk_started_ + policy_.max_delay - std::chrono::steady_clock::now());
+	return left.count() > 0 ? left : std::chrono::microseconds(0);
+}
+
+void client_session::set_cork(bool cork) {
+#ifdef TCP_CORK
+	if (cork == corked_) return;
+	corked_ = cork;
+	asio::error_code ec;
+	sock_.set_option(asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_CORK>(cork), ec);
+#else
+	(void)cork;
+#endif
+}
+
+void client_session::serialize_sample(sample_p &&samp) {
+	bool shared = raw_transfer_;
+	// a converted sample is only worth keeping for other sessions if there are any
+	if (!shared && converting_sessions_)
+		shared = converting_sessions_->load(std::memory_order_relaxed) > 1;
+	if (vectored_transfer_ && shared) {
+		if (queue_vectored(*samp)) vectored_samples_.push_back(std::move(samp));
+	} else if (delta_encoding_)
+		samp->save_streambuf_delta(feedbuf_, reverse_byte_order_, delta_previous_.data());
+	else if (data_protocol_version_ >= 110)
+		samp->save_streambuf(feedbuf_, data_protocol_version_, reverse_byte_order_, scratch_);
+	else
+		*outarch_ << *samp;
+}
+
+void client_session::serialize_gap(const sample &samp) {
+	if (const uint64_t gap = gaps_.missing_before(samp, gap_queue_)) {
+		const auto missing = std::min<uint64_t>(gap, std::numeric_limits<uint32_t>::max());
+		char marker[GAP_MARKER_BYTES];
+		sample::save_gap_marker(marker, static_cast<uint32_t>(missing), reverse_byte_order_);
+		feedbuf_.sputn(marker, GAP_MARKER_BYTES);
+	}
+}
+
+template <typename Handler> void client_session::start_transfer(Handler &&handler) {
+	transfer_started_ = std::chrono::steady_clock::now();
+	// with TCP_NODELAY, every syscall of a write that's split up would be sent as separate
+	// segments. This happens for vectored writes with more buffers than asio passes to one
+	// sendmsg() call; otherwise it's only worth the two extra syscalls if the policy asks for
+	// full segments.
+	if (vectored_refs_.empty()) {
+		set_cork(policy_.max_bytes != 0);
+		async_write(sock_, feedbuf_.data(), std::forward<Handler>(handler));
+	} else {
+		const auto &buffers = vectored_buffers();
+		set_cork(policy_.max_bytes != 0 || buffers.size() > max_write_buffers);
+		async_write(sock_, buffers, std::forward<Handler>(handler));
+	}
+}
+
+void client_session::finish_transfer(std::size_t len) {
+	LSL_TRACE_POINT(written, 0.0);
+	if (metrics_) {
+		metrics_->chunks_sent.add();
+		metrics_->bytes_sent.add(len);
+		metrics_->chunk_samples.record(static_cast<uint64_t>(samples_in_current_chunk_));
+		metrics_->write_us.record(static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - transfer_started_)
+				.count()));
+	}
+	samples_in_current_chunk_ = 0;
+	feedbuf_.consume(len - vectored_bytes_);
+	vectored_samples_.clear();
+	vectored_refs_.clear();
+	vectored_bytes_ = 0;
+}
+
+bool client_session::queue_vectored(const sample &samp) {
+	if (!raw_transfer_) {
+		const auto &serialized = samp.serialized(reverse_byte_order_);
+		return queue_bytes(serialized.data(), serialized.size());
+	}
+	bool referenced = false;
+	char header[sample::max_header_bytes];
+	for (uint32_t k = 0; k < samp.num_samples(); ++k) {
+		feedbuf_.sputn(header, static_cast<std::streamsize>(samp.save_header_raw(header, k)));
+		referenced |= queue_bytes(samp.raw_data(k), samp.datasize());
+	}
+	return referenced;
+}
+
+bool client_session::queue_bytes(const void *data, std::size_t len) {
+	if (len < min_reference_bytes) {
+		feedbuf_.sputn(static_cast<const char *>(data), static_cast<std::streamsize>(len));
+		return false;
+	}
+	vectored_refs_.push_back({feedbuf_.size(), data, len});
+	vectored_bytes_ += len;
+	return true;
+}
+
+const std::vector<asio::const_buffer> &client_session::vectored_buffers() {
+	// the feed buffer is only referenced now that it won't be reallocated anymore
+	vectored_buffers_.clear();
+	const char *staged = static_cast<const char *>(feedbuf_.data().data());
+	std::size_t pos = 0;
+	for (const auto &ref : vectored_refs_) {
+		if (ref.offset > pos) vectored_buffers_.emplace_back(staged + pos, ref.offset - pos);
+		vectored_buffers_.emplace_back(ref.data, ref.len);
+		pos = ref.offset;
+	}
+	if (feedbuf_.size() > pos) vectored_buffers_.emplace_back(staged + pos, feedbuf_.size() - pos);
+	return vectored_buffers_;
+}
+
+bool client_session::is_local_peer() {
+	asio::error_code ec;
+	const auto peer = sock_.remote_endpoint(ec).address();
+	return !ec && (peer.is_loopback() || peer == sock_.local_endpoint(ec).address());
+}
+
+void client_session::watch_shm_session() {
+	auto buf = std::make_shared<char>();
+	sock_.async_read_some(asio::buffer(buf.get(), 1),
+		[buf, shared_this = shared_from_this()](err_t err, std::size_t /*unused*/) {
+			if (!err) return shared_this->watch_shm_session();
+			// the connection was closed by either side, stop publishing for it
+			shared_this->shm_.reset();
+		});
+}
+
+void client_session::watch_async_session() {
+	auto buf = std::make_shared<char>();
+	sock_.async_read_some(asio::buffer(buf.get(), 1),
+		[buf, shared_this = shared_from_this()](err_t err, std::size_t /*unused*/) {
+			if (!err) return shared_this->watch_async_session();
+			// without samples to send, a failed write wouldn't tell us the inlet is gone
+			shared_this->stop_async_transfer();
+		});
+}
+
+sample_p client_session::next_history_sample(double timeout) {
+	for (;;) {
+		while (history_next_ < history_count_) {
+			sample_p samp(std::move(history_batch_[history_next_++]));
+			double &ts = samp->timestamp();
+			if (ts != DEDUCED_TIMESTAMP)
+				history_timestamp_ = ts;
+			else if (history_srate_ != IRREGULAR_RATE)
+				history_timestamp_ += 1.0 / history_srate_;
+			if (!resume_) return samp;
+			// skip the samples the other party already has and those of unknown age
+			if (std::isnan(history_timestamp_) || history_timestamp_ <= resume_after_) continue;
+			// the other party can't deduce the first timestamp after a gap
+			ts = history_timestamp_;
+			resume_ = false;
+			return samp;
+		}
+		history_next_ = 0;
+		// wake up regularly to notice when the connection was closed
+		history_count_ = history_->read(*history_factory_, history_batch_,
+			sizeof(history_batch_) / sizeof(history_batch_[0]), std::min(timeout, 0.5));
+		if (!history_count_) return sample_p();
+	}
 }
 
 void client_session::handle_chunk_transfer_outcome(err_t err, std::size_t len) {
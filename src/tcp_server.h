@@ -4,6 +4,8 @@
 #include "forward.h"
 #include "socket_utils.h"
 #include <atomic>
+#include <chrono>
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -14,6 +16,21 @@ using err_t = const asio::error_code &;
 
 namespace lsl {
 
+/**
+ * Determines when the samples buffered for an inlet are sent off.
+ *
+ * A chunk is sent as soon as any of the limits is reached or a sample with the pushthrough flag
+ * was buffered. A zero limit is not checked.
+ */
+struct flush_policy {
+	/// maximum number of buffered samples (an inlet's max_chunklen takes precedence)
+	int max_samples{0};
+	/// maximum number of buffered bytes
+	std::size_t max_bytes{0};
+	/// maximum time since the first sample of the chunk was buffered
+	std::chrono::microseconds max_delay{0};
+};
+
 /// shared pointer to a socket
 using tcp_socket_p = std::shared_ptr<tcp_socket>;
 /// shared pointer to an acceptor socket
@@ -46,10 +63,11 @@ public:
 	 * @param factory A sample factory that is shared with other server objects.
 	 * @param protocol The protocol (IPv4 or IPv6) that shall be serviced by this server.
 	 * @param chunk_size The preferred chunk size, in samples. If 0, the pushthrough flag determines
-	 * the effective chunking.
+	 * the effective chunking. Can be changed later with set_flush_policy().
+	 * @param async_sender Send samples from the IO thread instead of one thread per session.
 	 */
-	tcp_server(stream_info_impl *info, io_context_p io, send_buffer_p sendbuf, factory_p factory,
-		int chunk_size, bool allow_v4, bool allow_v6);
+	tcp_server(stream_info_impl_p info, io_context_p io, send_buffer_p sendbuf, factory_p factory,
+		int chunk_size, bool allow_v4, bool allow_v6, bool async_sender = false);
 
 	/**
 	 * Begin serving TCP connections.
@@ -67,6 +85,20 @@ public:
 	 */
 	void end_serving();
 
+	/// Set the flush policy for sessions that start transferring samples afterwards.
+	void set_flush_policy(const flush_policy &policy);
+
+	/// Get the current flush policy.
+	flush_policy get_flush_policy();
+
+	/**
+	 * Keep the most recent samples in a ring buffer file, so reconnecting inlets can resume.
+	 * @param path The file, or an empty string to disable the history.
+	 * @param max_samples The number of samples to keep (estimated for string samples).
+	 * @throws std::runtime_error if the file couldn't be created.
+	 */
+	void set_history(const std::string &path, std::size_t max_samples);
+
 private:
 	friend class client_session;
 
@@ -79,14 +111,37 @@ private:
 
 	void unregister_inflight_session(client_session *session);
 
+	/// Keep a session that's served by the async sender alive until it unregisters.
+	void register_async_session(const std::shared_ptr<class client_session> &session);
+
+	void unregister_async_session(client_session *session);
+
 	/// Post a close of all in-flight sockets.
 	void close_inflight_sessions();
 
+	/**
+	 * Get the publisher for same-host inlets, creating it if necessary.
+	 * @param max_buffered The maximum number of samples the first inlet wants to be buffered.
+	 * @return The publisher, or nullptr if it couldn't be created.
+	 */
+	std::shared_ptr<class shm_publisher> get_shm_publisher(int max_buffered);
+
+	/// The file of the sample history, or an empty string if there's none.
+	std::string history_path();
+
+	/// The size of a ring holding `num_samples` samples.
+	std::size_t ring_bytes(std::size_t num_samples) const;
+
 	// data used by the transfer threads
-	int chunk_size_; // the chunk size to use (or 0)
+	bool async_sender_; // whether sessions are served by the IO thread instead of own threads
+	flush_policy flush_policy_;	// when the sessions send off buffered samples
+	std::mutex flush_policy_mut_; // mutex protecting the flush policy
+	// number of sessions sending converted samples (strings or swapped bytes), per byte order;
+	// they only share the samples' serializations if there are several of them
+	std::shared_ptr<std::atomic<int>> converting_sessions_[2];
 
 	// data shared with the outlet
-	stream_info_impl *info_; // shared stream_info object
+	stream_info_impl_p info_; // shared stream_info object
 	io_context_p io_;	// shared ptr to IO service; ensures that the IO is still around by the time
 						// the acceptor needs to be destroyed
 	factory_p factory_; // reference to the sample factory (which owns the samples)
@@ -98,6 +153,14 @@ private:
 	// registry of in-flight asessions (for cancellation)
 	std::map<void *, std::weak_ptr<client_session>> inflight_;
 	std::recursive_mutex inflight_mut_; // mutex protecting the registry from concurrent access
+	// sessions served by the async sender (owned here while waiting for samples)
+	std::map<void *, std::shared_ptr<client_session>> async_sessions_;
+
+	// shared memory transport, owned by the sessions using it
+	std::weak_ptr<class shm_publisher> shm_publisher_;
+	// history of the most recent samples for resuming inlets (see set_history())
+	std::shared_ptr<class shm_publisher> history_;
+	std::mutex shm_mut_; // mutex protecting the publishers
 };
 } // namespace lsl
 
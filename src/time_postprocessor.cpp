@@ -1,5 +1,6 @@
 #include "time_postprocessor.h"
 #include "api_config.h"
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include <utility>
@@ -17,13 +18,13 @@ using namespace lsl;
 /// how many samples have to be seen between clocksyncs?
 const uint8_t samples_between_clocksyncs = 50;
 
-time_postprocessor::time_postprocessor(postproc_callback_t query_correction,
+time_postprocessor::time_postprocessor(correction_callback_t query_correction,
 	postproc_callback_t query_srate, reset_callback_t query_reset)
 	: samples_since_last_clocksync(samples_between_clocksyncs),
 	  query_srate_(std::move(query_srate)), options_(proc_none),
 	  halftime_(api_config::get_instance()->smoothing_halftime()),
 	  query_correction_(std::move(query_correction)), query_reset_(std::move(query_reset)),
-	  next_query_time_(0.0), last_offset_(0.0), last_value_(std::numeric_limits<double>::lowest()) {
+	  next_query_time_(0.0), last_value_(std::numeric_limits<double>::lowest()) {
 }
 
 void time_postprocessor::set_options(uint32_t options)
@@ -63,11 +64,11 @@ double time_postprocessor::process_internal(double value) {
 		// second)
 		if (++samples_since_last_clocksync > samples_between_clocksyncs &&
 			lsl_clock() > next_query_time_) {
-			last_offset_ = query_correction_();
+			correction_ = query_correction_();
 			samples_since_last_clocksync = 0;
 			if (query_reset_()) {
 				// reset state to unitialized
-				last_offset_ = query_correction_();
+				correction_ = query_correction_();
 				last_value_ = std::numeric_limits<double>::lowest();
 				// reset the dejitterer to an uninitialized state so it's
 				// initialized on the next use
@@ -75,10 +76,10 @@ double time_postprocessor::process_internal(double value) {
 			}
 			next_query_time_ = lsl_clock() + 0.5;
 		}
-		// perform clock synchronization; this is done by adding the last-measured clock offset
-		// value (typically this is used to map the value from the sender's clock to our local
-		// clock)
-		value += last_offset_;
+		// perform clock synchronization; this is done by adding the clock offset at the time of
+		// the sample as predicted by the last correction (typically this is used to map the value
+		// from the sender's clock to our local clock)
+		value += correction_.at(value);
 	}
 
 	// --- jitter removal ---
@@ -130,6 +131,35 @@ double postproc_dejitterer::dejitter(double t) noexcept {
 	return w0_ + u1 * w1_ + t0_;			 // t = float(w.T * u) + t0
 }
 
+void clock_drift_model::add(double remote_time, double correction, double uncertainty) {
+	// the floor keeps a single, unrealistically fast round trip from being the only one that counts
+	const double u = std::max(uncertainty, 1e-6);
+	points_.push_back(point{remote_time, correction, 1 / (u * u)});
+	while (points_.size() > window_) points_.pop_front();
+}
+
+clock_correction clock_drift_model::fit() const {
+	if (points_.empty()) return {};
+	// weighted means; the fit is centered on the mean time for better numerics
+	double w_sum = 0, t_mean = 0, c_mean = 0;
+	for (const auto &p : points_) w_sum += p.weight;
+	for (const auto &p : points_) {
+		t_mean += p.weight / w_sum * p.t;
+		c_mean += p.weight / w_sum * p.correction;
+	}
+	if (points_.size() < 3) return {c_mean, 0, t_mean};
+
+	double s_tt = 0, s_tc = 0;
+	for (const auto &p : points_) {
+		s_tt += p.weight * (p.t - t_mean) * (p.t - t_mean);
+		s_tc += p.weight * (p.t - t_mean) * (p.correction - c_mean);
+	}
+	const double skew = s_tt > 0 ? s_tc / s_tt : 0;
+	// an implausible skew: go with the latest measurement until the adjustment is out of the window
+	if (std::abs(skew) > max_skew) return {points_.back().correction, 0, points_.back().t};
+	return {c_mean, skew, t_mean};
+}
+
 void postproc_dejitterer::skip_samples(uint_fast32_t skipped_samples) noexcept {
 	samples_since_t0_ += skipped_samples;
 }
@@ -3,13 +3,70 @@
 
 #include "common.h"
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <mutex>
 
 namespace lsl {
 
+/**
+ * The correction that maps remote time stamps to the local clock.
+ *
+ * It's a linear function of the remote time, so the drift of the remote clock (its skew) is
+ * accounted for between two clock offset measurements.
+ */
+struct clock_correction {
+	/// the correction at the remote time t_ref
+	double offset{0};
+	/// the change of the correction per second of remote time
+	double skew{0};
+	double t_ref{0};
+
+	/// A correction by `offset` (constant if `skew` is zero)
+	clock_correction(double offset = 0, double skew = 0, double t_ref = 0)
+		: offset(offset), skew(skew), t_ref(t_ref) {}
+
+	/// The correction for a time stamp of the remote clock
+	double at(double remote_time) const noexcept { return offset + skew * (remote_time - t_ref); }
+};
+
+/**
+ * Estimates the offset and the skew of a remote clock with a weighted least squares fit over the
+ * most recent clock offset measurements.
+ *
+ * The measurements are weighted by the inverse square of their uncertainty (the round trip time),
+ * so quick round trips dominate just like the best estimate of a single measurement wave does.
+ */
+class clock_drift_model {
+public:
+	/// @param window The number of measurements the fit is calculated from.
+	explicit clock_drift_model(std::size_t window = 30) : window_(window) {}
+
+	/// Add a measurement: the `correction` observed at `remote_time` with an `uncertainty` (RTT).
+	void add(double remote_time, double correction, double uncertainty);
+
+	/// Forget all measurements, e.g. because the remote clock has been reset.
+	void reset() { points_.clear(); }
+
+	/// The fitted correction; the skew is only estimated from three or more measurements.
+	clock_correction fit() const;
+
+	std::size_t size() const { return points_.size(); }
+
+	/// the largest plausible skew; more likely means a clock has been adjusted
+	static constexpr double max_skew = 500e-6;
+
+private:
+	struct point {
+		double t, correction, weight;
+	};
+	std::deque<point> points_;
+	std::size_t window_;
+};
+
 /// A callback function that allows the post-processor to query state from other objects if needed
 using postproc_callback_t = std::function<double()>;
+using correction_callback_t = std::function<clock_correction()>;
 using reset_callback_t = std::function<bool()>;
 
 /// Dejitter / smooth timestamps with a first order recursive least squares filter (RLS).
@@ -41,7 +98,7 @@ struct postproc_dejitterer {
 class time_postprocessor {
 public:
 	/// Construct a new time post-processor given some callback functions.
-	time_postprocessor(postproc_callback_t query_correction, postproc_callback_t query_srate,
+	time_postprocessor(correction_callback_t query_correction, postproc_callback_t query_srate,
 		reset_callback_t query_reset);
 
 	/**
@@ -81,14 +138,14 @@ private:
 	float halftime_;
 
 	// handling of time corrections
-	/// a callback function that returns the current time-correction offset
-	postproc_callback_t query_correction_;
+	/// a callback function that returns the current time correction
+	correction_callback_t query_correction_;
 	/// a callback function that returns whether the clock was reset
 	reset_callback_t query_reset_;
 	/// the next time when we query the time-correction offset
 	double next_query_time_;
-	/// last queried correction offset
-	double last_offset_;
+	/// last queried time correction
+	clock_correction correction_;
 
 	postproc_dejitterer dejitter;
 
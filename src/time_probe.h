@@ -0,0 +1,67 @@
+#ifndef TIME_PROBE_H
+#define TIME_PROBE_H
+
+#include <boost/endian/conversion.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace lsl {
+
+/**
+ * A time synchronization probe in the binary format.
+ *
+ * The inlet sends the probe with its wave id and the time of transmission (t0), the outlet fills
+ * in the time of reception (t1) and of its reply (t2) and sends it back in place, so neither side
+ * has to format or parse text. All fields are little endian.
+ * Outlets that don't know the format ignore the probe, so inlets also send text probes until they
+ * received a binary reply (see time_receiver).
+ */
+struct time_probe {
+	/// the size of a probe on the wire: magic, wave id and three time stamps
+	static constexpr std::size_t size = 4 + 4 + 3 * 8;
+	/// the first bytes of a probe; text requests start with "LSL:" instead
+	static const char *magic() { return "LSLt"; }
+
+	uint32_t wave_id{0};
+	double t0{0}, t1{0}, t2{0};
+
+	/// Write the probe to `buf`, which has room for `size` bytes.
+	void write(char *buf) const {
+		memcpy(buf, magic(), 4);
+		put(buf + 4, lslboost::endian::native_to_little(wave_id));
+		put_double(buf + 8, t0);
+		put_double(buf + 16, t1);
+		put_double(buf + 24, t2);
+	}
+
+	/// Read a probe from a received packet. @return false if the packet isn't a binary probe.
+	bool read(const char *buf, std::size_t len) {
+		if (len != size || memcmp(buf, magic(), 4) != 0) return false;
+		wave_id = lslboost::endian::little_to_native(get<uint32_t>(buf + 4));
+		t0 = get_double(buf + 8);
+		t1 = get_double(buf + 16);
+		t2 = get_double(buf + 24);
+		return true;
+	}
+
+private:
+	template <typename T> static void put(char *dst, T value) { memcpy(dst, &value, sizeof(T)); }
+	template <typename T> static T get(const char *src) {
+		T value;
+		memcpy(&value, src, sizeof(T));
+		return value;
+	}
+	static void put_double(char *dst, double value) {
+		const auto bits = get<uint64_t>(reinterpret_cast<const char *>(&value));
+		put(dst, lslboost::endian::native_to_little(bits));
+	}
+	static double get_double(const char *src) {
+		const uint64_t bits = lslboost::endian::little_to_native(get<uint64_t>(src));
+		return get<double>(reinterpret_cast<const char *>(&bits));
+	}
+};
+
+} // namespace lsl
+
+#endif
@@ -3,6 +3,8 @@
 #include "inlet_connection.h"
 #include "socket_utils.h"
 #include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <algorithm>
 #include <chrono>
 #include <exception>
 #include <limits>
@@ -21,17 +23,21 @@ time_receiver::time_receiver(inlet_connection &conn)
 	  remote_time_(std::numeric_limits<double>::max()),
 	  uncertainty_(std::numeric_limits<double>::max()), cfg_(api_config::get_instance()),
 	  time_sock_(time_io_), outlet_addr_(conn_.get_udp_endpoint()), next_estimate_(time_io_),
-	  aggregate_results_(time_io_), next_packet_(time_io_) {
+	  aggregate_results_(time_io_), next_packet_(time_io_),
+	  drift_model_(static_cast<std::size_t>(std::max(cfg_->time_drift_window(), 1))) {
 	conn_.register_onlost(this, &timeoffset_upd_);
 	conn_.register_onrecover(this, [this]() {
 		reset_timeoffset_on_recovery();
 		outlet_addr_ = conn_.get_udp_endpoint();
 		DLOG_F(INFO, "Set new time service address: %s", outlet_addr_.address().to_string().c_str());
+		// the new outlet might not understand the same probe formats; the flags belong to the
+		// time thread, so they're reset there
+		asio::post(time_io_, [this]() { send_binary_ = send_text_ = true; });
 		// handle outlet switching between IPv4 and IPv6
 		time_sock_.close();
-		time_sock_.open(outlet_addr_.protocol());
+		open_socket();
 	});
-	time_sock_.open(outlet_addr_.protocol());
+	open_socket();
 }
 
 time_receiver::~time_receiver() {
@@ -46,6 +52,14 @@ time_receiver::~time_receiver() {
 }
 
 
+void time_receiver::open_socket() {
+	time_sock_.open(outlet_addr_.protocol());
+#ifdef LSL_RX_TIMESTAMPS
+	// with the time the kernel received a reply, our scheduling delay doesn't count as t3
+	rx_timestamps_ = cfg_->kernel_timestamps() && enable_rx_timestamps(time_sock_);
+#endif
+}
+
 // === external data acccess ===
 
 double time_receiver::time_correction(double timeout) {
@@ -55,6 +69,19 @@ double time_receiver::time_correction(double timeout) {
 
 double time_receiver::time_correction(double *remote_time, double *uncertainty, double timeout) {
 	std::unique_lock<std::mutex> lock(timeoffset_mut_);
+	wait_for_estimate(lock, timeout);
+	*remote_time = remote_time_;
+	*uncertainty = uncertainty_;
+	return timeoffset_;
+}
+
+clock_correction time_receiver::correction_model(double timeout) {
+	std::unique_lock<std::mutex> lock(timeoffset_mut_);
+	wait_for_estimate(lock, timeout);
+	return correction_;
+}
+
+void time_receiver::wait_for_estimate(std::unique_lock<std::mutex> &lock, double timeout) {
 	auto timeoffset_available = [this]() {
 		return (timeoffset_ != std::numeric_limits<double>::max()) || conn_.lost();
 	};
@@ -71,9 +98,6 @@ double time_receiver::time_correction(double *remote_time, double *uncertainty,
 	if (conn_.lost())
 		throw lost_error("The stream read by this inlet has been lost. To recover, you need to "
 						 "re-resolve the source and re-create the inlet.");
-	*remote_time = remote_time_;
-	*uncertainty = uncertainty_;
-	return timeoffset_;
 }
 
 bool time_receiver::was_reset() {
@@ -111,9 +135,12 @@ void time_receiver::start_time_estimation() {
 	// clear the estimates buffer
 	estimates_.clear();
 	estimate_times_.clear();
+	text_estimates_.clear();
+	text_estimate_times_.clear();
 	// generate a new wave id so that we don't confuse packets from earlier (or mis-guided)
 	// estimations
 	current_wave_id_ = std::rand();
+	binary_replies_ = 0;
 	// start the packet exchange chains
 	send_next_packet(1);
 	receive_next_packet();
@@ -130,15 +157,26 @@ void time_receiver::start_time_estimation() {
 
 void time_receiver::send_next_packet(int packet_num) {
 	try {
-		// form the request & send it
-		std::ostringstream request;
-		request.precision(16);
-		request << "LSL:timedata\r\n" << current_wave_id_ << " " << lsl_clock() << "\r\n";
-		auto msg_buffer = std::make_shared<std::string>(request.str());
-		time_sock_.async_send_to(asio::buffer(*msg_buffer), outlet_addr_,
-			[msg_buffer](err_t /*unused*/, std::size_t /*unused*/) {
-				/* Do nothing, but keep the msg_buffer alive until async_send is completed */
-			});
+		if (send_binary_) {
+			// the buffer is only reused for the next probe, long after this one has been sent
+			time_probe probe;
+			probe.wave_id = static_cast<uint32_t>(current_wave_id_);
+			probe.t0 = lsl_clock();
+			probe.write(probe_buffer_);
+			time_sock_.async_send_to(asio::buffer(probe_buffer_), outlet_addr_,
+				[](err_t /*unused*/, std::size_t /*unused*/) {});
+		}
+		if (send_text_) {
+			// form the request & send it
+			std::ostringstream request;
+			request.precision(16);
+			request << "LSL:timedata\r\n" << current_wave_id_ << " " << lsl_clock() << "\r\n";
+			auto msg_buffer = std::make_shared<std::string>(request.str());
+			time_sock_.async_send_to(asio::buffer(*msg_buffer), outlet_addr_,
+				[msg_buffer](err_t /*unused*/, std::size_t /*unused*/) {
+					/* Do nothing, but keep the msg_buffer alive until async_send is completed */
+				});
+		}
 	} catch (std::exception &e) {
 		LOG_F(WARNING, "Error trying to send a time packet: %s", e.what());
 	}
@@ -152,41 +190,81 @@ void time_receiver::send_next_packet(int packet_num) {
 }
 
 void time_receiver::receive_next_packet() {
+#ifdef LSL_RX_TIMESTAMPS
+	if (rx_timestamps_) {
+		// receive the replies ourselves, so t3 is the time the kernel received them
+		time_sock_.async_wait(udp_socket::wait_read, [this](err_t err) {
+			double t3;
+			long len;
+			while (!err && (len = receive_timestamped(time_sock_, recv_buffer_,
+								sizeof(recv_buffer_), remote_endpoint_, t3)) >= 0)
+				process_reply(static_cast<std::size_t>(len), t3);
+			if (err != asio::error::operation_aborted) receive_next_packet();
+		});
+		return;
+	}
+#endif
 	time_sock_.async_receive_from(asio::buffer(recv_buffer_), remote_endpoint_,
 		[this](err_t err, std::size_t len) { handle_receive_outcome(err, len); });
 }
 
 void time_receiver::handle_receive_outcome(err_t err, std::size_t len) {
+	if (!err) process_reply(len, lsl_clock());
+	if (err != asio::error::operation_aborted) receive_next_packet();
+}
+
+void time_receiver::process_reply(std::size_t len, double t3) {
 	try {
-		if (!err) {
+		double t0, t1, t2;
+		bool current_wave = false;
+		time_probe probe;
+		const bool binary = probe.read(recv_buffer_, len);
+		if (binary) {
+			// binary reply: the outlet understands binary probes, so text isn't needed anymore
+			current_wave = probe.wave_id == static_cast<uint32_t>(current_wave_id_);
+			t0 = probe.t0;
+			t1 = probe.t1;
+			t2 = probe.t2;
+			++binary_replies_;
+			send_text_ = false;
+		} else {
 			// parse the buffer contents
 			std::istringstream is(std::string(recv_buffer_, len));
 			int wave_id;
 			is >> wave_id;
-			if (wave_id == current_wave_id_) {
-				double t0, t1, t2, t3 = lsl_clock();
-				is >> t0 >> t1 >> t2;
-				// calculate RTT and offset
-				double rtt =
-					(t3 - t0) - (t2 - t1); // round trip time (time passed here - time passed there)
-				double offset =
-					((t1 - t0) + (t2 - t3)) /
-					2; // averaged clock offset (other clock - my clock) with rtt bias averaged out
-				// store it
-				estimates_.push_back(std::make_pair(rtt, offset));
-				estimate_times_.push_back(
-					std::make_pair((t3 + t0) / 2.0, (t2 + t1) / 2.0)); // local_time, remote_time
-			}
+			current_wave = wave_id == current_wave_id_;
+			is >> t0 >> t1 >> t2;
+		}
+		if (current_wave) {
+			// calculate RTT and offset
+			double rtt =
+				(t3 - t0) - (t2 - t1); // round trip time (time passed here - time passed there)
+			double offset =
+				((t1 - t0) + (t2 - t3)) /
+				2; // averaged clock offset (other clock - my clock) with rtt bias averaged out
+			conn_.metrics().rtt_us.record(static_cast<uint64_t>(std::max(rtt, 0.0) * 1e6));
+			// store it; while both formats are probed, each probe can get two replies, so the
+			// text replies are only used if there are no binary ones
+			const bool both_probed = send_binary_ && !binary;
+			(both_probed ? text_estimates_ : estimates_).push_back(std::make_pair(rtt, offset));
+			(both_probed ? text_estimate_times_ : estimate_times_)
+				.push_back(std::make_pair((t3 + t0) / 2.0, (t2 + t1) / 2.0)); // local, remote
 		}
 	} catch (std::exception &e) {
 		LOG_F(WARNING, "Error while processing a time estimation return packet: %s", e.what());
 	}
-	if (err != asio::error::operation_aborted) receive_next_packet();
 }
 
 void time_receiver::result_aggregation_scheduled(err_t err) {
 	if (err) return;
 
+	// replies, but none to the binary probes: the outlet predates them
+	if (send_binary_ && send_text_ && binary_replies_ == 0 && !text_estimates_.empty()) {
+		send_binary_ = false;
+		estimates_.swap(text_estimates_);
+		estimate_times_.swap(text_estimate_times_);
+	}
+
 	if ((int)estimates_.size() >= cfg_->time_update_minprobes()) {
 		// take the estimate with the lowest error bound (=rtt), as in NTP
 		double best_offset = 0, best_rtt = FOREVER;
@@ -204,7 +282,13 @@ void time_receiver::result_aggregation_scheduled(err_t err) {
 			uncertainty_ = best_rtt;
 			timeoffset_ = -best_offset;
 			remote_time_ = best_remote_time;
+			if (reset_drift_model_) drift_model_.reset();
+			reset_drift_model_ = false;
+			drift_model_.add(best_remote_time, -best_offset, best_rtt);
+			correction_ = drift_model_.fit();
 		}
+		conn_.metrics().time_correction.set(-best_offset);
+		conn_.metrics().time_uncertainty.set(best_rtt);
 		timeoffset_upd_.notify_all();
 	}
 }
@@ -216,4 +300,5 @@ void time_receiver::reset_timeoffset_on_recovery() {
 		// obtained time offsets
 		was_reset_ = true;
 	timeoffset_ = NOT_ASSIGNED;
+	reset_drift_model_ = true;
 }
@@ -2,6 +2,8 @@
 #define TIME_RECEIVER_H
 
 #include "socket_utils.h"
+#include "time_postprocessor.h"
+#include "time_probe.h"
 #include <asio/io_context.hpp>
 #include <asio/ip/udp.hpp>
 #include <asio/steady_timer.hpp>
@@ -54,6 +56,14 @@ public:
 	double time_correction(double timeout = 2);
 	double time_correction(double *remote_time, double *uncertainty, double timeout);
 
+	/**
+	 * Retrieve the time correction as a function of the remote time, which accounts for the drift
+	 * of the remote clock between the estimates (see clock_drift_model).
+	 * @param timeout Timeout for the first time-correction estimate.
+	 * @throws timeout_error If the initial estimate times out.
+	 */
+	clock_correction correction_model(double timeout = 2);
+
 	/**
 	 * Determine whether the clock was (potentially) reset since the last call to was_reset()
 	 *
@@ -63,6 +73,9 @@ public:
 	bool was_reset();
 
 private:
+	/// Wait until the first time offset is available, see time_correction().
+	void wait_for_estimate(std::unique_lock<std::mutex> &lock, double timeout);
+
 	/// The time reader / updater thread.
 	void time_thread();
 
@@ -78,6 +91,12 @@ private:
 	/// Handler that gets called once reception of a time packet has completed
 	void handle_receive_outcome(err_t err, std::size_t len);
 
+	/// Process the reply in recv_buffer_ that was received at (local) time t3
+	void process_reply(std::size_t len, double t3);
+
+	/// (Re)open the socket for the outlet's protocol
+	void open_socket();
+
 	/// Handlers that gets called once the time estimation results shall be aggregated.
 	void result_aggregation_scheduled(err_t err);
 
@@ -99,6 +118,10 @@ private:
 	double remote_time_;
 	/// round trip time (a.k.a. uncertainty) at the specficied timeoffset_
 	double uncertainty_;
+	/// the correction fitted to the recent time offsets
+	clock_correction correction_;
+	/// whether the drift model has to forget the offsets of a previous connection
+	bool reset_drift_model_{false};
 	/// mutex to protect the time offset
 	std::mutex timeoffset_mut_;
 	/// condition variable to indicate that an update for the time offset is available
@@ -128,8 +151,20 @@ private:
 	estimate_list estimates_;
 	/// a vector of the local time and the remote time at a given estimate
 	estimate_list estimate_times_;
+	/// estimates from text replies while binary probes are sent as well, see process_reply()
+	estimate_list text_estimates_, text_estimate_times_;
+	/// the model of the remote clock, fitted to the best estimate of each exchange
+	clock_drift_model drift_model_;
 	/// an id for the current wave of time packets
 	int current_wave_id_{0};
+	/// the probe formats to send: both until the outlet's replies tell which one it understands
+	bool send_binary_{true}, send_text_{true};
+	/// the number of binary replies received during the current exchange
+	int binary_replies_{0};
+	/// whether the kernel time stamps received replies (see enable_rx_timestamps())
+	bool rx_timestamps_{false};
+	/// the last binary probe that was sent
+	char probe_buffer_[time_probe::size]{0};
 };
 } // namespace lsl
 
@@ -0,0 +1,121 @@
+#include "trace.h"
+
+#ifdef LSL_TRACE
+#include "common.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+using namespace lsl;
+
+namespace {
+/// The most recent events of one thread, written only by that thread
+struct trace_ring {
+	static constexpr uint64_t size = 1 << 16;
+
+	explicit trace_ring(uint32_t thread) : thread(thread) {}
+
+	const uint32_t thread;
+	/// number of events recorded so far; the last `size` of them are kept
+	std::atomic<uint64_t> written{0};
+	/// number of events discarded by trace_clear()
+	std::atomic<uint64_t> cleared{0};
+	std::array<trace_event, size> events;
+};
+
+struct trace_registry {
+	std::mutex mut;
+	std::vector<std::shared_ptr<trace_ring>> rings;
+};
+
+trace_registry &registry() {
+	// never destroyed, so threads can still record events during the static destruction
+	static auto *instance = new trace_registry();
+	return *instance;
+}
+
+trace_ring &this_thread_ring() {
+	// the registry keeps the ring of a thread that has exited, so its events can be exported
+	thread_local trace_ring *ring = [] {
+		trace_registry &reg = registry();
+		std::lock_guard<std::mutex> lock(reg.mut);
+		reg.rings.push_back(std::make_shared<trace_ring>(static_cast<uint32_t>(reg.rings.size())));
+		return reg.rings.back().get();
+	}();
+	return *ring;
+}
+} // namespace
+#endif
+
+const char *lsl::trace_stage_name(trace_stage stage) {
+	switch (stage) {
+	case trace_stage::enqueue: return "enqueue";
+	case trace_stage::dequeue: return "dequeue";
+	case trace_stage::written: return "written";
+	case trace_stage::received: return "received";
+	case trace_stage::pulled: return "pulled";
+	}
+	return "unknown";
+}
+
+#ifdef LSL_TRACE
+void lsl::trace_point(trace_stage stage, double key) noexcept {
+	trace_ring &ring = this_thread_ring();
+	const uint64_t pos = ring.written.load(std::memory_order_relaxed);
+	ring.events[pos % trace_ring::size] = trace_event{lsl_clock(), key, ring.thread, stage};
+	ring.written.store(pos + 1, std::memory_order_release);
+}
+
+std::vector<trace_event> lsl::trace_events() {
+	std::vector<trace_event> result;
+	trace_registry &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mut);
+	for (const auto &ring : reg.rings) {
+		const uint64_t end = ring->written.load(std::memory_order_acquire);
+		if (end <= ring->cleared.load(std::memory_order_relaxed)) continue;
+		const uint64_t begin = std::max(end > trace_ring::size ? end - trace_ring::size : 0,
+			ring->cleared.load(std::memory_order_relaxed));
+		const std::size_t start = result.size();
+		for (uint64_t pos = begin; pos < end; ++pos)
+			result.push_back(ring->events[pos % trace_ring::size]);
+		// drop the events the thread overwrote while they were copied
+		const uint64_t now = ring->written.load(std::memory_order_acquire);
+		if (now > begin + trace_ring::size) {
+			const uint64_t overwritten = std::min(now - begin - trace_ring::size, end - begin);
+			result.erase(result.begin() + start, result.begin() + start + overwritten);
+		}
+	}
+	return result;
+}
+
+void lsl::trace_clear() {
+	trace_registry &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mut);
+	// rings of live threads can't be removed and only their threads write to them
+	for (const auto &ring : reg.rings)
+		ring->cleared.store(
+			ring->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+void lsl::trace_write_chrome(std::ostream &os) {
+	const auto events = trace_events();
+	const auto flags = os.flags();
+	os << std::fixed;
+	os.precision(3);
+	os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	for (std::size_t k = 0; k < events.size(); ++k) {
+		const trace_event &e = events[k];
+		os << (k ? ",\n" : "\n") << "{\"name\":\"" << trace_stage_name(e.stage)
+		   << "\",\"cat\":\"lsl\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << e.thread
+		   << ",\"ts\":" << e.time * 1e6;
+		os.precision(9);
+		os << ",\"args\":{\"timestamp\":" << e.key << "}}";
+		os.precision(3);
+	}
+	os << "\n]}\n";
+	os.flags(flags);
+}
+#endif
@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+/**
+ * @file trace.h Trace points along the path of a sample from the outlet to the inlet.
+ *
+ * When built with LSL_TRACE (CMake option `LSL_TRACE`), each trace point records the time it was
+ * passed together with the timestamp of the sample passing it, so the stages of a sample can be
+ * matched up afterwards. Otherwise, the trace points compile to nothing.
+ *
+ * Each thread records into its own ring of the most recent events without any locking; only the
+ * first event of a thread registers its ring.
+ */
+
+namespace lsl {
+
+/// The stages of the sample pipeline
+enum class trace_stage : uint8_t {
+	/// the sample was pushed into the send buffer (stream_outlet_impl)
+	enqueue,
+	/// a session took the sample from its queue to send it (client_session, shm_publisher)
+	dequeue,
+	/// the samples dequeued before by the same thread were written to the socket (or ring)
+	written,
+	/// the sample was deserialized by the inlet (data_receiver)
+	received,
+	/// the sample was returned by pull_sample() or pull_chunk() (stream_inlet_impl)
+	pulled
+};
+
+const char *trace_stage_name(trace_stage stage);
+
+/// A recorded trace point
+struct trace_event {
+	/// lsl_clock() when the trace point was passed
+	double time;
+	/// the (remote) timestamp of the sample, or 0 for stages concerning multiple samples
+	double key;
+	/// the recording thread, numbered in the order of their first event
+	uint32_t thread;
+	trace_stage stage;
+};
+
+#ifdef LSL_TRACE
+/// Record that the sample with timestamp `key` passed `stage`.
+void trace_point(trace_stage stage, double key) noexcept;
+
+/// Get the events recorded so far by all threads, ordered by thread and time.
+std::vector<trace_event> trace_events();
+
+/// Discard all recorded events.
+void trace_clear();
+
+/// Write the recorded events in the Chrome trace event format (chrome://tracing, Perfetto).
+void trace_write_chrome(std::ostream &os);
+
+#define LSL_TRACE_POINT(stage, key) ::lsl::trace_point(::lsl::trace_stage::stage, key)
+#else
+#define LSL_TRACE_POINT(stage, key) ((void)0)
+#endif
+
+} // namespace lsl
+
+#endif
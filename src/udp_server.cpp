@@ -2,7 +2,10 @@
 #include "api_config.h"
 #include "socket_utils.h"
 #include "stream_info_impl.h"
+#include "time_probe.h"
 #include "util/strfuns.hpp"
+#include <array>
+#include <cerrno>
 #include <asio/io_context.hpp>
 #include <asio/ip/address.hpp>
 #include <asio/ip/address_v4.hpp>
@@ -13,12 +16,37 @@
 #include <sstream>
 #include <utility>
 
+#ifdef LSL_UDP_BATCHING
+#include <sys/socket.h>
+#endif
+
 namespace ip = asio::ip;
 
 namespace lsl {
 
-udp_server::udp_server(stream_info_impl *info, asio::io_context &io, udp protocol)
-	: info_(info), io_(io), socket_(std::make_shared<udp_socket_p::element_type>(io)),
+#ifdef LSL_UDP_BATCHING
+struct udp_server::batch {
+	/// the maximum number of packets received (and probes answered) at once
+	static constexpr int size = 16;
+	/// the largest UDP payload
+	static constexpr std::size_t max_packet = 65536;
+
+	/// the packets' contents; not initialized, so only pages that ever held a packet are used
+	std::unique_ptr<char[]> data{new char[size * max_packet]};
+	/// the packets' senders
+	udp::endpoint sources[size];
+	/// the packets' receive time stamps
+	char control[size][rx_timestamp_control_size];
+	iovec iov[size];
+	mmsghdr msgs[size];
+	/// the replies to binary time probes, sent from the received packets' buffers
+	iovec reply_iov[size];
+	mmsghdr replies[size];
+};
+#endif
+
+udp_server::udp_server(stream_info_impl_p info, asio::io_context &io, udp protocol)
+	: info_(std::move(info)), io_(io), socket_(std::make_shared<udp_socket_p::element_type>(io)),
 	  time_services_enabled_(true) {
 	// open the socket for the specified protocol
 	socket_->open(protocol);
@@ -33,11 +61,17 @@ udp_server::udp_server(stream_info_impl *info, asio::io_context &io, udp protoco
 		info_->v6service_port(port);
 	LOG_F(2, "%s: Started unicast udp server at port %d (addr %p)", info_->name().c_str(), port,
 		(void *)this);
+#ifdef LSL_UDP_BATCHING
+	batch_ = std::make_unique<batch>();
+	// with the time the kernel received a probe, the outlet's scheduling delay doesn't count as t1
+	if (api_config::get_instance()->kernel_timestamps() && !enable_rx_timestamps(*socket_))
+		LOG_F(INFO, "Kernel receive time stamps aren't available for time probes");
+#endif
 }
 
-udp_server::udp_server(stream_info_impl *info, asio::io_context &io, ip::address addr,
+udp_server::udp_server(stream_info_impl_p info, asio::io_context &io, ip::address addr,
 	uint16_t port, int ttl, const std::string &listen_address)
-	: info_(info), io_(io), socket_(std::make_shared<udp_socket>(io)),
+	: info_(std::move(info)), io_(io), socket_(std::make_shared<udp_socket>(io)),
 	  time_services_enabled_(false) {
 	bool is_broadcast = addr == ip::address_v4::broadcast();
 
@@ -89,6 +123,8 @@ udp_server::udp_server(stream_info_impl *info, asio::io_context &io, ip::address
 		this->info_->name().c_str(), addr.to_string().c_str(), port, (void *)this);
 }
 
+udp_server::~udp_server() = default;
+
 // === externally issued asynchronous commands ===
 
 void udp_server::begin_serving() {
@@ -112,9 +148,18 @@ void udp_server::end_serving() {
 
 void udp_server::request_next_packet() {
 	DLOG_F(5, "udp_server::request_next_packet");
+#ifdef LSL_UDP_BATCHING
+	if (batch_) {
+		socket_->async_wait(udp_socket::wait_read, [weak_this = weak_from_this()](err_t err) {
+			if (auto this_ = weak_this.lock()) this_->handle_batch(err);
+		});
+		return;
+	}
+#endif
 	socket_->async_receive_from(asio::buffer(buffer_), remote_endpoint_,
-		[weak_this = weak_from_this()](
-			err_t err, std::size_t len) { weak_this.lock()->handle_receive_outcome(err, len); });
+		[weak_this = weak_from_this()](err_t err, std::size_t len) {
+			if (auto this_ = weak_this.lock()) this_->handle_receive_outcome(err, len);
+		});
 }
 
 void udp_server::process_shortinfo_request(std::istream& request_stream)
@@ -134,16 +179,17 @@ void udp_server::process_shortinfo_request(std::istream& request_stream)
 		LOG_F(3, "%p query matches, replying to port %d", (void *)this, return_port);
 		// query matches: send back reply
 		udp::endpoint return_endpoint(remote_endpoint_.address(), return_port);
-		string_p replymsg(
-			std::make_shared<std::string>((query_id += "\r\n") += info_->to_shortinfo_message()));
-		socket_->async_send_to(asio::buffer(*replymsg), return_endpoint,
-			[weak_this = weak_from_this(), replymsg](err_t err_, std::size_t /*unused*/) {
-				if (err_ != asio::error::operation_aborted && err_ != asio::error::shut_down)
-					weak_this.lock()->request_next_packet();
+		// the shortinfo is only rendered again after a change, so it's sent from the shared copy
+		string_p replyhead(std::make_shared<std::string>(query_id += "\r\n"));
+		auto shortinfo = info_->shortinfo_message();
+		const std::array<asio::const_buffer, 2> reply{
+			{asio::buffer(*replyhead), asio::buffer(*shortinfo)}};
+		socket_->async_send_to(reply, return_endpoint,
+			[replyhead, shortinfo](err_t /*unused*/, std::size_t /*unused*/) {
+				/* keep the reply alive until it's sent */
 			});
 	} else {
 		DLOG_F(2, "%p query didn't match", (void *)this);
-		request_next_packet();
 	}
 }
 
@@ -159,26 +205,35 @@ void udp_server::process_timedata_request(std::istream &request_stream, double t
 	reply << ' ' << wave_id << ' ' << t0 << ' ' << t1 << ' ' << lsl_clock();
 	string_p replymsg(std::make_shared<std::string>(reply.str()));
 	socket_->async_send_to(asio::buffer(*replymsg), remote_endpoint_,
-		[weak_this = weak_from_this(), replymsg](err_t err_, std::size_t /*unused*/) {
-			if (err_ != asio::error::operation_aborted && err_ != asio::error::shut_down)
-				weak_this.lock()->request_next_packet();
+		[replymsg](err_t /*unused*/, std::size_t /*unused*/) {
+			/* keep the reply alive until it's sent */
 		});
 }
 
 void udp_server::handle_receive_outcome(err_t err, std::size_t len) {
 	DLOG_F(6, "udp_server::handle_receive_outcome (%lub)", len);
-	if (err) {
-		// non-critical error? Wait for the next packet
-		if (err != asio::error::operation_aborted || err != asio::error::shut_down)
-			request_next_packet();
-		return;
-	}
-	try {
+	if (err == asio::error::operation_aborted || !socket_->is_open()) return;
+	if (!err) {
 		// remember the time of packet reception for possible later use
 		double t1 = time_services_enabled_ ? lsl_clock() : 0.0;
+		time_probe probe;
+		if (time_services_enabled_ && probe.read(buffer_, len)) {
+			// binary time probe: reply right away from the receive buffer
+			probe.t1 = t1;
+			probe.t2 = lsl_clock();
+			probe.write(buffer_);
+			asio::error_code send_err;
+			socket_->send_to(asio::buffer(buffer_, time_probe::size), remote_endpoint_, 0, send_err);
+		} else
+			process_request(buffer_, len, t1);
+	}
+	request_next_packet();
+}
 
+void udp_server::process_request(const char *data, std::size_t len, double t1) {
+	try {
 		// wrap received packet into a request stream and parse the method from it
-		std::istringstream request_stream(std::string(buffer_, buffer_ + len));
+		std::istringstream request_stream(std::string(data, data + len));
 		std::string method;
 		getline(request_stream, method);
 		method = trim(method);
@@ -197,6 +252,61 @@ void udp_server::handle_receive_outcome(err_t err, std::size_t len) {
 		LOG_F(
 			WARNING, "%p udp_server: hiccup during request processing: %s", (void *)this, e.what());
 	}
+}
+
+#ifdef LSL_UDP_BATCHING
+void udp_server::handle_batch(err_t err) {
+	if (err == asio::error::operation_aborted || !socket_->is_open()) return;
+	if (!err) {
+		batch &b = *batch_;
+		for (int k = 0; k < batch::size; ++k) {
+			b.iov[k] = {b.data.get() + k * batch::max_packet, batch::max_packet};
+			b.msgs[k] = {};
+			b.msgs[k].msg_hdr.msg_name = b.sources[k].data();
+			b.msgs[k].msg_hdr.msg_namelen = static_cast<socklen_t>(b.sources[k].capacity());
+			b.msgs[k].msg_hdr.msg_iov = &b.iov[k];
+			b.msgs[k].msg_hdr.msg_iovlen = 1;
+			b.msgs[k].msg_hdr.msg_control = b.control[k];
+			b.msgs[k].msg_hdr.msg_controllen = sizeof(b.control[k]);
+		}
+		const int received =
+			recvmmsg(socket_->native_handle(), b.msgs, batch::size, MSG_DONTWAIT, nullptr);
+		const double now = lsl_clock();
+
+		// answer the binary time probes in place and all at once, process anything else as usual
+		unsigned int n_replies = 0;
+		time_probe probes[batch::size];
+		for (int k = 0; k < received; ++k) {
+			char *packet = static_cast<char *>(b.iov[k].iov_base);
+			b.sources[k].resize(b.msgs[k].msg_hdr.msg_namelen);
+			const double t1 = rx_timestamp(b.msgs[k].msg_hdr, now);
+			if (probes[n_replies].read(packet, b.msgs[k].msg_len)) {
+				probes[n_replies].t1 = t1;
+				b.reply_iov[n_replies] = {packet, time_probe::size};
+				b.replies[n_replies] = {};
+				b.replies[n_replies].msg_hdr.msg_name = b.sources[k].data();
+				b.replies[n_replies].msg_hdr.msg_namelen = b.msgs[k].msg_hdr.msg_namelen;
+				b.replies[n_replies].msg_hdr.msg_iov = &b.reply_iov[n_replies];
+				b.replies[n_replies].msg_hdr.msg_iovlen = 1;
+				++n_replies;
+			} else {
+				remote_endpoint_ = b.sources[k];
+				process_request(packet, b.msgs[k].msg_len, t1);
+			}
+		}
+		if (n_replies) {
+			const double t2 = lsl_clock();
+			for (unsigned int k = 0; k < n_replies; ++k) {
+				probes[k].t2 = t2;
+				probes[k].write(static_cast<char *>(b.reply_iov[k].iov_base));
+			}
+			if (sendmmsg(socket_->native_handle(), b.replies, n_replies, MSG_DONTWAIT) < 0) {
+				DLOG_F(WARNING, "%p Couldn't reply to %u time probes (%d)", (void *)this, n_replies,
+					errno);
+			}
+		}
+	}
 	request_next_packet();
 }
+#endif
 } // namespace lsl
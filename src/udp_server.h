@@ -9,6 +9,11 @@
 #include <memory>
 #include <string>
 
+// on Linux, bursts of time probes are received and answered with one system call
+#if defined(__linux__)
+#define LSL_UDP_BATCHING
+#endif
+
 using asio::ip::udp;
 using err_t = const asio::error_code &;
 
@@ -25,6 +30,8 @@ using udp_socket_p = std::shared_ptr<udp_socket>;
  *  - `LSL:timedata`. This is a request for time synchronization info that comes with a time stamp
  * (t0). The t0 stamp and two more time stamps (t1 and t2) are returned (similar to the NTP packet
  * exchange).
+ *  - binary time probes (see time_probe), which are answered like `LSL:timedata` requests but
+ * without any text processing.
  */
 class udp_server : public std::enable_shared_from_this<udp_server> {
 public:
@@ -38,7 +45,7 @@ public:
 	 * @param io asio::io_context that runs the server's async operations
 	 * @param protocol The protocol stack to use (tcp::v4() or tcp::v6()).
 	 */
-	udp_server(stream_info_impl *info, asio::io_context &io, udp protocol);
+	udp_server(stream_info_impl_p info, asio::io_context &io, udp protocol);
 
 	/**
 	 * Create a new UDP server in multicast mode.
@@ -46,9 +53,10 @@ public:
 	 * This server will listen on a multicast address and responds only to LSL:shortinfo requests.
 	 * This is for multicast/broadcast (and optionally unicast) local service discovery.
 	 */
-	udp_server(stream_info_impl *info, asio::io_context &io, asio::ip::address addr,
+	udp_server(stream_info_impl_p info, asio::io_context &io, asio::ip::address addr,
 		uint16_t port, int ttl, const std::string &listen_address);
 
+	~udp_server();
 
 	/// Start serving UDP traffic.
 	/// Call this only after the (shared) info object has been initialized by every involved party.
@@ -65,6 +73,14 @@ private:
 	/// Handler that gets called when a the next packet was received (or the op was cancelled).
 	void handle_receive_outcome(err_t err, std::size_t len);
 
+	/// Process a text request received from remote_endpoint_ at (local) time t1.
+	void process_request(const char *data, std::size_t len, double t1);
+
+#ifdef LSL_UDP_BATCHING
+	/// Handler that gets called when the socket is readable: receive and process a batch.
+	void handle_batch(err_t err);
+#endif
+
 	/// Parse and process a LSL::shortinfo request
 	void process_shortinfo_request(std::istream& request_stream);
 
@@ -72,7 +88,7 @@ private:
 	void process_timedata_request(std::istream& request_stream, double t1);
 
 	/// stream_info reference
-	stream_info_impl *info_;
+	stream_info_impl_p info_;
 	/// IO service reference
 	asio::io_context &io_;
 	udp_socket_p socket_;
@@ -82,6 +98,11 @@ private:
 	bool time_services_enabled_;
 	/// the endpoint that we're currently talking to)
 	udp::endpoint remote_endpoint_;
+#ifdef LSL_UDP_BATCHING
+	/// buffers and message headers for batches of packets (only for time services)
+	struct batch;
+	std::unique_ptr<batch> batch_;
+#endif
 };
 } // namespace lsl
 
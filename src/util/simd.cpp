@@ -0,0 +1,478 @@
+#include "simd.hpp"
+#include <atomic>
+#include <boost/endian/conversion.hpp>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) ||                              \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LSL_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LSL_TARGET_AVX2
+#else
+#define LSL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define LSL_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace lsl::simd;
+using std::size_t;
+
+namespace {
+
+/// IEEE754 exponent and magnitude masks for the subnormal suppression
+const uint32_t exp32 = UINT32_C(0x7f800000), abs32 = UINT32_C(0x7fffffff);
+const uint64_t exp64 = UINT64_C(0x7ff0000000000000), abs64 = UINT64_C(0x7fffffffffffffff);
+
+template <typename T, typename U> void convert_scalar(const T *src, U *dst, size_t n) noexcept {
+	for (size_t i = 0; i < n; ++i) dst[i] = static_cast<U>(src[i]);
+}
+
+template <typename T> void byteswap_scalar(T *data, size_t n) noexcept {
+	for (size_t i = 0; i < n; ++i) lslboost::endian::endian_reverse_inplace(data[i]);
+}
+
+void zero_subnormals_scalar(uint32_t *data, size_t n) noexcept {
+	for (size_t i = 0; i < n; ++i)
+		if (!(data[i] & exp32)) data[i] &= ~abs32;
+}
+
+void zero_subnormals_scalar(uint64_t *data, size_t n) noexcept {
+	for (size_t i = 0; i < n; ++i)
+		if (!(data[i] & exp64)) data[i] &= ~abs64;
+}
+
+/// One implementation of each kernel
+struct kernel_table {
+	isa target;
+	void (*i16_f32)(const int16_t *, float *, size_t) noexcept;
+	void (*f32_i16)(const float *, int16_t *, size_t) noexcept;
+	void (*f32_f64)(const float *, double *, size_t) noexcept;
+	void (*f64_f32)(const double *, float *, size_t) noexcept;
+	void (*swap16)(uint16_t *, size_t) noexcept;
+	void (*swap32)(uint32_t *, size_t) noexcept;
+	void (*swap64)(uint64_t *, size_t) noexcept;
+	void (*zero32)(uint32_t *, size_t) noexcept;
+	void (*zero64)(uint64_t *, size_t) noexcept;
+};
+
+const kernel_table scalar_kernels = {isa::scalar, convert_scalar<int16_t, float>,
+	convert_scalar<float, int16_t>, convert_scalar<float, double>, convert_scalar<double, float>,
+	byteswap_scalar<uint16_t>, byteswap_scalar<uint32_t>, byteswap_scalar<uint64_t>,
+	zero_subnormals_scalar, zero_subnormals_scalar};
+
+#ifdef LSL_SIMD_X86
+// SSE2 is part of the x86_64 baseline, so these need no special compiler flags
+
+void i16_f32_sse2(const int16_t *src, float *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(dst + i, _mm_cvtepi32_ps(lo));
+		_mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(hi));
+	}
+	convert_scalar(src + i, dst + i, n - i);
+}
+
+void f32_i16_sse2(const float *src, int16_t *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		// truncate to int32 and keep the lower 16 bits like the scalar cast does
+		__m128i a = _mm_cvttps_epi32(_mm_loadu_ps(src + i));
+		__m128i b = _mm_cvttps_epi32(_mm_loadu_ps(src + i + 4));
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(a, b));
+	}
+	convert_scalar(src + i, dst + i, n - i);
+}
+
+void f32_f64_sse2(const float *src, double *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 v = _mm_loadu_ps(src + i);
+		_mm_storeu_pd(dst + i, _mm_cvtps_pd(v));
+		_mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+	}
+	convert_scalar(src + i, dst + i, n - i);
+}
+
+void f64_f32_sse2(const double *src, float *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 a = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+		__m128 b = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+		_mm_storeu_ps(dst + i, _mm_movelh_ps(a, b));
+	}
+	convert_scalar(src + i, dst + i, n - i);
+}
+
+/// swap the bytes in each 16 bit word
+inline __m128i swap_bytes_sse2(__m128i v) noexcept {
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+/// swap the 16 bit words in each 32 bit word
+inline __m128i swap_words_sse2(__m128i v) noexcept {
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+}
+
+void swap16_sse2(uint16_t *data, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		auto *p = reinterpret_cast<__m128i *>(data + i);
+		_mm_storeu_si128(p, swap_bytes_sse2(_mm_loadu_si128(p)));
+	}
+	byteswap_scalar(data + i, n - i);
+}
+
+void swap32_sse2(uint32_t *data, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		auto *p = reinterpret_cast<__m128i *>(data + i);
+		_mm_storeu_si128(p, swap_bytes_sse2(swap_words_sse2(_mm_loadu_si128(p))));
+	}
+	byteswap_scalar(data + i, n - i);
+}
+
+void swap64_sse2(uint64_t *data, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		auto *p = reinterpret_cast<__m128i *>(data + i);
+		__m128i v = _mm_shuffle_epi32(_mm_loadu_si128(p), 0xB1);
+		_mm_storeu_si128(p, swap_bytes_sse2(swap_words_sse2(v)));
+	}
+	byteswap_scalar(data + i, n - i);
+}
+
+void zero32_sse2(uint32_t *data, size_t n) noexcept {
+	const __m128i expmask = _mm_set1_epi32(static_cast<int32_t>(exp32));
+	const __m128i absmask = _mm_set1_epi32(static_cast<int32_t>(abs32));
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		auto *p = reinterpret_cast<__m128i *>(data + i);
+		__m128i v = _mm_loadu_si128(p);
+		__m128i tiny = _mm_cmpeq_epi32(_mm_and_si128(v, expmask), _mm_setzero_si128());
+		_mm_storeu_si128(p, _mm_andnot_si128(_mm_and_si128(tiny, absmask), v));
+	}
+	zero_subnormals_scalar(data + i, n - i);
+}
+
+void zero64_sse2(uint64_t *data, size_t n) noexcept {
+	// the exponent is completely contained in the upper 32 bits
+	const __m128i expmask = _mm_set1_epi64x(static_cast<int64_t>(exp64));
+	const __m128i absmask = _mm_set1_epi64x(static_cast<int64_t>(abs64));
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		auto *p = reinterpret_cast<__m128i *>(data + i);
+		__m128i v = _mm_loadu_si128(p);
+		__m128i tiny = _mm_cmpeq_epi32(_mm_and_si128(v, expmask), _mm_setzero_si128());
+		tiny = _mm_shuffle_epi32(tiny, 0xF5);
+		_mm_storeu_si128(p, _mm_andnot_si128(_mm_and_si128(tiny, absmask), v));
+	}
+	zero_subnormals_scalar(data + i, n - i);
+}
+
+const kernel_table sse2_kernels = {isa::sse2, i16_f32_sse2, f32_i16_sse2, f32_f64_sse2,
+	f64_f32_sse2, swap16_sse2, swap32_sse2, swap64_sse2, zero32_sse2, zero64_sse2};
+
+// AVX2 kernels are compiled for AVX2 regardless of the global compiler flags and only
+// selected when the CPU supports them
+
+LSL_TARGET_AVX2 void i16_f32_avx2(const int16_t *src, float *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const auto *p = reinterpret_cast<const __m128i *>(src + i);
+		_mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(p))));
+		_mm256_storeu_ps(
+			dst + i + 8, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(p + 1))));
+	}
+	i16_f32_sse2(src + i, dst + i, n - i);
+}
+
+LSL_TARGET_AVX2 void f32_i16_avx2(const float *src, int16_t *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_cvttps_epi32(_mm256_loadu_ps(src + i));
+		__m256i b = _mm256_cvttps_epi32(_mm256_loadu_ps(src + i + 8));
+		a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+		b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+		// packs works per 128 bit lane, so the 64 bit blocks have to be put back in order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+	}
+	f32_i16_sse2(src + i, dst + i, n - i);
+}
+
+LSL_TARGET_AVX2 void f32_f64_avx2(const float *src, double *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+		_mm256_storeu_pd(dst + i + 4, _mm256_cvtps_pd(_mm_loadu_ps(src + i + 4)));
+	}
+	f32_f64_sse2(src + i, dst + i, n - i);
+}
+
+LSL_TARGET_AVX2 void f64_f32_avx2(const double *src, float *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+		_mm_storeu_ps(dst + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4)));
+	}
+	f64_f32_sse2(src + i, dst + i, n - i);
+}
+
+LSL_TARGET_AVX2 inline void shuffle_bytes_avx2(void *data, size_t bytes, __m256i order) noexcept {
+	for (size_t i = 0; i + 32 <= bytes; i += 32) {
+		auto *p = reinterpret_cast<__m256i *>(static_cast<char *>(data) + i);
+		_mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), order));
+	}
+}
+
+LSL_TARGET_AVX2 void swap16_avx2(uint16_t *data, size_t n) noexcept {
+	const __m256i order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1,
+		0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	const size_t i = n & ~size_t(15);
+	shuffle_bytes_avx2(data, i * sizeof(uint16_t), order);
+	swap16_sse2(data + i, n - i);
+}
+
+LSL_TARGET_AVX2 void swap32_avx2(uint32_t *data, size_t n) noexcept {
+	const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3,
+		2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const size_t i = n & ~size_t(7);
+	shuffle_bytes_avx2(data, i * sizeof(uint32_t), order);
+	swap32_sse2(data + i, n - i);
+}
+
+LSL_TARGET_AVX2 void swap64_avx2(uint64_t *data, size_t n) noexcept {
+	const __m256i order = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7,
+		6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	const size_t i = n & ~size_t(3);
+	shuffle_bytes_avx2(data, i * sizeof(uint64_t), order);
+	swap64_sse2(data + i, n - i);
+}
+
+LSL_TARGET_AVX2 void zero32_avx2(uint32_t *data, size_t n) noexcept {
+	const __m256i expmask = _mm256_set1_epi32(static_cast<int32_t>(exp32));
+	const __m256i absmask = _mm256_set1_epi32(static_cast<int32_t>(abs32));
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		auto *p = reinterpret_cast<__m256i *>(data + i);
+		__m256i v = _mm256_loadu_si256(p);
+		__m256i tiny = _mm256_cmpeq_epi32(_mm256_and_si256(v, expmask), _mm256_setzero_si256());
+		_mm256_storeu_si256(p, _mm256_andnot_si256(_mm256_and_si256(tiny, absmask), v));
+	}
+	zero32_sse2(data + i, n - i);
+}
+
+LSL_TARGET_AVX2 void zero64_avx2(uint64_t *data, size_t n) noexcept {
+	const __m256i expmask = _mm256_set1_epi64x(static_cast<int64_t>(exp64));
+	const __m256i absmask = _mm256_set1_epi64x(static_cast<int64_t>(abs64));
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		auto *p = reinterpret_cast<__m256i *>(data + i);
+		__m256i v = _mm256_loadu_si256(p);
+		__m256i tiny = _mm256_cmpeq_epi64(_mm256_and_si256(v, expmask), _mm256_setzero_si256());
+		_mm256_storeu_si256(p, _mm256_andnot_si256(_mm256_and_si256(tiny, absmask), v));
+	}
+	zero64_sse2(data + i, n - i);
+}
+
+const kernel_table avx2_kernels = {isa::avx2, i16_f32_avx2, f32_i16_avx2, f32_f64_avx2,
+	f64_f32_avx2, swap16_avx2, swap32_avx2, swap64_avx2, zero32_avx2, zero64_avx2};
+
+bool cpu_has_avx2() noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	// the OS has to save the AVX registers on context switches (OSXSAVE + XCR0 bits 1 and 2)
+	const int osxsave_avx = (1 << 27) | (1 << 28);
+	if ((info[2] & osxsave_avx) != osxsave_avx || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // LSL_SIMD_X86
+
+#ifdef LSL_SIMD_NEON
+// Advanced SIMD is mandatory on AArch64
+
+void i16_f32_neon(const int16_t *src, float *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t v = vld1q_s16(src + i);
+		vst1q_f32(dst + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))));
+		vst1q_f32(dst + i + 4, vcvtq_f32_s32(vmovl_high_s16(v)));
+	}
+	convert_scalar(src + i, dst + i, n - i);
+}
+
+void f32_i16_neon(const float *src, int16_t *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		// truncate to int32 and keep the lower 16 bits like the scalar cast does
+		int32x4_t a = vcvtq_s32_f32(vld1q_f32(src + i));
+		int32x4_t b = vcvtq_s32_f32(vld1q_f32(src + i + 4));
+		vst1q_s16(dst + i, vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+	}
+	convert_scalar(src + i, dst + i, n - i);
+}
+
+void f32_f64_neon(const float *src, double *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t v = vld1q_f32(src + i);
+		vst1q_f64(dst + i, vcvt_f64_f32(vget_low_f32(v)));
+		vst1q_f64(dst + i + 2, vcvt_high_f64_f32(v));
+	}
+	convert_scalar(src + i, dst + i, n - i);
+}
+
+void f64_f32_neon(const double *src, float *dst, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		float32x2_t lo = vcvt_f32_f64(vld1q_f64(src + i));
+		vst1q_f32(dst + i, vcvt_high_f32_f64(lo, vld1q_f64(src + i + 2)));
+	}
+	convert_scalar(src + i, dst + i, n - i);
+}
+
+void swap16_neon(uint16_t *data, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		auto *p = reinterpret_cast<uint8_t *>(data + i);
+		vst1q_u8(p, vrev16q_u8(vld1q_u8(p)));
+	}
+	byteswap_scalar(data + i, n - i);
+}
+
+void swap32_neon(uint32_t *data, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		auto *p = reinterpret_cast<uint8_t *>(data + i);
+		vst1q_u8(p, vrev32q_u8(vld1q_u8(p)));
+	}
+	byteswap_scalar(data + i, n - i);
+}
+
+void swap64_neon(uint64_t *data, size_t n) noexcept {
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		auto *p = reinterpret_cast<uint8_t *>(data + i);
+		vst1q_u8(p, vrev64q_u8(vld1q_u8(p)));
+	}
+	byteswap_scalar(data + i, n - i);
+}
+
+void zero32_neon(uint32_t *data, size_t n) noexcept {
+	const uint32x4_t expmask = vdupq_n_u32(exp32), absmask = vdupq_n_u32(abs32);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		uint32x4_t v = vld1q_u32(data + i);
+		uint32x4_t tiny = vceqq_u32(vandq_u32(v, expmask), vdupq_n_u32(0));
+		vst1q_u32(data + i, vbicq_u32(v, vandq_u32(tiny, absmask)));
+	}
+	zero_subnormals_scalar(data + i, n - i);
+}
+
+void zero64_neon(uint64_t *data, size_t n) noexcept {
+	const uint64x2_t expmask = vdupq_n_u64(exp64), absmask = vdupq_n_u64(abs64);
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		uint64x2_t v = vld1q_u64(data + i);
+		uint64x2_t tiny = vceqq_u64(vandq_u64(v, expmask), vdupq_n_u64(0));
+		vst1q_u64(data + i, vbicq_u64(v, vandq_u64(tiny, absmask)));
+	}
+	zero_subnormals_scalar(data + i, n - i);
+}
+
+const kernel_table neon_kernels = {isa::neon, i16_f32_neon, f32_i16_neon, f32_f64_neon,
+	f64_f32_neon, swap16_neon, swap32_neon, swap64_neon, zero32_neon, zero64_neon};
+#endif // LSL_SIMD_NEON
+
+/// Get the kernel table for an instruction set, or nullptr if it's not supported
+const kernel_table *kernels_for(isa target) noexcept {
+	switch (target) {
+	case isa::scalar: return &scalar_kernels;
+#ifdef LSL_SIMD_X86
+	case isa::sse2: return &sse2_kernels;
+	case isa::avx2: return cpu_has_avx2() ? &avx2_kernels : nullptr;
+#endif
+#ifdef LSL_SIMD_NEON
+	case isa::neon: return &neon_kernels;
+#endif
+	default: return nullptr;
+	}
+}
+
+const kernel_table *best_kernels() noexcept {
+	for (isa target : {isa::avx2, isa::sse2, isa::neon})
+		if (const kernel_table *kernels = kernels_for(target)) return kernels;
+	return &scalar_kernels;
+}
+
+std::atomic<const kernel_table *> &active() noexcept {
+	static std::atomic<const kernel_table *> kernels{best_kernels()};
+	return kernels;
+}
+
+inline const kernel_table &k() noexcept { return *active().load(std::memory_order_relaxed); }
+
+} // namespace
+
+isa lsl::simd::active_isa() noexcept { return k().target; }
+
+isa lsl::simd::detected_isa() noexcept { return best_kernels()->target; }
+
+const char *lsl::simd::isa_name(isa target) noexcept {
+	switch (target) {
+	case isa::sse2: return "SSE2";
+	case isa::avx2: return "AVX2";
+	case isa::neon: return "NEON";
+	default: return "scalar";
+	}
+}
+
+bool lsl::simd::select_isa(isa target) noexcept {
+	const kernel_table *kernels = kernels_for(target);
+	if (!kernels) return false;
+	active().store(kernels);
+	return true;
+}
+
+void lsl::simd::convert(const int16_t *src, float *dst, size_t n) noexcept {
+	k().i16_f32(src, dst, n);
+}
+
+void lsl::simd::convert(const float *src, int16_t *dst, size_t n) noexcept {
+	k().f32_i16(src, dst, n);
+}
+
+void lsl::simd::convert(const float *src, double *dst, size_t n) noexcept {
+	k().f32_f64(src, dst, n);
+}
+
+void lsl::simd::convert(const double *src, float *dst, size_t n) noexcept {
+	k().f64_f32(src, dst, n);
+}
+
+void lsl::simd::byteswap(uint16_t *data, size_t n) noexcept { k().swap16(data, n); }
+
+void lsl::simd::byteswap(uint32_t *data, size_t n) noexcept { k().swap32(data, n); }
+
+void lsl::simd::byteswap(uint64_t *data, size_t n) noexcept { k().swap64(data, n); }
+
+void lsl::simd::zero_subnormals(uint32_t *data, size_t n) noexcept { k().zero32(data, n); }
+
+void lsl::simd::zero_subnormals(uint64_t *data, size_t n) noexcept { k().zero64(data, n); }
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Vectorized kernels for the hot per-value loops in sample.cpp, i.e. the type conversions
+ * in `assign_typed()`/`retrieve_typed()`, byte swapping and subnormal suppression.
+ *
+ * The best instruction set supported by the CPU is selected at runtime; each kernel produces
+ * the same results as the equivalent scalar `static_cast` / `endian_reverse_inplace()` loop.
+ */
+namespace lsl {
+namespace simd {
+
+enum class isa { scalar, sse2, avx2, neon };
+
+/// The instruction set the kernels currently dispatch to
+isa active_isa() noexcept;
+
+/// The best instruction set supported by this build and CPU
+isa detected_isa() noexcept;
+
+/// Human-readable name of an instruction set
+const char *isa_name(isa target) noexcept;
+
+/**
+ * Switch the kernels to another instruction set, e.g. to compare implementations in tests
+ * and benchmarks.
+ * @return false if the instruction set isn't supported by this build or CPU
+ */
+bool select_isa(isa target) noexcept;
+
+/// Convert `n` values with the semantics of `static_cast`
+void convert(const int16_t *src, float *dst, std::size_t n) noexcept;
+void convert(const float *src, int16_t *dst, std::size_t n) noexcept;
+void convert(const float *src, double *dst, std::size_t n) noexcept;
+void convert(const double *src, float *dst, std::size_t n) noexcept;
+
+/// Reverse the byte order of `n` values in place
+void byteswap(uint16_t *data, std::size_t n) noexcept;
+void byteswap(uint32_t *data, std::size_t n) noexcept;
+void byteswap(uint64_t *data, std::size_t n) noexcept;
+
+/// Replace subnormal float32 (`uint32_t`) / float64 (`uint64_t`) values by a signed zero
+void zero_subnormals(uint32_t *data, std::size_t n) noexcept;
+void zero_subnormals(uint64_t *data, std::size_t n) noexcept;
+
+} // namespace simd
+} // namespace lsl
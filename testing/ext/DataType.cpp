@@ -3,6 +3,8 @@
 #include <catch2/catch.hpp>
 #include <cstdint>
 #include <lsl_cpp.h>
+#include <memory>
+#include <string>
 #include <thread>
 
 // clazy:excludeall=non-pod-global-static
@@ -105,3 +107,149 @@ TEST_CASE("Flush", "[datatransfer][basic]") {
 	pusher.join();
 	//sp.in_.set_postprocessing(lsl::post_none);
 }
+
+TEST_CASE("async sender", "[datatransfer][multi]") {
+	const int nchan = 2, nsamples = 100, ninlets = 3;
+	for (auto cf : {lsl::cf_float32, lsl::cf_string}) {
+		const std::string name = "AsyncSender" + std::to_string(cf);
+		lsl::stream_info info(name, "DataType", nchan, 100, cf, "asyncsender");
+		lsl::stream_outlet out(info, 0, 360, transp_async_sender);
+		auto found_stream_info(lsl::resolve_stream("name", name, 1, 2.0));
+		REQUIRE(!found_stream_info.empty());
+
+		std::vector<std::unique_ptr<lsl::stream_inlet>> inlets;
+		for (int i = 0; i < ninlets; ++i) {
+			inlets.emplace_back(new lsl::stream_inlet(found_stream_info[0]));
+			inlets.back()->open_stream(2.);
+		}
+		// the outlet starts buffering for an inlet only after the inlet received the stream header
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+		std::vector<int32_t> sent(nchan * nsamples), received(nchan * nsamples);
+		for (int i = 0; i < nchan * nsamples; ++i) sent[i] = i;
+		out.push_chunk_multiplexed(sent.data(), nchan * nsamples / 2);
+		for (int k = nsamples / 2; k < nsamples; ++k) out.push_sample(&sent[k * nchan]);
+
+		for (auto &inlet : inlets) {
+			std::size_t pulled = 0;
+			for (int tries = 0; tries < 10 && pulled < received.size(); ++tries)
+				pulled += inlet->pull_chunk_multiplexed(
+					received.data() + pulled, nullptr, received.size() - pulled, 0, 1.);
+			CHECK(pulled == received.size());
+			CHECK(received == sent);
+		}
+	}
+}
+
+TEST_CASE("busy poll inlet", "[datatransfer][basic]") {
+	lsl::stream_info info("BusyPoll", "DataType", 1, lsl::IRREGULAR_RATE, lsl::cf_int32, "busypoll");
+	auto sp = create_streampair(info);
+	CHECK_THROWS(sp.in_.set_mode(inlet_mode_busy_poll, -1));
+	CHECK_THROWS(sp.in_.set_mode(static_cast<lsl_inlet_mode_t>(42), 0));
+	sp.in_.set_mode(inlet_mode_busy_poll, 200);
+
+	for (int32_t i = 0; i < 100; ++i) {
+		int32_t received = -1;
+		sp.out_.push_sample(&i);
+		CHECK(sp.in_.pull_sample(&received, 1, 1.) != 0.0);
+		CHECK(received == i);
+	}
+	// switching back while samples are in flight must not lose any
+	int32_t value = 100, received = -1;
+	sp.out_.push_sample(&value);
+	sp.in_.set_mode(inlet_mode_default);
+	CHECK(sp.in_.pull_sample(&received, 1, 1.) != 0.0);
+	CHECK(received == value);
+}
+
+TEST_CASE("outlet flush policy", "[datatransfer][basic]") {
+	for (auto flags : {transp_default, transp_async_sender}) {
+		const std::string name = "FlushPolicy" + std::to_string(flags);
+		lsl::stream_info info(name, "DataType", 1, lsl::IRREGULAR_RATE, lsl::cf_int32, name);
+		// without a flush policy, a chunk of 1000 samples would never fill up
+		lsl::stream_outlet out(info, 1000, 360, flags);
+		CHECK_THROWS(out.set_flush_policy(-1));
+		out.set_flush_policy(3, 0, 20000);
+		auto found_stream_info(lsl::resolve_stream("name", name, 1, 2.0));
+		REQUIRE(!found_stream_info.empty());
+		lsl::stream_inlet in(found_stream_info[0]);
+		in.open_stream(2.);
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+		// a single sample is sent once the delay expired
+		int32_t value = 17, received = -1;
+		out.push_sample(&value, 0.0, false);
+		CHECK(in.pull_sample(&received, 1, 1.) != 0.0);
+		CHECK(received == value);
+
+		// the third sample completes a chunk, long before the delay expires
+		for (int32_t i = 0; i < 3; ++i) out.push_sample(&i, 0.0, false);
+		for (int32_t i = 0; i < 3; ++i) {
+			CHECK(in.pull_sample(&received, 1, 1.) != 0.0);
+			CHECK(received == i);
+		}
+	}
+}
+
+TEST_CASE("dropped samples", "[datatransfer][basic]") {
+	lsl::stream_info info("DroppedSamples", "DataType", 1, 100, lsl::cf_int32, "droppedsamples");
+	lsl::stream_outlet out(info);
+	auto found_stream_info(lsl::resolve_stream("name", info.name(), 1, 2.0));
+	REQUIRE(!found_stream_info.empty());
+	// buffer one second, i.e. 100 samples
+	lsl::stream_inlet in(found_stream_info[0], 1);
+	in.open_stream(2.);
+	out.wait_for_consumers(2.);
+
+	const int32_t n = 1000;
+	for (int32_t i = 0; i < n; ++i) out.push_sample(&i);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	// all samples are either received or counted as dropped
+	int32_t received = -1, last = -1, pulled = 0;
+	while (in.pull_sample(&received, 1, 0.5) != 0.0) {
+		CHECK(received > last);
+		last = received;
+		++pulled;
+	}
+	CHECK(last == n - 1);
+	CHECK(in.dropped_samples() >= static_cast<uint64_t>(n - 100));
+	CHECK(in.dropped_samples() + pulled == static_cast<uint64_t>(n));
+}
+
+TEST_CASE("runtime stats", "[datatransfer][basic]") {
+	lsl::stream_info info("RuntimeStats", "DataType", 1, 100, lsl::cf_int32, "runtimestats");
+	lsl::stream_outlet out(info);
+	auto found_stream_info(lsl::resolve_stream("name", info.name(), 1, 2.0));
+	REQUIRE(!found_stream_info.empty());
+	lsl::stream_inlet in(found_stream_info[0]);
+	in.open_stream(2.);
+	out.wait_for_consumers(2.);
+	in.time_correction(2.);
+
+	const int32_t n = 100;
+	for (int32_t i = 0; i < n; ++i) out.push_sample(&i);
+	int32_t received;
+	for (int32_t i = 0; i < n; ++i) REQUIRE(in.pull_sample(&received, 1, 2.) != 0.0);
+
+	const lsl_outlet_stats out_stats = out.stats();
+	CHECK(out_stats.samples_pushed == static_cast<uint64_t>(n));
+	CHECK(out_stats.samples_dropped == 0);
+	CHECK(out_stats.sessions_accepted >= 1);
+	CHECK(out_stats.sessions_active >= 1);
+
+	const lsl_inlet_stats in_stats = in.stats();
+	CHECK(in_stats.samples_received == static_cast<uint64_t>(n));
+	CHECK(in_stats.samples_dropped == 0);
+	CHECK(in_stats.samples_queued == 0);
+	CHECK(in_stats.time_probes > 0);
+	CHECK(in_stats.rtt_us_p50 <= in_stats.rtt_us_max);
+
+	char *text = lsl_get_metrics_text();
+	REQUIRE(text != nullptr);
+	const std::string metrics(text);
+	lsl_destroy_string(text);
+	CHECK(metrics.find("lsl_outlet_samples_pushed_total{name=\"RuntimeStats\",type=\"DataType\","
+					   "source_id=\"runtimestats\"") != std::string::npos);
+	CHECK(metrics.find("# TYPE lsl_inlet_samples_received_total counter") != std::string::npos);
+}
@@ -1,7 +1,12 @@
 #include "../common/create_streampair.hpp"
 #include "../common/lsltypes.hpp"
+#include <algorithm>
 #include <catch2/catch.hpp>
+#include <chrono>
 #include <lsl_cpp.h>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 // clazy:excludeall=non-pod-global-static
 
@@ -20,3 +25,41 @@ TEST_CASE("bounce", "[basic][latency]") {
 		sp.in_.pull_sample(&data, 1.);
 	};
 }
+
+TEST_CASE("delivery latency histogram", "[latency]") {
+	lsl::stream_info info("latencyhist", "Test", 1, lsl::IRREGULAR_RATE, lsl::cf_double64);
+	auto sp = create_streampair(info);
+	const int rounds = 1000;
+	const double bucket_limits[] = {10, 20, 50, 100, 200, 500, 1000};
+
+	for (auto mode : {inlet_mode_default, inlet_mode_busy_poll}) {
+		sp.in_.set_mode(mode, 500);
+		std::vector<double> latencies;
+		std::thread puller([&]() {
+			double sent;
+			for (int i = 0; i < rounds; ++i)
+				if (sp.in_.pull_sample(&sent, 1, 1.))
+					latencies.push_back((lsl::local_clock() - sent) * 1e6);
+		});
+		for (int i = 0; i < rounds; ++i) {
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+			double now = lsl::local_clock();
+			sp.out_.push_sample(&now);
+		}
+		puller.join();
+		REQUIRE(latencies.size() == static_cast<std::size_t>(rounds));
+
+		std::sort(latencies.begin(), latencies.end());
+		std::ostringstream hist;
+		hist << (mode == inlet_mode_default ? "default" : "busy poll") << " mode, p50 "
+			 << latencies[rounds / 2] << " us, p99 " << latencies[rounds * 99 / 100] << " us\n";
+		auto it = latencies.begin();
+		for (double limit : bucket_limits) {
+			auto end = std::lower_bound(it, latencies.end(), limit);
+			hist << "  < " << limit << " us: " << (end - it) << '\n';
+			it = end;
+		}
+		hist << " >= 1000 us: " << (latencies.end() - it);
+		WARN(hist.str());
+	}
+}
@@ -6,6 +6,7 @@
 #include <lsl_cpp.h>
 #include <string>
 #include <thread>
+#include <vector>
 
 // clazy:excludeall=non-pod-global-static
 
@@ -68,3 +69,36 @@ TEMPLATE_TEST_CASE("stringconversion", "[basic][throughput]", int64_t, double) {
 		sp.in_.pull_chunk_multiplexed(data.data(), nullptr, nitems, 0, 5.0);
 	};
 }
+
+TEST_CASE("subscriber scaling", "[throughput][multi]") {
+	const int nchan = 16, chunk_size = 64;
+	const std::size_t param_inlets[] = {1, 10, 50};
+	std::vector<float> data(nchan * chunk_size, 17.f), received(data.size());
+
+	for (auto flags : {transp_default, transp_async_sender}) {
+		const std::string mode = flags == transp_async_sender ? "async" : "threads";
+		const std::string name = "SubscriberScaling_" + mode;
+		lsl::stream_info info(name, "Bench", nchan, 1000, lsl::cf_float32, name);
+		lsl::stream_outlet out(info, 0, 360, flags);
+		auto found_stream_info(lsl::resolve_stream("name", name, 1, 2.0));
+		REQUIRE(!found_stream_info.empty());
+
+		std::list<lsl::stream_inlet> inlet_list;
+		for (auto n_inlets : param_inlets) {
+			while (inlet_list.size() < n_inlets) {
+				inlet_list.emplace_front(found_stream_info[0], 300, false);
+				inlet_list.front().open_stream(.5);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			for (auto &inlet : inlet_list) inlet.flush();
+
+			BENCHMARK(mode + "_inlets_" + std::to_string(n_inlets)) {
+				out.push_chunk_multiplexed(data.data(), data.size());
+				for (auto &inlet : inlet_list)
+					for (std::size_t pulled = 0; pulled < received.size();)
+						pulled += inlet.pull_chunk_multiplexed(received.data() + pulled, nullptr,
+							received.size() - pulled, 0, 1.);
+			};
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#include "../src/consumer_queue.h"
+#include "../src/sample.h"
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// clazy:excludeall=non-pod-global-static
+
+TEST_CASE("consumer_queue push", "[queue][latency]") {
+	lsl::factory fac(cft_float32, 8, 16);
+	auto sample = fac.new_sample(0.0, true);
+	lsl::consumer_queue queue(1024);
+
+	// no consumer is blocked, so this shouldn't need any synchronization
+	BENCHMARK("push without waiting consumer") {
+		queue.push_sample(sample);
+		return queue.pop_sample(0.0);
+	};
+}
+
+TEST_CASE("consumer_queue wakeup latency", "[queue][latency]") {
+	using clock = std::chrono::steady_clock;
+	const int rounds = 2000;
+	lsl::factory fac(cft_float32, 8, 16);
+	lsl::consumer_queue queue(1024);
+	std::atomic<clock::rep> pushed_at{0};
+	std::atomic<bool> consumer_ready{false};
+	std::vector<double> latencies;
+	latencies.reserve(rounds);
+
+	std::thread consumer([&]() {
+		for (int i = 0; i < rounds; ++i) {
+			consumer_ready = true;
+			auto s = queue.pop_sample(5.0);
+			const auto now = clock::now().time_since_epoch().count();
+			if (s) latencies.push_back(static_cast<double>(now - pushed_at.load()));
+		}
+	});
+
+	auto sample = fac.new_sample(0.0, true);
+	for (int i = 0; i < rounds; ++i) {
+		// give the consumer time to block in pop_sample()
+		while (!consumer_ready.exchange(false)) std::this_thread::yield();
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+		pushed_at = clock::now().time_since_epoch().count();
+		queue.push_sample(sample);
+	}
+	consumer.join();
+
+	REQUIRE(latencies.size() == static_cast<std::size_t>(rounds));
+	std::sort(latencies.begin(), latencies.end());
+	const double to_us = 1e6 * clock::period::num / clock::period::den;
+	WARN("wakeup latency p50: " << latencies[rounds / 2] * to_us << " us, p99: "
+								<< latencies[rounds * 99 / 100] * to_us << " us");
+}
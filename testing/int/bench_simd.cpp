@@ -0,0 +1,81 @@
+#include "../src/util/simd.hpp"
+#include <catch2/catch.hpp>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// clazy:excludeall=non-pod-global-static
+
+using lsl::simd::isa;
+
+// one second of 64 channel data at 1 kHz
+const std::size_t n = 64 * 1000;
+
+template <typename Fn> void bench_each_isa(const char *kernel, Fn fn) {
+	for (isa target : {isa::scalar, isa::sse2, isa::avx2, isa::neon}) {
+		if (!lsl::simd::select_isa(target)) continue;
+		BENCHMARK(std::string(kernel) + ' ' + lsl::simd::isa_name(target)) { return fn(); };
+	}
+	lsl::simd::select_isa(lsl::simd::detected_isa());
+}
+
+TEST_CASE("simd conversion kernels") {
+	std::vector<int16_t> i16(n, 1234);
+	std::vector<float> f32(n, 1234.5f);
+	std::vector<double> f64(n, 1234.5);
+
+	bench_each_isa("int16->float", [&]() {
+		lsl::simd::convert(i16.data(), f32.data(), n);
+		return f32[0];
+	});
+	bench_each_isa("float->int16", [&]() {
+		lsl::simd::convert(f32.data(), i16.data(), n);
+		return i16[0];
+	});
+	bench_each_isa("float->double", [&]() {
+		lsl::simd::convert(f32.data(), f64.data(), n);
+		return f64[0];
+	});
+	bench_each_isa("double->float", [&]() {
+		lsl::simd::convert(f64.data(), f32.data(), n);
+		return f32[0];
+	});
+}
+
+TEST_CASE("simd byteswap kernels") {
+	std::vector<uint16_t> u16(n, 0x0102);
+	std::vector<uint32_t> u32(n, 0x01020304);
+	std::vector<uint64_t> u64(n, 0x0102030405060708);
+
+	bench_each_isa("byteswap16", [&]() {
+		lsl::simd::byteswap(u16.data(), n);
+		return u16[0];
+	});
+	bench_each_isa("byteswap32", [&]() {
+		lsl::simd::byteswap(u32.data(), n);
+		return u32[0];
+	});
+	bench_each_isa("byteswap64", [&]() {
+		lsl::simd::byteswap(u64.data(), n);
+		return u64[0];
+	});
+}
+
+TEST_CASE("simd subnormal kernels") {
+	// mix of normal and subnormal values
+	std::vector<uint32_t> u32(n);
+	std::vector<uint64_t> u64(n);
+	for (std::size_t i = 0; i < n; ++i) {
+		u32[i] = (i & 1) ? 0x3f800000 : 0x00000001;
+		u64[i] = (i & 1) ? 0x3ff0000000000000 : 0x0000000000000001;
+	}
+
+	bench_each_isa("zero_subnormals32", [&]() {
+		lsl::simd::zero_subnormals(u32.data(), n);
+		return u32[0];
+	});
+	bench_each_isa("zero_subnormals64", [&]() {
+		lsl::simd::zero_subnormals(u64.data(), n);
+		return u64[0];
+	});
+}
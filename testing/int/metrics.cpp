@@ -0,0 +1,50 @@
+#include "../src/consumer_queue.h"
+#include "../src/metrics.h"
+#include "../src/sample.h"
+#include "../src/send_buffer.h"
+#include <catch2/catch.hpp>
+#include <cstdint>
+
+// clazy:excludeall=non-pod-global-static
+
+TEST_CASE("histogram buckets", "[metrics][basic]") {
+	using lsl::histogram;
+	// every value lies in its bucket and the buckets are contiguous
+	for (uint64_t v : {0ull, 1ull, 7ull, 8ull, 9ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull,
+			 (1ull << 40) + 12345, ~0ull}) {
+		const int b = histogram::bucket(v);
+		INFO(v);
+		REQUIRE(b >= 0);
+		REQUIRE(b < histogram::num_buckets);
+		CHECK(v <= histogram::bucket_limit(b));
+		if (b > 0) CHECK(v > histogram::bucket_limit(b - 1));
+	}
+	CHECK(histogram::bucket_limit(histogram::num_buckets - 1) == ~0ull);
+	// the bucket width is at most 1/8 of the values in it
+	for (int b = histogram::sub_buckets; b < histogram::num_buckets; ++b)
+		CHECK(histogram::bucket_limit(b) - histogram::bucket_limit(b - 1) <=
+			  histogram::bucket_limit(b - 1) / histogram::sub_buckets + 1);
+}
+
+TEST_CASE("histogram quantiles", "[metrics][basic]") {
+	lsl::histogram h;
+	CHECK(h.quantile(0.5) == 0);
+	for (uint64_t v = 1; v <= 1000; ++v) h.record(v);
+	CHECK(h.count() == 1000);
+	CHECK(h.sum() == 500500);
+	CHECK(h.max() == 1000);
+	CHECK(h.quantile(0.5) >= 500);
+	CHECK(h.quantile(0.5) <= 500 * 9 / 8);
+	CHECK(h.quantile(0.99) >= 990);
+	CHECK(h.quantile(1) == 1000);
+}
+
+TEST_CASE("dropped samples metric", "[metrics][basic]") {
+	lsl::factory fac(lsl_channel_format_t::cft_int32, 1, 16);
+	auto buf = std::make_shared<lsl::send_buffer>(16);
+	auto queue = buf->new_consumer(4);
+	for (int i = 0; i < 10; ++i) buf->push_sample(fac.new_sample(i, true));
+	CHECK(buf->samples_pushed() == 10);
+	CHECK(buf->samples_queued() == queue->read_available());
+	CHECK(buf->metrics()->samples_dropped.value() + queue->read_available() == 10);
+}
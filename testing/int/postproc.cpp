@@ -78,3 +78,48 @@ TEST_CASE("rls_smoothing", "[basic]") {
 	CHECK(fabs(pp.w0_ - latency) < .1);
 	CHECK(fabs(pp.w1_ - 1 / srate) < 1e-6);
 }
+
+TEST_CASE("clock drift model", "[basic]") {
+	// the remote clock runs 20 ppm fast; offsets are measured every 2 s with a varying RTT
+	const double skew = -20e-6, offset = 1000, interval = 2;
+	auto true_correction = [&](double remote_time) { return offset + skew * remote_time; };
+	std::default_random_engine rng;
+	std::exponential_distribution<double> queueing(1 / 50e-6);
+
+	lsl::clock_drift_model model(30);
+	CHECK(model.fit().at(123) == 0);
+	double max_error = 0, max_step_error = 0;
+	for (int k = 0; k < 3600; ++k) {
+		// the asymmetric part of the RTT ends up in the measured offset
+		const double t = 5000 + k * interval, out = queueing(rng), back = queueing(rng);
+		const double rtt = 100e-6 + out + back, measured = true_correction(t) + (back - out) / 2;
+		model.add(t, measured, rtt);
+		const auto correction = model.fit();
+		// samples between this measurement and the next one
+		for (double dt = 0; dt < interval; dt += interval / 10) {
+			const double truth = true_correction(t + dt);
+			if (k >= 30) max_error = std::max(max_error, std::abs(correction.at(t + dt) - truth));
+			max_step_error = std::max(max_step_error, std::abs(measured - truth));
+		}
+	}
+	INFO("max error " << max_error * 1e6 << " us, step function " << max_step_error * 1e6 << " us")
+	CHECK(max_error < 50e-6);
+	CHECK(max_error < max_step_error / 3);
+	CHECK(model.fit().skew == Approx(skew).margin(1e-6));
+
+	// a jump to an implausible skew (e.g. the remote clock was adjusted) isn't extrapolated
+	model.add(5000 + 3600 * interval, 2000, 100e-6);
+	CHECK(model.fit().skew == 0);
+	CHECK(model.fit().offset == 2000);
+	model.reset();
+	CHECK(model.size() == 0);
+}
+
+TEST_CASE("postprocessing with clock drift", "[basic]") {
+	const lsl::clock_correction correction(-50, 1e-5, 1000);
+	lsl::time_postprocessor pp(
+		[&]() { return correction; }, []() { return 100.; }, []() { return false; });
+	pp.set_options(proc_clocksync);
+	for (double t : {1000., 1500., 3000.})
+		CHECK(pp.process_timestamp(t) == Approx(t - 50 + 1e-5 * (t - 1000)).epsilon(1e-12));
+}
@@ -1,8 +1,14 @@
 #include "../src/consumer_queue.h"
 #include "../src/sample.h"
+#include "../src/send_buffer.h"
+#include <algorithm>
 #include <atomic>
 #include <catch2/catch.hpp>
+#include <functional>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 
 // clazy:excludeall=non-pod-global-static
 
@@ -25,6 +31,70 @@ TEST_CASE("consumer_queue", "[queue][basic]") {
 	CHECK(queue.empty());
 }
 
+TEST_CASE("consumer_queue_bulk", "[queue][basic]") {
+	const int size = 10;
+	lsl::factory fac(lsl_channel_format_t::cft_int8, 4, size);
+	lsl::consumer_queue queue(size);
+	lsl::sample_p out[size];
+
+	// Does an empty queue time out without returning anything?
+	CHECK(queue.pop_samples(out, size, 0.01) == 0);
+
+	for (int i = 0; i < 3 * size / 2; ++i) queue.push_sample(fac.new_sample(i, true));
+
+	// Are only the requested number of samples returned, in order?
+	REQUIRE(queue.pop_samples(out, 3) == 3);
+	for (int i = 0; i < 3; ++i) CHECK(static_cast<int>(out[i]->timestamp()) == size / 2 + i);
+
+	// Does the wrapped remainder of the ring get returned?
+	REQUIRE(queue.pop_samples(out, size) == size - 3);
+	CHECK(static_cast<int>(out[size - 4]->timestamp()) == 3 * size / 2 - 1);
+	CHECK(queue.empty());
+
+	// Does a blocked pop_samples() get woken up by a push?
+	std::thread pusher([&]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		queue.push_sample(fac.new_sample(42, true));
+	});
+	CHECK(queue.pop_samples(out, size, 5.0) == 1);
+	CHECK(static_cast<int>(out[0]->timestamp()) == 42);
+	pusher.join();
+
+	// Does push_samples() respect the capacity and keep the order?
+	for (int i = 0; i < size; ++i) out[i] = fac.new_sample(i, true);
+	queue.push_samples(out, size);
+	queue.push_samples(out, 0);
+	CHECK(queue.read_available() == size);
+	CHECK(static_cast<int>(queue.pop_sample()->timestamp()) == 0);
+}
+
+TEST_CASE("consumer_queue_chunks", "[queue][basic]") {
+	const int size = 10, chunk_size = 4;
+	lsl::factory fac(lsl_channel_format_t::cft_int8, 4, size);
+	lsl::consumer_queue queue(size);
+	for (int i = 0; i < 5; ++i) {
+		auto chunk = fac.new_chunk(chunk_size, true);
+		chunk->timestamps()[0] = i;
+		queue.push_sample(chunk);
+	}
+
+	// Do the chunks' samples count against the capacity, dropping the oldest chunks?
+	lsl::sample_p out[size];
+	REQUIRE(queue.pop_samples(out, size) == size / chunk_size);
+	std::size_t retained = 0;
+	for (int i = 0; i < size / chunk_size; ++i) retained += out[i]->num_samples();
+	CHECK(retained <= size);
+	CHECK(static_cast<int>(out[0]->timestamps()[0]) == 5 - size / chunk_size);
+
+	// Is a chunk larger than the capacity kept on its own?
+	queue.push_sample(fac.new_sample(0., true));
+	queue.push_sample(fac.new_chunk(size + 1, true));
+	CHECK(queue.read_available() == 1);
+	CHECK(queue.pop_sample()->num_samples() == size + 1);
+	queue.push_sample(fac.new_sample(0., true));
+	CHECK(queue.read_available() == 1);
+}
+
 TEST_CASE("consumer_queue_threaded", "[queue][threads]") {
 	const unsigned int size = 100000;
 	lsl::factory fac(lsl_channel_format_t::cft_int8, 4, 1);
@@ -54,6 +124,126 @@ TEST_CASE("consumer_queue_threaded", "[queue][threads]") {
 	pusher.join();
 }
 
+TEST_CASE("send_buffer_consumers_threaded", "[queue][threads]") {
+	lsl::factory fac(lsl_channel_format_t::cft_int8, 4, 1);
+	auto sample = fac.new_sample(0.0, true);
+	auto buffer = std::make_shared<lsl::send_buffer>(100);
+	auto persistent = buffer->new_consumer();
+	std::atomic<bool> done{false};
+
+	std::thread pusher([&]() {
+		while (!done) buffer->push_sample(sample);
+	});
+
+	// Consumers come and go while the pusher is running
+	for (int i = 0; i < 200; ++i) {
+		auto consumer = buffer->new_consumer(10);
+		while (consumer->read_available() == 0) std::this_thread::yield();
+		CHECK(consumer->pop_sample() == sample);
+	}
+	done = true;
+	pusher.join();
+	CHECK(persistent->read_available() == 100);
+	CHECK(buffer->have_consumers());
+	persistent.reset();
+	CHECK(!buffer->have_consumers());
+}
+
+TEST_CASE("send_buffer_producers_threaded", "[queue][threads]") {
+	const unsigned int per_thread = 10000;
+	// a factory may only be used by one thread
+	lsl::factory fac1(cft_int8, 4, 16), fac2(cft_int8, 4, 16);
+	auto buffer = std::make_shared<lsl::send_buffer>(2 * per_thread);
+	auto consumer = buffer->new_consumer();
+
+	// Two threads push to the same buffer, like two user threads pushing to one outlet
+	auto push = [&](lsl::factory &fac) {
+		for (unsigned int i = 0; i < per_thread; ++i) buffer->push_sample(fac.new_sample(0., true));
+	};
+	std::thread first(push, std::ref(fac1)), second(push, std::ref(fac2));
+	first.join();
+	second.join();
+
+	// Did the consumer get every sample exactly once, numbered consecutively?
+	REQUIRE(consumer->read_available() == 2 * per_thread);
+	std::vector<uint64_t> seqs;
+	while (consumer->read_available()) seqs.push_back(consumer->pop_sample()->seq());
+	std::sort(seqs.begin(), seqs.end());
+	bool consecutive = true;
+	for (std::size_t i = 0; i < seqs.size(); ++i) consecutive &= seqs[i] == i;
+	CHECK(consecutive);
+	CHECK(buffer->samples_pushed() == 2 * per_thread);
+}
+
+TEST_CASE("consumer_queue_gaps_threaded", "[queue][threads]") {
+	const unsigned int per_thread = 20000;
+	lsl::factory fac1(cft_int8, 4, 16), fac2(cft_int8, 4, 16);
+	auto buffer = std::make_shared<lsl::send_buffer>(16);
+	auto consumer = buffer->new_consumer();
+
+	// Two producers overrun a small queue while it's being drained
+	std::atomic<int> running{2};
+	auto push = [&](lsl::factory &fac) {
+		for (unsigned int i = 0; i < per_thread; ++i) buffer->push_sample(fac.new_sample(0., true));
+		--running;
+	};
+	std::thread first(push, std::ref(fac1)), second(push, std::ref(fac2));
+	lsl::gap_tracker gaps;
+	uint64_t received = 0, missing = 0;
+	while (running || consumer->read_available()) {
+		auto samp = consumer->pop_sample(0.01);
+		if (!samp) continue;
+		missing += gaps.missing_before(*samp, consumer.get());
+		++received;
+	}
+	first.join();
+	second.join();
+
+	// Are only dropped samples reported, even though the samples arrive out of order? A sample
+	// dropped before the first or after the last received one from the other thread isn't a gap.
+	const uint64_t dropped = consumer->samples_dropped();
+	INFO(received)
+	CHECK(missing <= dropped);
+	CHECK(missing + 2 >= dropped);
+	CHECK(received + dropped == 2 * per_thread);
+}
+
+TEST_CASE("factory slabs", "[basic]") {
+	for (bool numa_local : {false, true}) {
+		lsl::factory fac(cft_string, 2, 20, numa_local);
+		auto stats = fac.stats();
+		CHECK(stats.capacity == (numa_local ? 0 : 20));
+		CHECK(stats.in_use == 0);
+
+		// exhaust the reserve, so that the factory has to add slabs
+		std::vector<lsl::sample_p> samples;
+		for (int i = 0; i < 100; ++i) {
+			samples.push_back(fac.new_sample(i, false));
+			const std::string values[2] = {std::to_string(i), "x"};
+			samples.back()->assign_typed(values);
+		}
+		stats = fac.stats();
+		CHECK(stats.in_use == 100);
+		CHECK(stats.high_water_mark == 100);
+		CHECK(stats.capacity >= 100);
+		CHECK(stats.slabs > 1);
+		// no sample was being reclaimed meanwhile
+		CHECK(stats.reclaim_slabs == 0);
+		std::string out[2];
+		samples[42]->retrieve_typed(out);
+		CHECK(out[0] == "42");
+
+		// the samples are returned to the slabs instead of being freed
+		samples.clear();
+		const auto grown = fac.stats();
+		CHECK(grown.in_use == 0);
+		CHECK(grown.high_water_mark == 100);
+		for (int i = 0; i < 100; ++i) samples.push_back(fac.new_sample(i, false));
+		CHECK(fac.stats().capacity == grown.capacity);
+		CHECK(fac.stats().slabs == grown.slabs);
+	}
+}
+
 TEST_CASE("sample conversion", "[basic]") {
 	lsl::factory fac(lsl_channel_format_t::cft_int64, 2, 1);
 	double values[2] = {1, -1};
@@ -72,3 +262,158 @@ TEST_CASE("sample conversion", "[basic]") {
 		values[1] = (double)(-buf[0]);
 	}
 }
+
+TEST_CASE("string sample storage", "[basic]") {
+	lsl::factory fac(cft_string, 3, 1);
+	// values that grow and shrink, including an empty one and one with a 4 byte length prefix
+	const std::vector<std::vector<std::string>> rounds{{"a", "", "bc"},
+		{std::string(300, 'x'), "{\"event\": 1}", ""}, {"", "", ""},
+		{"d", std::string(20, 'y'), "e"}};
+	for (const auto &values : rounds) {
+		// the samples are recycled by the factory for each round
+		auto sent = fac.new_sample(1., true), received = fac.new_sample(0., true);
+		sent->assign_typed(values.data());
+
+		std::stringbuf sb;
+		sent->save_streambuf(sb, LSL_PROTOCOL_VERSION, false);
+		received->load_streambuf(sb, LSL_PROTOCOL_VERSION, false, false);
+		CHECK(*received == *sent);
+
+		std::string out[3];
+		received->retrieve_typed(out);
+		CHECK(std::equal(values.begin(), values.end(), out));
+	}
+}
+
+TEST_CASE("shared sample serialization", "[basic]") {
+	for (auto fmt : {cft_int32, cft_string}) {
+		lsl::factory fac(fmt, 2, 1);
+		const int32_t values[] = {1, -2};
+		auto samp = fac.new_sample(3., true);
+		samp->assign_typed(values);
+
+		std::stringbuf sb;
+		samp->save_streambuf(sb, LSL_PROTOCOL_VERSION, false);
+		const auto &bytes = samp->serialized(false);
+		CHECK(std::string(bytes.begin(), bytes.end()) == sb.str());
+
+		// Do concurrent callers share the serialization for their byte order?
+		const std::vector<char> *shared[4];
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 4; ++i)
+			threads.emplace_back([&, i]() { shared[i] = &samp->serialized(i % 2 != 0); });
+		for (auto &t : threads) t.join();
+		CHECK(shared[0] == &bytes);
+		CHECK(shared[2] == &bytes);
+		CHECK(shared[1] == shared[3]);
+		CHECK(shared[1] != &bytes);
+
+		// Is the serialization discarded when the sample is recycled?
+		const std::string old_bytes(bytes.begin(), bytes.end());
+		samp = lsl::sample_p();
+		samp = fac.new_sample(4., true);
+		samp->assign_typed(values);
+		const auto &new_bytes = samp->serialized(false);
+		CHECK(std::string(new_bytes.begin(), new_bytes.end()) != old_bytes);
+	}
+}
+
+TEST_CASE("delta encoding", "[basic]") {
+	const int32_t values[][3] = {{1000, -1000, 0}, {1001, -1002, 0}, {-8388608, 8388607, 1},
+		{INT16_MAX, INT16_MIN, -1}};
+	for (auto fmt : {cft_int8, cft_int16, cft_int32, cft_int64}) {
+		lsl::factory fac(fmt, 3, 2);
+		std::stringbuf sb;
+		int64_t sent_previous[3] = {0}, received_previous[3] = {0};
+		std::size_t sizes[4];
+		for (int i = 0; i < 4; ++i) {
+			auto sent = fac.new_sample(i ? lsl::DEDUCED_TIMESTAMP : 1., true);
+			sent->assign_typed(values[i]);
+			const auto before = sb.str().size();
+			sent->save_streambuf_delta(sb, false, sent_previous);
+			sizes[i] = sb.str().size() - before;
+
+			auto received = fac.new_sample(0., true);
+			received->load_streambuf_delta(sb, false, received_previous);
+			CHECK(*received == *sent);
+		}
+		// small differences take one byte per value
+		CHECK(sizes[1] == 1 + 3);
+	}
+
+	// 64 bit values wrap around instead of overflowing
+	lsl::factory fac(cft_int64, 2, 2);
+	const int64_t extremes[] = {INT64_MIN, INT64_MAX};
+	auto sent = fac.new_sample(2., true), received = fac.new_sample(0., true);
+	sent->assign_typed(extremes);
+	std::stringbuf sb;
+	int64_t sent_previous[2] = {INT64_MAX, INT64_MIN}, received_previous[2] = {INT64_MAX, INT64_MIN};
+	sent->save_streambuf_delta(sb, true, sent_previous);
+	received->load_streambuf_delta(sb, true, received_previous);
+	CHECK(*received == *sent);
+}
+
+TEST_CASE("sample chunks", "[basic]") {
+	const uint32_t num_chans = 3, num_samples = 4;
+	for (auto fmt : {cft_float32, cft_string}) {
+		lsl::factory fac(fmt, num_chans, 1);
+		int32_t values[num_chans * num_samples];
+		for (uint32_t i = 0; i < num_chans * num_samples; ++i) values[i] = static_cast<int32_t>(i);
+
+		auto chunk = fac.new_chunk(num_samples, true);
+		REQUIRE(chunk->num_samples() == num_samples);
+		chunk->assign_typed(values);
+		for (uint32_t k = 0; k < num_samples; ++k)
+			chunk->timestamps()[k] = k ? lsl::DEDUCED_TIMESTAMP : 42.;
+
+		int32_t out[num_chans * num_samples];
+		chunk->retrieve_typed(out);
+		CHECK(std::equal(values, values + num_chans * num_samples, out));
+
+		// Is the serialized chunk identical to its samples serialized one after another?
+		std::stringbuf chunkbuf, samplesbuf;
+		chunk->save_streambuf(chunkbuf, LSL_PROTOCOL_VERSION, false);
+		for (uint32_t k = 0; k < num_samples; ++k) {
+			auto sample = fac.new_sample(chunk->timestamps()[k], false);
+			sample->assign_typed(values + k * num_chans);
+			sample->save_streambuf(samplesbuf, LSL_PROTOCOL_VERSION, false);
+		}
+		CHECK(chunkbuf.str() == samplesbuf.str());
+
+		// Do the raw headers and channel data add up to the serialized chunk?
+		if (fmt == cft_string) continue;
+		std::string vectored;
+		for (uint32_t k = 0; k < num_samples; ++k) {
+			char header[lsl::sample::max_header_bytes];
+			vectored.append(header, chunk->save_header_raw(header, k));
+			vectored.append(static_cast<const char *>(chunk->raw_data(k)), chunk->datasize());
+		}
+		CHECK(vectored == chunkbuf.str());
+	}
+}
+
+TEST_CASE("sample buffer deserialization", "[basic]") {
+	lsl::factory fac(cft_int16, 3, 4);
+	const int16_t values[] = {1, -2, 3};
+	std::stringbuf sb;
+	for (double ts : {1.5, lsl::DEDUCED_TIMESTAMP}) {
+		auto sample = fac.new_sample(ts, false);
+		sample->assign_typed(values);
+		sample->save_streambuf(sb, LSL_PROTOCOL_VERSION, false);
+	}
+	const std::string buf = sb.str();
+
+	auto received = fac.new_sample(0., false);
+	// Are incomplete samples rejected?
+	CHECK(received->load_buffer(buf.data(), 0, false, false) == 0);
+	CHECK(received->load_buffer(buf.data(), 9 + 5, false, false) == 0);
+
+	// Are both samples decoded correctly?
+	int16_t out[3];
+	REQUIRE(received->load_buffer(buf.data(), buf.size(), false, false) == 9 + 6);
+	CHECK(received->timestamp() == 1.5);
+	received->retrieve_typed(out);
+	CHECK(std::equal(values, values + 3, out));
+	REQUIRE(received->load_buffer(buf.data() + 15, buf.size() - 15, false, false) == 1 + 6);
+	CHECK(received->timestamp() == lsl::DEDUCED_TIMESTAMP);
+}
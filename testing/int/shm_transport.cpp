@@ -0,0 +1,115 @@
+#include "shm_transport.h"
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// clazy:excludeall=non-pod-global-static
+
+#ifdef LSL_SHM_TRANSPORT
+
+static std::string ring_name(const char *suffix) {
+	return "/dev/shm/lsl-test-" + std::to_string(getpid()) + "-" + suffix;
+}
+
+static void append_record(lsl::shm_ring &ring, uint32_t value) {
+	char *dst = ring.append(sizeof(value));
+	REQUIRE(dst != nullptr);
+	memcpy(dst, &value, sizeof(value));
+}
+
+TEST_CASE("shm ring", "[shm][basic]") {
+	lsl::shm_ring writer(ring_name("basic"), 4096);
+	lsl::shm_ring reader(writer.path());
+	auto cur = reader.make_cursor(writer.write_pos());
+	std::size_t len;
+
+	// nothing is visible until it's published
+	append_record(writer, 1);
+	CHECK(reader.next(cur, len) == nullptr);
+	writer.publish();
+
+	// wrap around the record area a few times
+	for (uint32_t k = 1; k < 2000; ++k) {
+		const char *rec = reader.next(cur, len);
+		REQUIRE(rec != nullptr);
+		REQUIRE(len == sizeof(uint32_t));
+		uint32_t value;
+		memcpy(&value, rec, sizeof(value));
+		REQUIRE(value == k);
+		REQUIRE(reader.advance(cur, len));
+		append_record(writer, k + 1);
+		writer.publish();
+	}
+	CHECK(cur.lost == 0);
+	CHECK(writer.append(writer.max_record() + 1) == nullptr);
+
+	writer.close();
+	CHECK(reader.closed());
+}
+
+TEST_CASE("shm ring wakeup", "[shm][basic]") {
+	lsl::shm_ring writer(ring_name("wakeup"), 4096);
+	lsl::shm_ring reader(writer.path());
+	auto cur = reader.make_cursor(writer.write_pos());
+	std::size_t len;
+
+	// an idle writer is still around
+	CHECK_FALSE(reader.closed());
+
+	// a waiting reader is woken up by the publishing writer
+	std::thread publisher([&writer]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		// no REQUIRE here, Catch's assertions aren't thread-safe
+		const uint32_t value = 1;
+		memcpy(writer.append(sizeof(value)), &value, sizeof(value));
+		writer.publish();
+	});
+	const auto start = std::chrono::steady_clock::now();
+	const auto deadline = start + std::chrono::seconds(5);
+	while (!reader.next(cur, len) && std::chrono::steady_clock::now() < deadline)
+		reader.wait(cur, 5.0);
+	publisher.join();
+	CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(4));
+	CHECK(reader.next(cur, len) != nullptr);
+	CHECK_FALSE(reader.closed());
+}
+
+TEST_CASE("shm ring overrun", "[shm][basic]") {
+	lsl::shm_ring writer(ring_name("overrun"), 4096);
+	lsl::shm_ring reader(writer.path());
+	auto cur = reader.make_cursor(writer.write_pos());
+	std::size_t len;
+
+	// a record that's overwritten while it's being read is discarded
+	append_record(writer, 1);
+	writer.publish();
+	REQUIRE(reader.next(cur, len) != nullptr);
+	for (uint32_t k = 0; k < 1024; ++k) append_record(writer, k);
+	writer.publish();
+	CHECK_FALSE(reader.advance(cur, len));
+	CHECK(cur.lost == 1);
+
+	// a reader that fell behind by more than a lap continues at the writer's position
+	for (uint32_t k = 0; k < 1024; ++k) append_record(writer, k);
+	writer.publish();
+	CHECK(reader.next(cur, len) == nullptr);
+	CHECK(cur.lost == 2);
+	CHECK(cur.pos == writer.write_pos());
+
+	// the oldest record that's still intact can be read from the start
+	auto oldest = reader.oldest();
+	CHECK(writer.write_pos() - oldest.pos <= 4096);
+	while (reader.next(oldest, len)) REQUIRE(reader.advance(oldest, len));
+	CHECK(oldest.lost == 0);
+}
+
+TEST_CASE("shm ring names", "[shm][basic]") {
+	lsl::shm_ring writer(ring_name("names"), 4096);
+	CHECK_THROWS(lsl::shm_ring(writer.path(), 4096));
+	CHECK_THROWS(lsl::shm_ring(ring_name("missing")));
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "../src/util/simd.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+// clazy:excludeall=non-pod-global-static
+
+using lsl::simd::isa;
+
+/// Run `check` once for each instruction set supported on this machine
+template <typename Fn> void for_each_isa(Fn check) {
+	for (isa target : {isa::scalar, isa::sse2, isa::avx2, isa::neon}) {
+		if (!lsl::simd::select_isa(target)) continue;
+		INFO(lsl::simd::isa_name(target));
+		check();
+	}
+	lsl::simd::select_isa(lsl::simd::detected_isa());
+}
+
+/// Bitwise comparison, so NaNs and signed zeros are compared correctly
+template <typename T> bool same_bits(const std::vector<T> &a, const std::vector<T> &b) {
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+// the lengths include all kernel tails for the vector widths in use
+const std::size_t max_len = 67;
+
+TEST_CASE("simd conversions", "[basic][simd]") {
+	std::vector<int16_t> i16;
+	std::vector<float> f32;
+	std::vector<double> f64;
+	for (std::size_t i = 0; i < max_len; ++i) {
+		i16.push_back(static_cast<int16_t>(i * 1031 - 32768));
+		f32.push_back(static_cast<float>(i) * -743.37f + 16000.f);
+		f64.push_back(static_cast<double>(i) * 1.1e36 - 2e37);
+	}
+	f64[3] = std::numeric_limits<double>::denorm_min();
+	f64[5] = -0.;
+
+	for_each_isa([&]() {
+		for (std::size_t n = 0; n <= max_len; ++n) {
+			INFO(n);
+			std::vector<float> f32_ref(n), f32_out(n, 1);
+			std::vector<double> f64_ref(n), f64_out(n, 1);
+			std::vector<int16_t> i16_ref(n), i16_out(n, 1);
+
+			for (std::size_t i = 0; i < n; ++i) f32_ref[i] = static_cast<float>(i16[i]);
+			lsl::simd::convert(i16.data(), f32_out.data(), n);
+			CHECK(same_bits(f32_ref, f32_out));
+
+			for (std::size_t i = 0; i < n; ++i) i16_ref[i] = static_cast<int16_t>(f32[i]);
+			lsl::simd::convert(f32.data(), i16_out.data(), n);
+			CHECK(same_bits(i16_ref, i16_out));
+
+			for (std::size_t i = 0; i < n; ++i) f64_ref[i] = static_cast<double>(f32[i]);
+			lsl::simd::convert(f32.data(), f64_out.data(), n);
+			CHECK(same_bits(f64_ref, f64_out));
+
+			for (std::size_t i = 0; i < n; ++i) f32_ref[i] = static_cast<float>(f64[i]);
+			lsl::simd::convert(f64.data(), f32_out.data(), n);
+			CHECK(same_bits(f32_ref, f32_out));
+		}
+	});
+}
+
+TEST_CASE("simd byte swaps", "[basic][simd]") {
+	std::vector<uint16_t> u16;
+	std::vector<uint32_t> u32;
+	std::vector<uint64_t> u64;
+	for (std::size_t i = 0; i < max_len; ++i) {
+		u16.push_back(static_cast<uint16_t>(0x0102 + i));
+		u32.push_back(static_cast<uint32_t>(0x01020304 + i));
+		u64.push_back(UINT64_C(0x0102030405060708) + i);
+	}
+	std::vector<uint16_t> u16_ref(u16);
+	std::vector<uint32_t> u32_ref(u32);
+	std::vector<uint64_t> u64_ref(u64);
+	for (auto &val : u16_ref) val = static_cast<uint16_t>((val >> 8) | (val << 8));
+	for (auto &val : u32_ref)
+		val = (val >> 24) | ((val >> 8) & 0xff00) | ((val << 8) & 0xff0000) | (val << 24);
+	for (auto &val : u64_ref) {
+		uint64_t swapped = 0;
+		for (int byte = 0; byte < 8; ++byte) swapped = (swapped << 8) | ((val >> (byte * 8)) & 0xff);
+		val = swapped;
+	}
+
+	for_each_isa([&]() {
+		for (std::size_t n = 0; n <= max_len; ++n) {
+			INFO(n);
+			std::vector<uint16_t> a(u16.begin(), u16.begin() + n);
+			std::vector<uint32_t> b(u32.begin(), u32.begin() + n);
+			std::vector<uint64_t> c(u64.begin(), u64.begin() + n);
+			lsl::simd::byteswap(a.data(), n);
+			lsl::simd::byteswap(b.data(), n);
+			lsl::simd::byteswap(c.data(), n);
+			CHECK(same_bits(a, std::vector<uint16_t>(u16_ref.begin(), u16_ref.begin() + n)));
+			CHECK(same_bits(b, std::vector<uint32_t>(u32_ref.begin(), u32_ref.begin() + n)));
+			CHECK(same_bits(c, std::vector<uint64_t>(u64_ref.begin(), u64_ref.begin() + n)));
+		}
+	});
+}
+
+TEST_CASE("simd subnormal suppression", "[basic][simd]") {
+	const uint32_t f32_vals[] = {0, 0x80000000, 1, 0x80000001, 0x007fffff, 0x807fffff, 0x00800000,
+		0x80800000, 0x3f800000, 0x7f800000, 0x7fc00000, 0xffffffff};
+	const uint64_t f64_vals[] = {0, UINT64_C(0x8000000000000000), 1, UINT64_C(0x8000000000000001),
+		UINT64_C(0x000fffffffffffff), UINT64_C(0x800fffffffffffff), UINT64_C(0x0010000000000000),
+		UINT64_C(0x8010000000000000), UINT64_C(0x3ff0000000000000), UINT64_C(0x7ff8000000000000),
+		UINT64_C(0x00000000ffffffff), UINT64_C(0xffffffffffffffff)};
+	std::vector<uint32_t> u32;
+	std::vector<uint64_t> u64;
+	for (std::size_t i = 0; i < max_len; ++i) {
+		u32.push_back(f32_vals[i % 12]);
+		u64.push_back(f64_vals[(i * 5) % 12]);
+	}
+	// reference: the scalar implementation liblsl used before
+	std::vector<uint32_t> u32_ref(u32);
+	std::vector<uint64_t> u64_ref(u64);
+	for (auto &val : u32_ref)
+		if (val && ((val & UINT32_C(0x7fffffff)) <= UINT32_C(0x007fffff)))
+			val &= UINT32_C(0x80000000);
+	for (auto &val : u64_ref)
+		if (val && ((val & UINT64_C(0x7fffffffffffffff)) <= UINT64_C(0x000fffffffffffff)))
+			val &= UINT64_C(0x8000000000000000);
+
+	for_each_isa([&]() {
+		for (std::size_t n = 0; n <= max_len; ++n) {
+			INFO(n);
+			std::vector<uint32_t> a(u32.begin(), u32.begin() + n);
+			std::vector<uint64_t> b(u64.begin(), u64.begin() + n);
+			lsl::simd::zero_subnormals(a.data(), n);
+			lsl::simd::zero_subnormals(b.data(), n);
+			CHECK(same_bits(a, std::vector<uint32_t>(u32_ref.begin(), u32_ref.begin() + n)));
+			CHECK(same_bits(b, std::vector<uint64_t>(u64_ref.begin(), u64_ref.begin() + n)));
+		}
+	});
+}
@@ -88,3 +88,57 @@ TEST_CASE("streaminfo matching via XPath", "[basic][streaminfo][xml]") {
 
 #endif
 }
+
+TEST_CASE("trivial streaminfo queries", "[basic][streaminfo][xml]") {
+	lsl::stream_info_impl info(
+		"streamname", "EEG", 8, 500, lsl_channel_format_t::cft_float32, "sourceid");
+	pugi::xml_document doc;
+	doc.load_string(info.to_fullinfo_message().c_str());
+
+	// the fast path has to agree with XPath, including queries it leaves to XPath
+	for (const char *query :
+		{"name='streamname'", "name = \"streamname\"", " type='EEG' and name='streamname' ",
+			"type='EEG' and\tsource_id='sourceid'", "type='EOG'", "name='streamname' and type=''",
+			"name=''", "uid='x'", "name='streamname'and type='EEG'", "name='streamname' or 1",
+			"type='EEG' and", "name=streamname", "name='stream", "NAME='streamname'",
+			"channel_count='8'", "type='EEG' and channel_count>4"}) {
+		INFO(query);
+		bool expected = false;
+		try {
+			expected = pugi::xpath_query(query).evaluate_boolean(doc.first_child());
+		} catch (std::exception &) {}
+		CHECK(info.matches_query(query) == expected);
+	}
+
+	// cached results are evaluated again once the stream_info changed
+	CHECK(info.matches_query("channel_count > 4"));
+	info.channel_count(2);
+	CHECK_FALSE(info.matches_query("channel_count > 4"));
+	CHECK(info.matches_query("count(desc/*) = 0"));
+	info.desc().append_child("channels");
+	CHECK_FALSE(info.matches_query("count(desc/*) = 0"));
+}
+
+TEST_CASE("rendered info messages", "[basic][streaminfo]") {
+	lsl::stream_info_impl info("cached", "EEG", 4, 100, lsl_channel_format_t::cft_float32, "src");
+	auto shortinfo = info.shortinfo_message(), fullinfo = info.fullinfo_message();
+	// unchanged: the same messages are returned again
+	CHECK(info.shortinfo_message() == shortinfo);
+	CHECK(info.fullinfo_message() == fullinfo);
+	CHECK(info.to_shortinfo_message() == *shortinfo);
+
+	// changed fields are rendered again
+	info.session_id("other");
+	CHECK(info.shortinfo_message() != shortinfo);
+	CHECK(info.shortinfo_message()->find("<session_id>other</session_id>") != std::string::npos);
+
+	// changes of the description are included after desc() was called
+	info.desc().append_child("manufacturer").text() = "LSL";
+	CHECK(info.fullinfo_message()->find("<manufacturer>LSL</manufacturer>") != std::string::npos);
+	CHECK(info.shortinfo_message()->find("manufacturer") == std::string::npos);
+
+	// copies are rendered on their own
+	lsl::stream_info_impl copy(info);
+	CHECK(copy.fullinfo_message() != info.fullinfo_message());
+	CHECK(*copy.fullinfo_message() == *info.fullinfo_message());
+}
@@ -5,11 +5,15 @@
 #include "tcp_server.h"
 #include <asio/read.hpp>
 #include <asio/read_until.hpp>
+#include <asio/streambuf.hpp>
 #include <asio/write.hpp>
 #include <catch2/catch.hpp>
+#include <cstring>
 #include <functional>
 #include <sstream>
 #include <thread>
+#include <unistd.h>
+#include <vector>
 
 // clazy:excludeall=non-pod-global-static
 
@@ -24,12 +28,17 @@ class tcp_server_wrapper {
 	std::shared_ptr<asio::io_context> srv_ctx;
 	std::unique_ptr<std::thread> thread;
 public:
-	tcp_server_wrapper(std::shared_ptr<lsl::stream_info_impl> info) {
-		auto sendbuf = std::make_shared<lsl::send_buffer>(10);
+	std::shared_ptr<lsl::send_buffer> sendbuf;
+	std::shared_ptr<lsl::factory> factory;
+
+	tcp_server_wrapper(std::shared_ptr<lsl::stream_info_impl> info, int max_capacity = 10,
+		bool async_sender = false) {
+		sendbuf = std::make_shared<lsl::send_buffer>(max_capacity);
 		srv_ctx = std::make_shared<asio::io_context>(1);
-		auto factory =
+		factory =
 			std::make_shared<lsl::factory>(info->channel_format(), info->channel_count(), 10);
-		srv = std::make_shared<lsl::tcp_server>(info, srv_ctx, sendbuf, factory, 5, true, true);
+		srv = std::make_shared<lsl::tcp_server>(
+			info, srv_ctx, sendbuf, factory, 5, true, true, async_sender);
 		srv->begin_serving();
 	}
 	~tcp_server_wrapper() noexcept {
@@ -207,3 +216,281 @@ TEST_CASE("tcpserver_float", "[network]") {
 	tcp_server.run();
 	ctx.run();
 }
+
+TEST_CASE("tcpserver_delta", "[network]") {
+	asio::io_context ctx(1);
+
+	auto info =
+		std::make_shared<lsl::stream_info_impl>("TCP_i16", "", 3, 4., cft_int16, "abc123");
+	tcp_server_wrapper tcp_server(info);
+	tcp::endpoint ep(address_v4(0x7f000001), info->v4data_port());
+
+	send_request(ctx, ep, asio::buffer("LSL:streamfeed/110 \nValue-Encoding: delta\r\n\r\n"),
+		with_read_callback("delta", [](const std::string &res) {
+			REQUIRE(res.substr(0, 14) == "LSL/110 200 OK");
+			REQUIRE(res.find("Value-Encoding: delta") != std::string::npos);
+			// the test patterns aren't encoded
+			auto endofheader = res.find("\r\n\r\n");
+			REQUIRE(endofheader != std::string::npos);
+			CHECK(res.size() - endofheader - 4 == 2 * (1 + 8 + 3 * sizeof(int16_t)));
+		}));
+
+	send_request(ctx, ep, asio::buffer("LSL:streamfeed/110 \nValue-Encoding: zstd\r\n\r\n"),
+		with_read_callback("unknown encoding", [](const std::string &res) {
+			REQUIRE(res.substr(0, 14) == "LSL/110 200 OK");
+			REQUIRE(res.find("Value-Encoding") == std::string::npos);
+		}));
+
+	tcp_server.run();
+	ctx.run();
+}
+
+TEST_CASE("tcpserver_history", "[network]") {
+	auto info =
+		std::make_shared<lsl::stream_info_impl>("TCP_hist", "", 1, 10., cft_int32, "abc123");
+	tcp_server_wrapper tcp_server(info);
+	const std::string path = "/dev/shm/lsl-test-history-" + std::to_string(getpid());
+	try {
+		tcp_server->set_history(path, 100);
+	} catch (std::exception &e) {
+		WARN("history not supported: " << e.what());
+		return;
+	}
+	tcp_server.run();
+	auto push = [&](int32_t i) {
+		auto samp = tcp_server.factory->new_sample(i, true);
+		samp->assign_typed(&i);
+		tcp_server.sendbuf->push_sample(samp);
+	};
+	for (int32_t i = 1; i <= 10; ++i) push(i);
+
+	asio::io_context ctx(1);
+	sock_t sock(ctx);
+	sock.connect(tcp::endpoint(address_v4(0x7f000001), info->v4data_port()));
+	asio::write(sock, asio::buffer("LSL:streamfeed/110 \r\nResume-After: 4\r\n"
+								   "Max-Buffer-Length: 10\r\nMax-Chunk-Length: 1\r\n\r\n"));
+	asio::streambuf buf;
+	const std::size_t header_len = asio::read_until(sock, buf, "\r\n\r\n");
+	buf.consume(header_len);
+
+	// the test patterns are followed by the samples after the one with timestamp 4
+	const std::size_t sample_len = 1 + sizeof(double) + sizeof(int32_t);
+	auto read_bytes = [&](std::size_t n) {
+		if (buf.size() < n) asio::read(sock, buf, asio::transfer_exactly(n - buf.size()));
+	};
+	read_bytes(2 * sample_len);
+	buf.consume(2 * sample_len);
+	auto read_sample = [&]() {
+		read_bytes(sample_len);
+		const char *data = static_cast<const char *>(buf.data().data());
+		REQUIRE(data[0] == 2);
+		double ts;
+		int32_t value;
+		memcpy(&ts, data + 1, sizeof(ts));
+		memcpy(&value, data + 1 + sizeof(ts), sizeof(value));
+		buf.consume(sample_len);
+		CHECK(ts == value);
+		return value;
+	};
+	for (int32_t i = 5; i <= 10; ++i) CHECK(read_sample() == i);
+
+	// later samples are sent as usual
+	push(11);
+	CHECK(read_sample() == 11);
+	sock.close();
+	tcp_server->set_history("", 0);
+}
+
+TEST_CASE("tcpserver_gaps", "[network]") {
+	// large samples, so the socket buffers fill up and the session's queue overflows
+	const int nchan = 2000;
+	auto info = std::make_shared<lsl::stream_info_impl>(
+		"TCP_gaps", "", nchan, lsl::IRREGULAR_RATE, cft_int32, "abc123");
+	tcp_server_wrapper tcp_server(info);
+	tcp_server.run();
+
+	asio::io_context ctx(1);
+	sock_t sock(ctx);
+	sock.connect(tcp::endpoint(address_v4(0x7f000001), info->v4data_port()));
+	asio::write(sock, asio::buffer("LSL:streamfeed/110 \r\nSequence-Numbers: 1\r\n"
+								   "Max-Buffer-Length: 10\r\nMax-Chunk-Length: 1\r\n\r\n"));
+	asio::streambuf buf;
+	const std::size_t header_len = asio::read_until(sock, buf, "\r\n\r\n");
+	{
+		std::string header(static_cast<const char *>(buf.data().data()), header_len);
+		REQUIRE(header.find("Sequence-Numbers: 1") != std::string::npos);
+	}
+	buf.consume(header_len);
+	const std::size_t sample_len = 1 + sizeof(double) + nchan * sizeof(int32_t);
+	auto read_bytes = [&](std::size_t n) {
+		if (buf.size() < n) asio::read(sock, buf, asio::transfer_exactly(n - buf.size()));
+		return static_cast<const char *>(buf.data().data());
+	};
+	read_bytes(2 * sample_len);
+	buf.consume(2 * sample_len);
+	REQUIRE(tcp_server.sendbuf->wait_for_consumers(5.));
+
+	const int32_t n = 4000;
+	std::vector<int32_t> values(nchan);
+	for (int32_t i = 0; i < n; ++i) {
+		auto samp = tcp_server.factory->new_sample(i + 1, true);
+		values[0] = i;
+		samp->assign_typed(values.data());
+		tcp_server.sendbuf->push_sample(samp);
+	}
+
+	// each gap marker announces exactly the samples missing before the next sample
+	int32_t expected = 0, value = -1;
+	uint64_t missing = 0;
+	while (value != n - 1) {
+		const char *data = read_bytes(1);
+		if (data[0] == lsl::TAG_GAP) {
+			data = read_bytes(lsl::GAP_MARKER_BYTES);
+			const uint32_t gap = lsl::sample::load_gap_marker(data, false);
+			CHECK(gap > 0);
+			expected += static_cast<int32_t>(gap);
+			missing += gap;
+			buf.consume(lsl::GAP_MARKER_BYTES);
+			continue;
+		}
+		data = read_bytes(sample_len);
+		REQUIRE(data[0] == lsl::TAG_TRANSMITTED_TIMESTAMP);
+		memcpy(&value, data + 1 + sizeof(double), sizeof(value));
+		buf.consume(sample_len);
+		REQUIRE(value == expected++);
+	}
+	CHECK(missing > 0);
+	sock.close();
+}
+
+TEST_CASE("tcpserver_vectored", "[network]") {
+	// small samples are copied to the feed buffer, large ones are referenced. Enough samples
+	// for the latter to need more buffers than fit in a single sendmsg() call
+	for (const int nchan : {3, 300}) {
+		INFO("channels: " << nchan);
+		auto info = std::make_shared<lsl::stream_info_impl>(
+			"TCP_vec", "", nchan, 100., cft_float32, "abc123");
+		tcp_server_wrapper tcp_server(info, 1000);
+		tcp_server.run();
+
+		asio::io_context ctx(1);
+		sock_t sock(ctx);
+		sock.connect(tcp::endpoint(address_v4(0x7f000001), info->v4data_port()));
+		asio::write(sock, asio::buffer("LSL:streamfeed/110 \r\nMax-Buffer-Length: 1000\r\n\r\n"));
+		asio::streambuf buf;
+		const std::size_t header_len = asio::read_until(sock, buf, "\r\n\r\n");
+		buf.consume(header_len);
+		const std::size_t pattern_len = 2 * (1 + sizeof(double) + nchan * sizeof(float));
+		if (buf.size() < pattern_len)
+			asio::read(sock, buf, asio::transfer_exactly(pattern_len - buf.size()));
+		buf.consume(pattern_len);
+		REQUIRE(tcp_server.sendbuf->wait_for_consumers(5.));
+
+		// every other sample has a deduced timestamp, i.e. a shorter header
+		const int n = 100;
+		std::vector<float> values(nchan);
+		asio::streambuf expected;
+		for (int i = 0; i < n; ++i) {
+			const double ts = i % 2 ? lsl::DEDUCED_TIMESTAMP : i + 1.;
+			auto samp = tcp_server.factory->new_sample(ts, i == n - 1);
+			for (int c = 0; c < nchan; ++c) values[c] = static_cast<float>(i * nchan + c);
+			samp->assign_typed(values.data());
+			samp->save_streambuf(expected, 110, false, nullptr);
+			tcp_server.sendbuf->push_sample(samp);
+		}
+		if (buf.size() < expected.size())
+			asio::read(sock, buf, asio::transfer_exactly(expected.size() - buf.size()));
+		cmp_binstr(std::string(static_cast<const char *>(buf.data().data()), expected.size()),
+			std::string(static_cast<const char *>(expected.data().data()), expected.size()));
+		sock.close();
+	}
+}
+
+TEST_CASE("tcpserver_shared_serialization", "[network]") {
+	// byte-swapped sessions share the samples' serializations once there are several of them
+	const int nchan = 3;
+	auto info = std::make_shared<lsl::stream_info_impl>(
+		"TCP_shared", "", nchan, 100., cft_float32, "abc123");
+	tcp_server_wrapper tcp_server(info, 100);
+	tcp_server.run();
+
+	const std::size_t sample_len = 1 + sizeof(double) + nchan * sizeof(float);
+	auto serialize = [&](double ts, float value) {
+		auto samp = tcp_server.factory->new_sample(ts, true);
+		std::vector<float> values(nchan, value);
+		samp->assign_typed(values.data());
+		asio::streambuf sb;
+		std::vector<char> scratch(samp->datasize());
+		samp->save_streambuf(sb, 110, true, scratch.data());
+		std::string bytes(static_cast<const char *>(sb.data().data()), sb.size());
+		return std::make_pair(samp, bytes);
+	};
+
+	asio::io_context ctx(1);
+	std::vector<std::unique_ptr<sock_t>> socks;
+	std::vector<asio::streambuf> bufs(2);
+	for (auto &buf : bufs) {
+		socks.push_back(std::make_unique<sock_t>(ctx));
+		socks.back()->connect(tcp::endpoint(address_v4(0x7f000001), info->v4data_port()));
+		asio::write(*socks.back(), asio::buffer("LSL:streamfeed/110 \r\nNative-byte-order: 4321\r\n"
+												"Max-Buffer-Length: 100\r\n\r\n"));
+		buf.consume(asio::read_until(*socks.back(), buf, "\r\n\r\n"));
+		if (buf.size() < 2 * sample_len)
+			asio::read(*socks.back(), buf, asio::transfer_exactly(2 * sample_len - buf.size()));
+		buf.consume(2 * sample_len);
+	}
+
+	// the second session gets samples once it's registered, which can't be observed otherwise
+	const std::string probe = serialize(1., -1.f).second;
+	while (!socks[1]->available()) {
+		tcp_server.sendbuf->push_sample(serialize(1., -1.f).first);
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	std::string expected;
+	const int n = 10;
+	for (int i = 0; i < n; ++i) {
+		auto serialized = serialize(i + 2., static_cast<float>(i));
+		expected += serialized.second;
+		tcp_server.sendbuf->push_sample(serialized.first);
+	}
+
+	for (std::size_t s = 0; s < socks.size(); ++s) {
+		INFO("session " << s);
+		std::string received;
+		while (received.size() < expected.size()) {
+			auto &buf = bufs[s];
+			if (buf.size() < sample_len)
+				asio::read(*socks[s], buf, asio::transfer_exactly(sample_len - buf.size()));
+			std::string samp(static_cast<const char *>(buf.data().data()), sample_len);
+			buf.consume(sample_len);
+			if (samp != probe) received += samp;
+		}
+		cmp_binstr(received, expected);
+		socks[s]->close();
+	}
+}
+
+TEST_CASE("tcpserver_async_disconnect", "[network]") {
+	auto info =
+		std::make_shared<lsl::stream_info_impl>("TCP_async", "", 1, 10., cft_int32, "abc123");
+	tcp_server_wrapper tcp_server(info, 10, true);
+	tcp_server.run();
+	auto wait_for = [](std::function<bool()> cond) {
+		for (int i = 0; i < 200 && !cond(); ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return cond();
+	};
+
+	asio::io_context ctx(1);
+	sock_t sock(ctx);
+	sock.connect(tcp::endpoint(address_v4(0x7f000001), info->v4data_port()));
+	asio::write(sock, asio::buffer("LSL:streamfeed/110 \r\nMax-Buffer-Length: 10\r\n\r\n"));
+	asio::streambuf buf;
+	asio::read_until(sock, buf, "\r\n\r\n");
+	REQUIRE(wait_for([&]() { return tcp_server.sendbuf->have_consumers(); }));
+
+	// an idle session notices the closed connection without having to send anything
+	sock.close();
+	CHECK(wait_for([&]() { return !tcp_server.sendbuf->have_consumers(); }));
+}
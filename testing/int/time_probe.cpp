@@ -0,0 +1,155 @@
+#include "common.h"
+#include "stream_info_impl.h"
+#include "time_probe.h"
+#include "udp_server.h"
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// clazy:excludeall=non-pod-global-static
+
+using namespace asio::ip;
+
+TEST_CASE("binary time probes", "[basic][timesync]") {
+	lsl::time_probe probe, parsed;
+	probe.wave_id = 0xdeadbeef;
+	probe.t0 = 12345.6789012345;
+	probe.t1 = -1.0 / 3;
+	probe.t2 = 1e-300;
+	char buf[lsl::time_probe::size];
+	probe.write(buf);
+	REQUIRE(parsed.read(buf, sizeof(buf)));
+	CHECK(parsed.wave_id == probe.wave_id);
+	CHECK(parsed.t0 == probe.t0);
+	CHECK(parsed.t1 == probe.t1);
+	CHECK(parsed.t2 == probe.t2);
+	// little endian on the wire
+	CHECK(static_cast<unsigned char>(buf[4]) == 0xef);
+
+	CHECK_FALSE(parsed.read(buf, sizeof(buf) - 1));
+	const char text[] = "LSL:timedata\r\n1 0.00000000000000";
+	static_assert(sizeof(text) - 1 == lsl::time_probe::size, "text request has the probe's size");
+	CHECK_FALSE(parsed.read(text, sizeof(text) - 1));
+}
+
+TEST_CASE("udp server answers time probes", "[basic][timesync]") {
+	auto info =
+		std::make_shared<lsl::stream_info_impl>("Dummy", "dummy", 1, 1., cft_int8, "abcdef123");
+	asio::io_context ctx;
+	auto server = std::make_shared<lsl::udp_server>(info, ctx, udp::v4());
+	udp::endpoint ep(address_v4::loopback(), info->v4service_port());
+	server->begin_serving();
+	std::thread iothread([&ctx]() { ctx.run(); });
+
+	asio::basic_datagram_socket<udp, asio::io_context::executor_type> sock(ctx, udp::endpoint());
+	// a burst of binary probes with a text request in between
+	const int n_probes = 40;
+	const double t0 = lsl::lsl_clock();
+	char buf[1024];
+	for (uint32_t k = 0; k < n_probes; ++k) {
+		lsl::time_probe probe;
+		probe.wave_id = k;
+		probe.t0 = t0;
+		probe.write(buf);
+		sock.send_to(asio::buffer(buf, lsl::time_probe::size), ep);
+		if (k == n_probes / 2) {
+			const std::string request("LSL:timedata\r\n7 0.5\r\n");
+			sock.send_to(asio::buffer(request), ep);
+		}
+	}
+
+	int probes = 0, texts = 0;
+	uint64_t wave_ids = 0;
+	while (probes + texts < n_probes + 1) {
+		std::size_t len = sock.receive(asio::buffer(buf));
+		lsl::time_probe reply;
+		if (reply.read(buf, len)) {
+			++probes;
+			wave_ids += reply.wave_id;
+			CHECK(reply.t0 == t0);
+			CHECK(reply.t1 >= t0);
+			CHECK(reply.t2 >= reply.t1);
+		} else {
+			++texts;
+			CHECK(std::string(buf, len).compare(0, 5, " 7 0.") == 0);
+		}
+	}
+	CHECK(texts == 1);
+	CHECK(wave_ids == n_probes * (n_probes - 1) / 2);
+
+	server->end_serving();
+	ctx.stop();
+	iothread.join();
+}
+
+#ifdef LSL_RX_TIMESTAMPS
+TEST_CASE("kernel receive time stamps", "[timesync]") {
+	auto info =
+		std::make_shared<lsl::stream_info_impl>("Dummy", "dummy", 1, 1., cft_int8, "abcdef123");
+	asio::io_context ctx;
+	auto server = std::make_shared<lsl::udp_server>(info, ctx, udp::v4());
+	udp::endpoint ep(address_v4::loopback(), info->v4service_port());
+	server->begin_serving();
+	std::thread iothread([&ctx]() { ctx.run(); });
+
+	udp_socket sock(ctx, udp::endpoint(udp::v4(), 0));
+	REQUIRE(lsl::enable_rx_timestamps(sock));
+
+	// keep all cores busy, so the receiving threads aren't scheduled right away
+	std::atomic<bool> busy{true};
+	std::vector<std::thread> load;
+	for (unsigned k = 0; k < std::max(2u, std::thread::hardware_concurrency()); ++k)
+		load.emplace_back([&busy]() {
+			while (busy) {}
+		});
+
+	// the same replies, with t3 taken after the socket became readable or from the kernel
+	const int n_probes = 200;
+	std::vector<double> offsets_user, offsets_kernel;
+	double rtt_user = 0, rtt_kernel = 0;
+	char buf[1024];
+	for (uint32_t k = 0; k < n_probes; ++k) {
+		lsl::time_probe probe;
+		probe.wave_id = k;
+		probe.t0 = lsl::lsl_clock();
+		probe.write(buf);
+		sock.send_to(asio::buffer(buf, lsl::time_probe::size), ep);
+		sock.wait(udp_socket::wait_read);
+		const double t3_user = lsl::lsl_clock();
+		double t3_kernel;
+		udp::endpoint sender;
+		const long len = lsl::receive_timestamped(sock, buf, sizeof(buf), sender, t3_kernel);
+		REQUIRE(probe.read(buf, static_cast<std::size_t>(len)));
+		offsets_user.push_back(((probe.t1 - probe.t0) + (probe.t2 - t3_user)) / 2);
+		offsets_kernel.push_back(((probe.t1 - probe.t0) + (probe.t2 - t3_kernel)) / 2);
+		rtt_user += (t3_user - probe.t0) - (probe.t2 - probe.t1);
+		rtt_kernel += (t3_kernel - probe.t0) - (probe.t2 - probe.t1);
+	}
+	busy = false;
+	for (auto &t : load) t.join();
+
+	auto variance = [](const std::vector<double> &values) {
+		double mean = 0, sum_sq = 0;
+		for (double v : values) mean += v / values.size();
+		for (double v : values) sum_sq += (v - mean) * (v - mean);
+		return sum_sq / (values.size() - 1);
+	};
+	const double var_user = variance(offsets_user), var_kernel = variance(offsets_kernel);
+	INFO("offset SD (us): " << std::sqrt(var_user) * 1e6 << " user, "
+							 << std::sqrt(var_kernel) * 1e6 << " kernel");
+	INFO("mean RTT (us): " << rtt_user / n_probes * 1e6 << " user, "
+						   << rtt_kernel / n_probes * 1e6 << " kernel");
+	// the kernel receives a reply before the inlet's thread gets to it
+	CHECK(rtt_kernel < rtt_user);
+	CHECK(var_kernel <= var_user);
+
+	server->end_serving();
+	ctx.stop();
+	iothread.join();
+}
+#endif
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <lsl_cpp.h>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Throughput and latency benchmark over loopback. Run with `--help` for more information.
+
+/// The parameters of one benchmark run
+struct config {
+	std::string format;
+	int channels, chunk, inlets;
+	double rate;
+
+	std::tuple<std::string, int, int, int, double> key() const {
+		return std::make_tuple(format, channels, chunk, inlets, rate);
+	}
+};
+
+/// The outcome of one benchmark run
+struct result {
+	config cfg;
+	uint64_t pushed{0}, received{0}, dropped{0};
+	double elapsed{0}, cpu{0};
+	double lat_p50{0}, lat_p99{0}, lat_p999{0};
+
+	/// samples received per second, summed over all inlets
+	double throughput() const { return elapsed > 0 ? received / elapsed : 0; }
+	/// process CPU time per received sample, in nanoseconds
+	double cpu_ns_per_sample() const { return received ? cpu / received * 1e9 : 0; }
+};
+
+/// CPU time used by this process (all threads), in seconds
+static double process_cpu_time() {
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	auto seconds = [](const FILETIME &t) {
+		return ((uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime) * 1e-7;
+	};
+	return seconds(kernel) + seconds(user);
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		   (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+template <typename T> T sample_value() { return T(17); }
+template <> std::string sample_value<std::string>() { return std::string(16, 'a'); }
+
+template <typename T>
+static result run(const config &cfg, lsl::channel_format_t fmt, double duration, int id) {
+	result res;
+	res.cfg = cfg;
+	const std::string name = "lsl_bench_" + std::to_string(id);
+	lsl::stream_info info(name, "Benchmark", cfg.channels, cfg.rate, fmt, name);
+	lsl::stream_outlet out(info);
+	auto found = lsl::resolve_stream("source_id", name, 1, 5.);
+	if (found.empty()) throw std::runtime_error("Couldn't resolve the benchmark outlet");
+
+	std::vector<std::unique_ptr<lsl::stream_inlet>> inlets;
+	for (int k = 0; k < cfg.inlets; ++k) {
+		inlets.emplace_back(new lsl::stream_inlet(found[0]));
+		inlets.back()->open_stream(5.);
+	}
+
+	std::atomic<bool> done{false};
+	std::vector<std::vector<float>> latencies(cfg.inlets);
+	std::vector<uint64_t> received(cfg.inlets, 0);
+	std::vector<std::thread> pullers;
+	for (int k = 0; k < cfg.inlets; ++k)
+		pullers.emplace_back([&, k]() {
+			lsl::stream_inlet &in = *inlets[k];
+			const std::size_t max_samples = std::max(cfg.chunk, 64);
+			std::vector<T> data(max_samples * cfg.channels);
+			std::vector<double> stamps(max_samples);
+			while (true) {
+				// wait for the first sample, then take all samples that are available already
+				std::size_t n = 0;
+				if ((stamps[0] = in.pull_sample(data.data(), cfg.channels, 0.1)) != 0.0)
+					n = 1 + in.pull_chunk_multiplexed(data.data() + cfg.channels, stamps.data() + 1,
+								data.size() - cfg.channels, stamps.size() - 1, 0.0) /
+								cfg.channels;
+				const double now = lsl::local_clock();
+				for (std::size_t i = 0; i < n; ++i)
+					latencies[k].push_back(static_cast<float>((now - stamps[i]) * 1e6));
+				received[k] += n;
+				if (!n && done) break;
+			}
+		});
+
+	std::vector<T> data(cfg.chunk * cfg.channels, sample_value<T>());
+	std::vector<double> stamps(cfg.chunk);
+	const double cpu_start = process_cpu_time();
+	using clock = std::chrono::steady_clock;
+	auto seconds = [](double s) {
+		return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(s));
+	};
+	const auto start = clock::now(), end = start + seconds(duration);
+	// without a rate, the chunks are pushed as fast as possible
+	const auto interval = seconds(cfg.rate > 0 ? cfg.chunk / cfg.rate : 0);
+	for (auto next = start; next < end && clock::now() < end; next += interval) {
+		std::this_thread::sleep_until(next);
+		std::fill(stamps.begin(), stamps.end(), lsl::local_clock());
+		out.push_chunk_multiplexed(data.data(), stamps.data(), data.size());
+		res.pushed += cfg.chunk;
+	}
+	res.elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	// let the inlets drain their buffers
+	done = true;
+	for (auto &t : pullers) t.join();
+	res.cpu = process_cpu_time() - cpu_start;
+
+	std::vector<float> all;
+	for (int k = 0; k < cfg.inlets; ++k) {
+		res.received += received[k];
+		res.dropped += inlets[k]->dropped_samples();
+		all.insert(all.end(), latencies[k].begin(), latencies[k].end());
+	}
+	if (!all.empty()) {
+		std::sort(all.begin(), all.end());
+		auto quantile = [&](double q) {
+			return all[std::min(all.size() - 1, static_cast<std::size_t>(q * all.size()))];
+		};
+		res.lat_p50 = quantile(0.5);
+		res.lat_p99 = quantile(0.99);
+		res.lat_p999 = quantile(0.999);
+	}
+	return res;
+}
+
+static result run(const config &cfg, double duration, int id) {
+	if (cfg.format == "float32") return run<float>(cfg, lsl::cf_float32, duration, id);
+	if (cfg.format == "double64") return run<double>(cfg, lsl::cf_double64, duration, id);
+	if (cfg.format == "int64") return run<int64_t>(cfg, lsl::cf_int64, duration, id);
+	if (cfg.format == "int32") return run<int32_t>(cfg, lsl::cf_int32, duration, id);
+	if (cfg.format == "int16") return run<int16_t>(cfg, lsl::cf_int16, duration, id);
+	if (cfg.format == "int8") return run<char>(cfg, lsl::cf_int8, duration, id);
+	if (cfg.format == "string") return run<std::string>(cfg, lsl::cf_string, duration, id);
+	throw std::invalid_argument("Unknown channel format " + cfg.format);
+}
+
+static const char csv_header[] = "format,channels,chunk,inlets,rate,pushed,received,dropped,"
+								 "elapsed_s,throughput_sps,cpu_ns_per_sample,latency_p50_us,"
+								 "latency_p99_us,latency_p999_us";
+
+static void write_csv(std::ostream &os, const std::vector<result> &results) {
+	os << csv_header << '\n';
+	for (const auto &r : results)
+		os << r.cfg.format << ',' << r.cfg.channels << ',' << r.cfg.chunk << ',' << r.cfg.inlets
+		   << ',' << r.cfg.rate << ',' << r.pushed << ',' << r.received << ',' << r.dropped << ','
+		   << r.elapsed << ',' << r.throughput() << ',' << r.cpu_ns_per_sample() << ','
+		   << r.lat_p50 << ',' << r.lat_p99 << ',' << r.lat_p999 << '\n';
+}
+
+static void write_json(std::ostream &os, const std::vector<result> &results) {
+	os << "{\n  \"library_info\": \"" << lsl::library_info() << "\",\n  \"results\": [";
+	for (std::size_t k = 0; k < results.size(); ++k) {
+		const result &r = results[k];
+		os << (k ? ",\n" : "\n") << "    {\"format\": \"" << r.cfg.format
+		   << "\", \"channels\": " << r.cfg.channels << ", \"chunk\": " << r.cfg.chunk
+		   << ", \"inlets\": " << r.cfg.inlets << ", \"rate\": " << r.cfg.rate
+		   << ", \"pushed\": " << r.pushed << ", \"received\": " << r.received
+		   << ", \"dropped\": " << r.dropped << ", \"elapsed_s\": " << r.elapsed
+		   << ", \"throughput_sps\": " << r.throughput()
+		   << ", \"cpu_ns_per_sample\": " << r.cpu_ns_per_sample()
+		   << ", \"latency_us\": {\"p50\": " << r.lat_p50 << ", \"p99\": " << r.lat_p99
+		   << ", \"p999\": " << r.lat_p999 << "}}";
+	}
+	os << "\n  ]\n}\n";
+}
+
+/// Read the results of a previous run written with `--csv`.
+static std::map<std::tuple<std::string, int, int, int, double>, result> read_baseline(
+	const std::string &filename) {
+	std::ifstream in(filename);
+	if (!in) throw std::runtime_error("Couldn't open the baseline " + filename);
+	std::map<std::tuple<std::string, int, int, int, double>, result> baseline;
+	std::string line;
+	std::getline(in, line);
+	if (line != csv_header) throw std::runtime_error(filename + " isn't a CSV file by lsl_bench");
+	while (std::getline(in, line)) {
+		std::istringstream is(line);
+		result r;
+		std::string field;
+		std::vector<std::string> fields;
+		while (std::getline(is, field, ',')) fields.push_back(field);
+		if (fields.size() < 14) continue;
+		r.cfg = {fields[0], std::stoi(fields[1]), std::stoi(fields[2]), std::stoi(fields[3]),
+			std::stod(fields[4])};
+		r.received = std::stoull(fields[6]);
+		// reconstruct the derived values from the stored ones
+		r.elapsed = r.received / std::max(std::stod(fields[9]), 1e-9);
+		r.cpu = std::stod(fields[10]) * r.received * 1e-9;
+		r.lat_p50 = std::stod(fields[11]);
+		r.lat_p99 = std::stod(fields[12]);
+		r.lat_p999 = std::stod(fields[13]);
+		baseline[r.cfg.key()] = r;
+	}
+	return baseline;
+}
+
+/// Compare the results with a baseline and print the regressions; returns their number.
+static int compare(const std::vector<result> &results,
+	const std::map<std::tuple<std::string, int, int, int, double>, result> &baseline,
+	double tolerance, double latency_slack_us) {
+	int regressions = 0;
+	printf("\n%-9s %4s %5s %3s %7s | %16s %16s %16s\n", "format", "chan", "chunk", "in", "rate",
+		"throughput", "cpu ns/sample", "p99 latency us");
+	for (const auto &r : results) {
+		auto it = baseline.find(r.cfg.key());
+		if (it == baseline.end()) continue;
+		const result &b = it->second;
+		const bool slower = r.throughput() < b.throughput() * (1 - tolerance);
+		const bool costlier = r.cpu_ns_per_sample() > b.cpu_ns_per_sample() * (1 + tolerance);
+		const bool later = r.lat_p99 > b.lat_p99 * (1 + tolerance) + latency_slack_us;
+		auto change = [](double now, double before) {
+			return before != 0 ? (now / before - 1) * 100 : 0.;
+		};
+		printf("%-9s %4d %5d %3d %7g | %+14.1f%%%c %+14.1f%%%c %+14.1f%%%c\n",
+			r.cfg.format.c_str(), r.cfg.channels, r.cfg.chunk, r.cfg.inlets, r.cfg.rate,
+			change(r.throughput(), b.throughput()), slower ? '!' : ' ',
+			change(r.cpu_ns_per_sample(), b.cpu_ns_per_sample()), costlier ? '!' : ' ',
+			change(r.lat_p99, b.lat_p99), later ? '!' : ' ');
+		regressions += slower + costlier + later;
+	}
+	return regressions;
+}
+
+template <typename T> static std::vector<T> parse_list(const std::string &value) {
+	std::vector<T> result;
+	std::istringstream is(value);
+	std::string item;
+	while (std::getline(is, item, ',')) {
+		std::istringstream conv(item);
+		T parsed;
+		conv >> parsed;
+		result.push_back(parsed);
+	}
+	return result;
+}
+
+int main(int argc, char **argv) {
+	std::vector<std::string> formats{"float32", "double64", "int16", "string"};
+	std::vector<int> channels{1, 32, 128}, chunks{1, 32}, inlets{1, 4};
+	std::vector<double> rates{0, 1000};
+	double duration = 1, tolerance = 0.1, latency_slack_us = 50;
+	std::string json_file, csv_file, baseline_file;
+
+	for (int k = 1; k < argc; ++k) {
+		const std::string arg = argv[k];
+		if (arg == "-h" || arg == "--help") {
+			std::cout
+				<< "LSL throughput and latency benchmark\n"
+				<< "Usage: " << argv[0] << " [options]\n\n"
+				<< "Pushes samples from an outlet to inlets in the same process for each\n"
+				<< "combination of the swept parameters and reports the throughput, the CPU\n"
+				<< "time per received sample and the latency percentiles. Without a rate, the\n"
+				<< "latencies include the time the samples wait in the full buffers.\n\n"
+				<< "  --formats LIST    channel formats (float32,double64,int16,string)\n"
+				<< "  --channels LIST   channel counts (1,32,128)\n"
+				<< "  --chunks LIST     samples per pushed chunk (1,32)\n"
+				<< "  --inlets LIST     numbers of inlets (1,4)\n"
+				<< "  --rates LIST      sampling rates in Hz, 0 = as fast as possible (0,1000)\n"
+				<< "  --duration S      seconds per run (1)\n"
+				<< "  --json FILE       write the results as JSON (- for stdout)\n"
+				<< "  --csv FILE        write the results as CSV (- for stdout)\n"
+				<< "  --baseline FILE   compare with the CSV of a previous run, exit with 1\n"
+				<< "                    if any run regressed\n"
+				<< "  --tolerance F     relative change tolerated by the comparison (0.1)\n"
+				<< "  --latency-slack US  absolute latency change tolerated (50)\n";
+			return 0;
+		}
+		if (k + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << std::endl;
+			return 2;
+		}
+		const std::string value = argv[++k];
+		if (arg == "--formats") formats = parse_list<std::string>(value);
+		else if (arg == "--channels") channels = parse_list<int>(value);
+		else if (arg == "--chunks") chunks = parse_list<int>(value);
+		else if (arg == "--inlets") inlets = parse_list<int>(value);
+		else if (arg == "--rates") rates = parse_list<double>(value);
+		else if (arg == "--duration") duration = std::stod(value);
+		else if (arg == "--json") json_file = value;
+		else if (arg == "--csv") csv_file = value;
+		else if (arg == "--baseline") baseline_file = value;
+		else if (arg == "--tolerance") tolerance = std::stod(value);
+		else if (arg == "--latency-slack") latency_slack_us = std::stod(value);
+		else {
+			std::cerr << "Unknown option " << arg << std::endl;
+			return 2;
+		}
+	}
+
+	std::vector<result> results;
+	int id = 0;
+	printf("%-9s %4s %5s %3s %7s | %12s %10s %9s %9s %9s %8s\n", "format", "chan", "chunk", "in",
+		"rate", "samples/s", "cpu ns/smp", "p50 us", "p99 us", "p999 us", "dropped");
+	try {
+		for (const auto &format : formats)
+			for (int nchan : channels)
+				for (int chunk : chunks)
+					for (int ninlets : inlets)
+						for (double rate : rates) {
+							const result r = run({format, nchan, chunk, ninlets, rate}, duration,
+								id++);
+							printf("%-9s %4d %5d %3d %7g | %12.0f %10.1f %9.1f %9.1f %9.1f %8llu\n",
+								format.c_str(), nchan, chunk, ninlets, rate, r.throughput(),
+								r.cpu_ns_per_sample(), r.lat_p50, r.lat_p99, r.lat_p999,
+								static_cast<unsigned long long>(r.dropped));
+							fflush(stdout);
+							results.push_back(r);
+						}
+	} catch (std::exception &e) {
+		std::cerr << "Benchmark failed: " << e.what() << std::endl;
+		return 2;
+	}
+
+	auto write = [&](const std::string &filename, void (*writer)(std::ostream &,
+													  const std::vector<result> &)) {
+		if (filename.empty()) return;
+		if (filename == "-") return writer(std::cout, results);
+		std::ofstream out(filename);
+		out.precision(10);
+		writer(out, results);
+	};
+	write(json_file, write_json);
+	write(csv_file, write_csv);
+
+	if (!baseline_file.empty()) {
+		try {
+			const int regressions =
+				compare(results, read_baseline(baseline_file), tolerance, latency_slack_us);
+			if (regressions) {
+				printf("\n%d regression(s) beyond the tolerance (marked with !)\n", regressions);
+				return 1;
+			}
+			printf("\nNo regressions beyond the tolerance\n");
+		} catch (std::exception &e) {
+			std::cerr << e.what() << std::endl;
+			return 2;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <lsl_cpp.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs an outlet and an inlet in this process and prints how long the samples spent in each
+// stage between push_sample() and pull_sample(). Run with `--help` for more information.
+
+#ifndef LSL_TRACE
+#error "The trace points are only compiled in with the CMake option LSL_TRACE"
+#endif
+
+using lsl::trace_stage;
+
+/// The times a sample passed the stages, 0 if it wasn't seen there
+struct sample_trace {
+	double stage[5]{0, 0, 0, 0, 0};
+	double &operator[](trace_stage s) { return stage[static_cast<int>(s)]; }
+};
+
+static void print_stage(const char *name, std::vector<double> &&durations) {
+	if (durations.empty()) {
+		printf("%-14s %8s\n", name, "-");
+		return;
+	}
+	std::sort(durations.begin(), durations.end());
+	auto us = [&](double q) {
+		return durations[std::min(durations.size() - 1, std::size_t(q * durations.size()))] * 1e6;
+	};
+	printf("%-14s %8zu %10.1f %10.1f %10.1f %10.1f\n", name, durations.size(), us(0.0), us(0.5),
+		us(0.99), durations.back() * 1e6);
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && (argv[1] == std::string("-h") || argv[1] == std::string("--help"))) {
+		std::cout << "LSL latency breakdown\n"
+				  << "Usage: " << argv[0]
+				  << " [samples=10000] [rate=1000] [channels=8] [trace.json]\n\n"
+				  << "Pushes the samples through an outlet and an inlet in this process and prints "
+					 "the time\nthe samples spent in each stage, in microseconds. The recorded "
+					 "events can be saved\nin the Chrome trace format (chrome://tracing, "
+					 "ui.perfetto.dev).\n";
+		return 0;
+	}
+	const int samples = argc > 1 ? std::stoi(argv[1]) : 10000;
+	const double rate = argc > 2 ? std::stod(argv[2]) : 1000.;
+	const int channels = argc > 3 ? std::stoi(argv[3]) : 8;
+
+	lsl::stream_info info("TraceLatency", "Benchmark", channels, rate, lsl::cf_float32);
+	lsl::stream_outlet out(info);
+	auto found = lsl::resolve_stream("name", info.name(), 1, 5.);
+	if (found.empty()) {
+		std::cerr << "Couldn't resolve the outlet" << std::endl;
+		return 1;
+	}
+	lsl::stream_inlet in(found[0]);
+	in.open_stream(5.);
+	out.wait_for_consumers(5.);
+	lsl::trace_clear();
+
+	std::thread puller([&]() {
+		std::vector<float> sample(channels);
+		for (int k = 0; k < samples; ++k)
+			if (in.pull_sample(sample, 5.) == 0.0) break;
+	});
+	std::vector<float> sample(channels);
+	auto next = std::chrono::steady_clock::now();
+	const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1. / rate));
+	for (int k = 0; k < samples; ++k) {
+		std::this_thread::sleep_until(next += interval);
+		sample[0] = static_cast<float>(k);
+		out.push_sample(sample, lsl::local_clock());
+	}
+	puller.join();
+
+	// match the events by the samples' timestamps; a `written` event completes the samples its
+	// thread dequeued before
+	const auto events = lsl::trace_events();
+	std::map<double, sample_trace> traces;
+	std::vector<double> unwritten;
+	uint32_t thread = ~0u;
+	for (const auto &e : events) {
+		if (e.thread != thread) unwritten.clear();
+		thread = e.thread;
+		if (e.stage == trace_stage::written) {
+			for (double key : unwritten) traces[key][e.stage] = e.time;
+			unwritten.clear();
+			continue;
+		}
+		double &time = traces[e.key][e.stage];
+		if (time == 0.0) time = e.time;
+		if (e.stage == trace_stage::dequeue) unwritten.push_back(e.key);
+	}
+
+	auto durations = [&](trace_stage from, trace_stage to) {
+		std::vector<double> result;
+		for (auto &t : traces)
+			if (t.second[from] != 0.0 && t.second[to] != 0.0)
+				result.push_back(t.second[to] - t.second[from]);
+		return result;
+	};
+	printf("%-14s %8s %10s %10s %10s %10s\n", "stage [us]", "samples", "min", "p50", "p99", "max");
+	print_stage("send buffer", durations(trace_stage::enqueue, trace_stage::dequeue));
+	print_stage("serialize", durations(trace_stage::dequeue, trace_stage::written));
+	print_stage("transport", durations(trace_stage::written, trace_stage::received));
+	print_stage("inlet buffer", durations(trace_stage::received, trace_stage::pulled));
+	print_stage("total", durations(trace_stage::enqueue, trace_stage::pulled));
+
+	if (argc > 4) {
+		std::ofstream trace(argv[4]);
+		lsl::trace_write_chrome(trace);
+		std::cout << "Wrote " << events.size() << " events to " << argv[4] << std::endl;
+	}
+	return 0;
+}